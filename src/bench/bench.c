@@ -0,0 +1,650 @@
+#define _POSIX_C_SOURCE 200809L
+// Benchmark harness: microbenchmarks for instruction dispatch, the
+// assembler, T3 files, device I/O and interrupts, plus scaled-up versions
+// of the demo programs. Results are printed as JSON and compared against
+// a stored baseline.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ternuino.h"
+#include "assembler.h"
+#include "devices.h"
+#include "ternio.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#define BENCH_SOURCE_SIZE 4096
+#define BENCH_BODY_COPIES 20        // Copies of the measured instruction per loop
+#define BENCH_START_SIZE 1024
+#define BENCH_MAX_SIZE 100000000    // Loop counts must fit an immediate
+#define BENCH_DEFAULT_MIN_TIME 0.2
+#define BENCH_DEFAULT_REPS 3
+#define BENCH_DEFAULT_THRESHOLD 10.0
+
+typedef struct {
+    const char *scratch_dir;    // Where file benchmarks put their files
+    double start;
+    double elapsed;             // Time of the measured part of the last run
+} bench_context_t;
+
+// One benchmark. run() does n units of work, times the part that matters
+// with bench_begin/bench_end and returns the number of ops, 0 on failure.
+typedef struct {
+    const char *name;
+    const char *unit;
+    uint64_t (*run)(bench_context_t *ctx, uint64_t n, const void *arg);
+    const void *arg;
+} benchmark_t;
+
+typedef struct {
+    const benchmark_t *bench;
+    uint64_t ops;
+    double seconds;
+    double ns_per_op;
+    double baseline_ns;         // Negative if the baseline has no entry
+} bench_result_t;
+
+static double now_seconds(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+static void bench_begin(bench_context_t *ctx) {
+    ctx->start = now_seconds();
+}
+
+static void bench_end(bench_context_t *ctx) {
+    ctx->elapsed = now_seconds() - ctx->start;
+}
+
+static void scratch_path(const bench_context_t *ctx, const char *name, char *path, size_t size) {
+    snprintf(path, size, "%s/%s", ctx->scratch_dir, name);
+}
+
+// Assemble a benchmark program into a fresh CPU, .irq handlers included
+static bool load_program(ternuino_t *cpu, const char *source) {
+    assembler_t asm_state;
+    instruction_t program[MAX_MEMORY_SIZE];
+    int32_t size = 0;
+
+    assembler_init(&asm_state);
+    bool success = assembler_parse_source(&asm_state, source, strlen(source), program, &size);
+    if (success) {
+        ternuino_init(cpu, MAX_DATA_MEMORY_SIZE);
+        for (int i = 0; i < MAX_IRQ_VECTORS; i++) {
+            if (asm_state.irq_handlers[i] >= 0) {
+                ternuino_set_irq_handler(cpu, i, asm_state.irq_handlers[i]);
+            }
+        }
+        ternuino_load_program(cpu, program, size, asm_state.data_image, asm_state.data_size);
+    }
+    assembler_free(&asm_state);
+    return success;
+}
+
+static void free_devices(ternuino_t *cpu) {
+    for (int i = 0; i < cpu->device_count; i++) {
+        if (cpu->devices[i]) {
+            device_destroy(cpu->devices[i]);
+            cpu->devices[i] = NULL;
+        }
+    }
+}
+
+// Run a loaded CPU to HLT; the ops are the instructions executed
+static uint64_t run_cpu(bench_context_t *ctx, ternuino_t *cpu) {
+    bench_begin(ctx);
+    ternuino_run(cpu);
+    bench_end(ctx);
+    return cpu->cycles;
+}
+
+// Dispatch: one instruction repeated in a counted loop
+typedef struct {
+    const char *instr;
+    bool branch;                // instr takes a label operand naming the next line
+} dispatch_case_t;
+
+static uint64_t bench_dispatch(bench_context_t *ctx, uint64_t n, const void *arg) {
+    const dispatch_case_t *c = arg;
+    char source[BENCH_SOURCE_SIZE];
+    int len = snprintf(source, sizeof(source), "    MOV B, 1\n    MOV C, %d\nloop:\n", (int)n);
+
+    for (int i = 0; i < BENCH_BODY_COPIES; i++) {
+        if (c->branch) {
+            len += snprintf(source + len, sizeof(source) - (size_t)len, "    %s next%d\nnext%d:\n", c->instr, i, i);
+        } else {
+            len += snprintf(source + len, sizeof(source) - (size_t)len, "    %s\n", c->instr);
+        }
+    }
+    snprintf(source + len, sizeof(source) - (size_t)len, "    SUB C, B\n    TJP C, loop\n    HLT\n");
+
+    ternuino_t cpu;
+    if (!load_program(&cpu, source)) return 0;
+    return run_cpu(ctx, &cpu);
+}
+
+static const dispatch_case_t dispatch_nop = { "NOP", false };
+static const dispatch_case_t dispatch_mov = { "MOV A, B", false };
+static const dispatch_case_t dispatch_add = { "ADD A, B", false };
+static const dispatch_case_t dispatch_sub = { "SUB A, B", false };
+static const dispatch_case_t dispatch_mul = { "MUL A, B", false };
+static const dispatch_case_t dispatch_div = { "DIV A, B", false };
+static const dispatch_case_t dispatch_tand = { "TAND A, B", false };
+static const dispatch_case_t dispatch_tor = { "TOR A, B", false };
+static const dispatch_case_t dispatch_tnot = { "TNOT A", false };
+static const dispatch_case_t dispatch_neg = { "NEG A", false };
+static const dispatch_case_t dispatch_tsign = { "TSIGN A", false };
+static const dispatch_case_t dispatch_tabs = { "TABS A", false };
+static const dispatch_case_t dispatch_tshl3 = { "TSHL3 A", false };
+static const dispatch_case_t dispatch_tshr3 = { "TSHR3 A", false };
+static const dispatch_case_t dispatch_tcmpr = { "TCMPR A, B", false };
+static const dispatch_case_t dispatch_lea = { "LEA A, 5", false };
+static const dispatch_case_t dispatch_ld = { "LD A, 5", false };
+static const dispatch_case_t dispatch_st = { "ST B, 5", false };
+static const dispatch_case_t dispatch_jmp = { "JMP", true };
+static const dispatch_case_t dispatch_tjz = { "TJZ A,", true };     // A is 0: taken
+static const dispatch_case_t dispatch_tjn = { "TJN A,", true };     // Not taken
+
+// Assembler: a small program with labels and comments, parsed n times
+static const char assembler_program[] =
+    "# Counted loop with a three-way branch\n"
+    ".data\n"
+    "count:  .word 100\n"
+    "one:    .word 1\n"
+    ".text\n"
+    "loop:\n"
+    "    LD A, count        # A = count\n"
+    "    TSIGN A\n"
+    "    TJN A, negative\n"
+    "    TJZ A, zero\n"
+    "    MOV C, 1\n"
+    "    JMP next\n"
+    "negative:\n"
+    "    MOV C, -1\n"
+    "    JMP next\n"
+    "zero:\n"
+    "    MOV C, 0\n"
+    "next:\n"
+    "    LD A, count\n"
+    "    LD B, one\n"
+    "    SUB A, B\n"
+    "    ST A, count\n"
+    "    TJP A, loop\n"
+    "    HLT\n";
+
+static uint64_t bench_assembler_source(bench_context_t *ctx, uint64_t n, const void *arg) {
+    (void)arg;
+    size_t size = sizeof(assembler_program) - 1;
+    uint64_t lines = 0;
+    for (size_t i = 0; i < size; i++) {
+        if (assembler_program[i] == '\n') lines++;
+    }
+
+    instruction_t program[MAX_MEMORY_SIZE];
+    int32_t program_size;
+    bench_begin(ctx);
+    for (uint64_t i = 0; i < n; i++) {
+        assembler_t asm_state;
+        assembler_init(&asm_state);
+        bool success = assembler_parse_source(&asm_state, assembler_program, size, program, &program_size);
+        assembler_free(&asm_state);
+        if (!success) return 0;
+    }
+    bench_end(ctx);
+    return n * lines;
+}
+
+// Assembler: one source with n label definitions
+static uint64_t bench_assembler_labels(bench_context_t *ctx, uint64_t n, const void *arg) {
+    (void)arg;
+    size_t capacity = (size_t)n * 16 + 16;
+    char *source = malloc(capacity);
+    if (!source) return 0;
+
+    size_t len = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        len += (size_t)snprintf(source + len, capacity - len, "label%llu:\n", (unsigned long long)i);
+    }
+    len += (size_t)snprintf(source + len, capacity - len, "    HLT\n");
+
+    assembler_t asm_state;
+    instruction_t program[MAX_MEMORY_SIZE];
+    int32_t program_size;
+    assembler_init(&asm_state);
+    bench_begin(ctx);
+    bool success = assembler_parse_source(&asm_state, source, len, program, &program_size);
+    bench_end(ctx);
+    assembler_free(&asm_state);
+    free(source);
+    return success ? n : 0;
+}
+
+static int32_t sample_value(uint64_t i) {
+    return (int32_t)(i % 20001) - 10000;
+}
+
+static bool write_t3_file(const char *path, uint64_t n) {
+    t3_writer_t writer;
+    if (!t3_writer_open(&writer, path, T3_DEFAULT_INDEX_STRIDE)) return false;
+    bool success = true;
+    for (uint64_t i = 0; i < n && success; i++) {
+        success = t3_writer_put(&writer, sample_value(i));
+    }
+    return t3_writer_finish(&writer) && success;
+}
+
+static uint64_t bench_t3_write(bench_context_t *ctx, uint64_t n, const void *arg) {
+    (void)arg;
+    char path[512];
+    scratch_path(ctx, "bench_write.t3", path, sizeof(path));
+
+    bench_begin(ctx);
+    bool success = write_t3_file(path, n);
+    bench_end(ctx);
+    remove(path);
+    return success ? n : 0;
+}
+
+static uint64_t bench_t3_read(bench_context_t *ctx, uint64_t n, const void *arg) {
+    (void)arg;
+    char path[512];
+    scratch_path(ctx, "bench_read.t3", path, sizeof(path));
+    if (!write_t3_file(path, n)) return 0;
+
+    int32_t values[T3_BATCH_SIZE];
+    uint64_t total = 0;
+    t3_reader_t reader;
+    bench_begin(ctx);
+    if (t3_reader_open(&reader, path)) {
+        size_t count;
+        while ((count = t3_reader_read(&reader, values, T3_BATCH_SIZE)) > 0) {
+            total += count;
+        }
+        t3_reader_close(&reader);
+    }
+    bench_end(ctx);
+    remove(path);
+    return total == n ? n : 0;
+}
+
+// Device I/O: TWRITE or TREAD through the file device on channel 1
+static uint64_t bench_device(bench_context_t *ctx, uint64_t n, const void *arg) {
+    bool write = arg != NULL;
+    char path[512];
+    scratch_path(ctx, "bench_device.t3", path, sizeof(path));
+    if (!write && !write_t3_file(path, n * BENCH_BODY_COPIES)) return 0;
+
+    char source[BENCH_SOURCE_SIZE];
+    int len = snprintf(source, sizeof(source), "    TOPEN 1, %d\n    MOV B, 1\n    MOV C, %d\nloop:\n",
+                       write ? 1 : 0, (int)n);
+    for (int i = 0; i < BENCH_BODY_COPIES; i++) {
+        len += snprintf(source + len, sizeof(source) - (size_t)len, write ? "    TWRITE 1, B\n" : "    TREAD 1, A\n");
+    }
+    snprintf(source + len, sizeof(source) - (size_t)len, "    SUB C, B\n    TJP C, loop\n    TCLOSE 1\n    HLT\n");
+
+    ternuino_t cpu;
+    if (!load_program(&cpu, source)) return 0;
+    device_t *file_dev = file_device_create(1, 1);
+    if (!file_dev) return 0;
+    file_device_bind(file_dev, 0, path, write ? FILE_MODE_WRITE : FILE_MODE_READ);
+    ternuino_register_device(&cpu, file_dev);
+
+    // The TCLOSE that finalizes a written file is part of the cost
+    run_cpu(ctx, &cpu);
+    bool success = cpu.registers[REG_A] >= 0;
+    free_devices(&cpu);
+    remove(path);
+    return success ? n * BENCH_BODY_COPIES : 0;
+}
+
+// Interrupts: a software IRQ and its IRET per loop iteration
+static uint64_t bench_interrupt(bench_context_t *ctx, uint64_t n, const void *arg) {
+    (void)arg;
+    char source[BENCH_SOURCE_SIZE];
+    snprintf(source, sizeof(source),
+             ".irq 5, handler\n"
+             "    MOV B, 1\n"
+             "    MOV C, %d\n"
+             "    EI\n"
+             "loop:\n"
+             "    IRQ 5\n"
+             "    SUB C, B\n"
+             "    TJP C, loop\n"
+             "    HLT\n"
+             "handler:\n"
+             "    IRET\n", (int)n);
+
+    ternuino_t cpu;
+    if (!load_program(&cpu, source)) return 0;
+    run_cpu(ctx, &cpu);
+    return cpu.cycles == n * 4 + 3 + 1 ? n : 0;
+}
+
+// Workloads: the demo programs wrapped in a loop counted in data memory
+static const char workload_fibonacci[] =
+    ".data\n"
+    "count: .word %d\n"
+    ".text\n"
+    "outer:\n"
+    "    MOV A, 0\n"
+    "    MOV B, 1\n"
+    "    MOV C, 0\n"
+    "    ADD C, A\n"
+    "    ADD C, B\n"
+    "    MOV A, B\n"
+    "    MOV B, C\n"
+    "    MOV C, 0\n"
+    "    ADD C, A\n"
+    "    ADD C, B\n"
+    "    MOV A, B\n"
+    "    MOV B, C\n"
+    "    MOV C, 0\n"
+    "    ADD C, A\n"
+    "    ADD C, B\n"
+    "    MOV A, B\n"
+    "    MOV B, C\n"
+    "    LD C, count\n"
+    "    MOV A, 1\n"
+    "    SUB C, A\n"
+    "    ST C, count\n"
+    "    TJP C, outer\n"
+    "    HLT\n";
+
+static const char workload_select[] =
+    ".data\n"
+    "count: .word %d\n"
+    ".text\n"
+    "loop:\n"
+    "    LD A, count\n"
+    "    MOV B, 3\n"
+    "    MOV C, A\n"
+    "    DIV C, B\n"
+    "    MUL C, B\n"
+    "    SUB A, C           # count mod 3\n"
+    "    MOV B, 1\n"
+    "    SUB A, B           # -1, 0 or +1\n"
+    "    TJN A, negative\n"
+    "    TJZ A, zero\n"
+    "    MOV C, 1\n"
+    "    JMP next\n"
+    "negative:\n"
+    "    MOV C, -1\n"
+    "    JMP next\n"
+    "zero:\n"
+    "    MOV C, 0\n"
+    "next:\n"
+    "    LD A, count\n"
+    "    SUB A, B\n"
+    "    ST A, count\n"
+    "    TJP A, loop\n"
+    "    HLT\n";
+
+static const char workload_memory[] =
+    ".data\n"
+    "x:     .word 1\n"
+    "y:     .word -1\n"
+    "sum:   .word 0\n"
+    "count: .word %d\n"
+    ".text\n"
+    "loop:\n"
+    "    LEA A, x\n"
+    "    LD B, [A]\n"
+    "    LEA A, y\n"
+    "    LD C, [A]\n"
+    "    ADD B, C\n"
+    "    LD C, sum\n"
+    "    ADD C, B\n"
+    "    ST C, sum\n"
+    "    LD A, count\n"
+    "    MOV B, 1\n"
+    "    SUB A, B\n"
+    "    ST A, count\n"
+    "    TJP A, loop\n"
+    "    HLT\n";
+
+static uint64_t bench_workload(bench_context_t *ctx, uint64_t n, const void *arg) {
+    char source[BENCH_SOURCE_SIZE];
+    snprintf(source, sizeof(source), (const char*)arg, (int)n);
+
+    ternuino_t cpu;
+    if (!load_program(&cpu, source)) return 0;
+    return run_cpu(ctx, &cpu);
+}
+
+static const benchmark_t benchmarks[] = {
+    { "dispatch.nop", "instruction", bench_dispatch, &dispatch_nop },
+    { "dispatch.mov", "instruction", bench_dispatch, &dispatch_mov },
+    { "dispatch.add", "instruction", bench_dispatch, &dispatch_add },
+    { "dispatch.sub", "instruction", bench_dispatch, &dispatch_sub },
+    { "dispatch.mul", "instruction", bench_dispatch, &dispatch_mul },
+    { "dispatch.div", "instruction", bench_dispatch, &dispatch_div },
+    { "dispatch.tand", "instruction", bench_dispatch, &dispatch_tand },
+    { "dispatch.tor", "instruction", bench_dispatch, &dispatch_tor },
+    { "dispatch.tnot", "instruction", bench_dispatch, &dispatch_tnot },
+    { "dispatch.neg", "instruction", bench_dispatch, &dispatch_neg },
+    { "dispatch.tsign", "instruction", bench_dispatch, &dispatch_tsign },
+    { "dispatch.tabs", "instruction", bench_dispatch, &dispatch_tabs },
+    { "dispatch.tshl3", "instruction", bench_dispatch, &dispatch_tshl3 },
+    { "dispatch.tshr3", "instruction", bench_dispatch, &dispatch_tshr3 },
+    { "dispatch.tcmpr", "instruction", bench_dispatch, &dispatch_tcmpr },
+    { "dispatch.lea", "instruction", bench_dispatch, &dispatch_lea },
+    { "dispatch.ld", "instruction", bench_dispatch, &dispatch_ld },
+    { "dispatch.st", "instruction", bench_dispatch, &dispatch_st },
+    { "dispatch.jmp", "instruction", bench_dispatch, &dispatch_jmp },
+    { "dispatch.tjz_taken", "instruction", bench_dispatch, &dispatch_tjz },
+    { "dispatch.tjn_not_taken", "instruction", bench_dispatch, &dispatch_tjn },
+    { "assembler.source", "line", bench_assembler_source, NULL },
+    { "assembler.labels", "label", bench_assembler_labels, NULL },
+    { "t3.write", "value", bench_t3_write, NULL },
+    { "t3.read", "value", bench_t3_read, NULL },
+    { "device.file_write", "value", bench_device, "write" },
+    { "device.file_read", "value", bench_device, NULL },
+    { "interrupt.round_trip", "interrupt", bench_interrupt, NULL },
+    { "workload.fibonacci", "instruction", bench_workload, workload_fibonacci },
+    { "workload.select", "instruction", bench_workload, workload_select },
+    { "workload.memory", "instruction", bench_workload, workload_memory },
+};
+
+#define BENCHMARK_COUNT ((int)(sizeof(benchmarks) / sizeof(benchmarks[0])))
+
+// Grow n until one run takes min_time, then keep the best of reps runs
+static bool measure(bench_context_t *ctx, const benchmark_t *bench, double min_time, int reps,
+                    bench_result_t *result) {
+    uint64_t n = BENCH_START_SIZE;
+
+    for (;;) {
+        if (bench->run(ctx, n, bench->arg) == 0) return false;
+        if (ctx->elapsed >= min_time || n >= BENCH_MAX_SIZE) break;
+
+        // Aim a little past min_time, growing at most 16x per step
+        double factor = ctx->elapsed > 0 ? min_time * 1.2 / ctx->elapsed : 16.0;
+        if (factor > 16.0) factor = 16.0;
+        if (factor < 2.0) factor = 2.0;
+        n = (uint64_t)((double)n * factor);
+        if (n > BENCH_MAX_SIZE) n = BENCH_MAX_SIZE;
+    }
+
+    result->bench = bench;
+    result->ns_per_op = -1.0;
+    for (int rep = 0; rep < reps; rep++) {
+        uint64_t ops = bench->run(ctx, n, bench->arg);
+        if (ops == 0) return false;
+        double ns = ctx->elapsed * 1e9 / (double)ops;
+        if (result->ns_per_op < 0 || ns < result->ns_per_op) {
+            result->ops = ops;
+            result->seconds = ctx->elapsed;
+            result->ns_per_op = ns;
+        }
+    }
+    return true;
+}
+
+// Look up ns_per_op for each result in a file written by --output. One
+// benchmark per line, as write_json produces.
+static bool load_baseline(const char *filename, bench_result_t *results, int count) {
+    FILE *file = fopen(filename, "r");
+    if (!file) return false;
+
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        char *name = strstr(line, "\"name\": \"");
+        char *ns = strstr(line, "\"ns_per_op\": ");
+        if (!name || !ns) continue;
+
+        name += strlen("\"name\": \"");
+        char *end = strchr(name, '"');
+        if (!end) continue;
+        *end = '\0';
+
+        for (int i = 0; i < count; i++) {
+            if (strcmp(results[i].bench->name, name) == 0) {
+                results[i].baseline_ns = strtod(ns + strlen("\"ns_per_op\": "), NULL);
+            }
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+static double change_percent(const bench_result_t *result) {
+    return (result->ns_per_op - result->baseline_ns) * 100.0 / result->baseline_ns;
+}
+
+static bool is_regression(const bench_result_t *result, double threshold) {
+    return result->baseline_ns > 0 && change_percent(result) > threshold;
+}
+
+static void write_json(FILE *out, const bench_result_t *results, int count, double min_time, int reps,
+                       double threshold, int regressions) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"min_time\": %.3f,\n", min_time);
+    fprintf(out, "  \"repetitions\": %d,\n", reps);
+    fprintf(out, "  \"threshold_percent\": %.1f,\n", threshold);
+    fprintf(out, "  \"benchmarks\": [\n");
+    for (int i = 0; i < count; i++) {
+        const bench_result_t *r = &results[i];
+        fprintf(out, "    {\"name\": \"%s\", \"unit\": \"%s\", \"ops\": %llu, \"seconds\": %.6f, "
+                     "\"ns_per_op\": %.3f, \"ops_per_sec\": %.0f",
+                r->bench->name, r->bench->unit, (unsigned long long)r->ops, r->seconds,
+                r->ns_per_op, 1e9 / r->ns_per_op);
+        if (r->baseline_ns > 0) {
+            fprintf(out, ", \"baseline_ns_per_op\": %.3f, \"change_percent\": %.1f, \"regression\": %s",
+                    r->baseline_ns, change_percent(r), is_regression(r, threshold) ? "true" : "false");
+        }
+        fprintf(out, "}%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(out, "  ],\n");
+    fprintf(out, "  \"regressions\": %d\n", regressions);
+    fprintf(out, "}\n");
+}
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [options]\n", prog);
+    printf("Options:\n");
+    printf("  --filter TEXT      Run only benchmarks whose name contains TEXT\n");
+    printf("  --list             List the benchmarks and exit\n");
+    printf("  --min-time SEC     Minimum time of one measured run (default %.1f)\n", BENCH_DEFAULT_MIN_TIME);
+    printf("  --reps N           Measured runs per benchmark; the fastest counts (default %d)\n", BENCH_DEFAULT_REPS);
+    printf("  --baseline FILE    Compare with results saved by --output\n");
+    printf("  --threshold PCT    Slowdown against the baseline that fails the run (default %.0f)\n",
+           BENCH_DEFAULT_THRESHOLD);
+    printf("  --output FILE      Also write the JSON results to FILE\n");
+    printf("  --scratch DIR      Directory for temporary files (default .)\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *filter = NULL;
+    const char *baseline = NULL;
+    const char *output = NULL;
+    double min_time = BENCH_DEFAULT_MIN_TIME;
+    double threshold = BENCH_DEFAULT_THRESHOLD;
+    int reps = BENCH_DEFAULT_REPS;
+    bench_context_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.scratch_dir = ".";
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            min_time = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+            reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--scratch") == 0 && i + 1 < argc) {
+            ctx.scratch_dir = argv[++i];
+        } else if (strcmp(argv[i], "--list") == 0) {
+            for (int b = 0; b < BENCHMARK_COUNT; b++) {
+                printf("%-26s ns per %s\n", benchmarks[b].name, benchmarks[b].unit);
+            }
+            return 0;
+        } else {
+            print_usage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+    if (reps < 1) reps = 1;
+
+    bench_result_t results[BENCHMARK_COUNT];
+    int count = 0;
+    bool failed = false;
+    for (int b = 0; b < BENCHMARK_COUNT; b++) {
+        if (filter && !strstr(benchmarks[b].name, filter)) continue;
+
+        fprintf(stderr, "%-26s", benchmarks[b].name);
+        fflush(stderr);
+        if (!measure(&ctx, &benchmarks[b], min_time, reps, &results[count])) {
+            fprintf(stderr, " failed\n");
+            failed = true;
+            continue;
+        }
+        fprintf(stderr, " %10.3f ns/%s\n", results[count].ns_per_op, benchmarks[b].unit);
+        results[count].baseline_ns = -1.0;
+        count++;
+    }
+
+    if (baseline && !load_baseline(baseline, results, count)) {
+        fprintf(stderr, "No baseline at %s; record one with --output (make bench-baseline).\n", baseline);
+    }
+
+    int regressions = 0;
+    for (int i = 0; i < count; i++) {
+        if (is_regression(&results[i], threshold)) {
+            fprintf(stderr, "Regression: %s is %.1f%% slower than the baseline (%.3f -> %.3f ns/%s)\n",
+                    results[i].bench->name, change_percent(&results[i]), results[i].baseline_ns,
+                    results[i].ns_per_op, results[i].bench->unit);
+            regressions++;
+        }
+    }
+
+    write_json(stdout, results, count, min_time, reps, threshold, regressions);
+    if (output) {
+        FILE *file = fopen(output, "w");
+        if (!file) {
+            fprintf(stderr, "Error: Cannot write '%s'.\n", output);
+            return 1;
+        }
+        write_json(file, results, count, min_time, reps, threshold, regressions);
+        fclose(file);
+    }
+
+    return failed || regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,41 @@
+@echo off
+REM Build Workload Generator
+REM This script builds the asmgen.exe workload generator separately
+
+setlocal enabledelayedexpansion
+
+echo Building Workload Generator...
+echo.
+
+REM Check if GCC is available
+where gcc >nul 2>&1
+if %errorlevel% neq 0 (
+    echo Error: GCC not found in PATH
+    exit /b 1
+)
+
+REM Create build directory if it doesn't exist
+if not exist "build" mkdir build
+
+REM Compiler settings
+set CC=gcc
+set CFLAGS=-Wall -Wextra -std=c99 -O2 -Iinclude
+set TARGET=build\asmgen.exe
+
+echo Compiling Workload Generator...
+%CC% %CFLAGS% src\asmgen.c -o %TARGET%
+if !errorlevel! neq 0 (
+    echo Error compiling Workload Generator
+    exit /b 1
+)
+
+echo.
+echo Build successful! Workload Generator created: %TARGET%
+
+REM Test that executable was created
+if exist "%TARGET%" (
+    echo ✅ Workload Generator build completed successfully
+) else (
+    echo ❌ Workload Generator build failed - executable not found
+    exit /b 1
+)
@@ -60,6 +60,66 @@ echo   Compiling src\devices.c...
 %CC% %CFLAGS% -c src\devices.c -o build\obj\devices.o
 if !errorlevel! neq 0 exit /b 1
 
+echo   Compiling src\mapfile.c...
+%CC% %CFLAGS% -c src\mapfile.c -o build\obj\mapfile.o
+if !errorlevel! neq 0 exit /b 1
+
+echo   Compiling src\tritconv.c...
+%CC% %CFLAGS% -c src\tritconv.c -o build\obj\tritconv.o
+if !errorlevel! neq 0 exit /b 1
+
+echo   Compiling src\stream.c...
+%CC% %CFLAGS% -c src\stream.c -o build\obj\stream.o
+if !errorlevel! neq 0 exit /b 1
+
+echo   Compiling src\shmem.c...
+%CC% %CFLAGS% -c src\shmem.c -o build\obj\shmem.o
+if !errorlevel! neq 0 exit /b 1
+
+echo   Compiling src\t3async.c...
+%CC% %CFLAGS% -c src\t3async.c -o build\obj\t3async.o
+if !errorlevel! neq 0 exit /b 1
+
+echo   Compiling src\lexer.c...
+%CC% %CFLAGS% -c src\lexer.c -o build\obj\lexer.o
+if !errorlevel! neq 0 exit /b 1
+
+echo   Compiling src\tbo.c...
+%CC% %CFLAGS% -c src\tbo.c -o build\obj\tbo.o
+if !errorlevel! neq 0 exit /b 1
+
+echo   Compiling src\linker.c...
+%CC% %CFLAGS% -c src\linker.c -o build\obj\linker.o
+if !errorlevel! neq 0 exit /b 1
+
+echo   Compiling src\optimizer.c...
+%CC% %CFLAGS% -c src\optimizer.c -o build\obj\optimizer.o
+if !errorlevel! neq 0 exit /b 1
+
+echo   Compiling src\runtime.c...
+%CC% %CFLAGS% -c src\runtime.c -o build\obj\runtime.o
+if !errorlevel! neq 0 exit /b 1
+
+echo   Compiling src\libternuino.c...
+%CC% %CFLAGS% -c src\libternuino.c -o build\obj\libternuino.o
+if !errorlevel! neq 0 exit /b 1
+
+echo   Compiling src\server.c...
+%CC% %CFLAGS% -c src\server.c -o build\obj\server.o
+if !errorlevel! neq 0 exit /b 1
+
+echo   Compiling src\multicore.c...
+%CC% %CFLAGS% -c src\multicore.c -o build\obj\multicore.o
+if !errorlevel! neq 0 exit /b 1
+
+echo   Compiling src\mailbox.c...
+%CC% %CFLAGS% -c src\mailbox.c -o build\obj\mailbox.o
+if !errorlevel! neq 0 exit /b 1
+
+echo   Compiling src\scheduler.c...
+%CC% %CFLAGS% -c src\scheduler.c -o build\obj\scheduler.o
+if !errorlevel! neq 0 exit /b 1
+
 echo Linking executable...
 %CC% build\obj\*.o -o %TARGET%
 if !errorlevel! neq 0 exit /b 1
@@ -0,0 +1,51 @@
+@echo off
+REM Build the Embedding Library
+REM This script builds libternuino.a and ternuino.dll for hosts that run the simulator in-process
+
+setlocal enabledelayedexpansion
+
+echo Building Embedding Library...
+echo.
+
+REM Check if GCC is available
+where gcc >nul 2>&1
+if %errorlevel% neq 0 (
+    echo Error: GCC not found in PATH
+    exit /b 1
+)
+
+REM Create build directory structure
+if not exist "build" mkdir build
+if not exist "build\lib" mkdir build\lib
+
+REM Compiler settings
+set CC=gcc
+set CFLAGS=-Wall -Wextra -std=c99 -O2 -Iinclude
+set SOURCES=src\ternuino.c src\assembler.c src\tritlogic.c src\tritarith.c src\tritword.c src\ternio.c src\devices.c src\mapfile.c src\tritconv.c src\stream.c src\shmem.c src\t3async.c src\lexer.c src\tbo.c src\linker.c src\optimizer.c src\runtime.c src\libternuino.c src\server.c src\multicore.c src\mailbox.c src\scheduler.c
+
+echo Compiling library sources...
+for %%f in (%SOURCES%) do (
+    echo   Compiling %%f...
+    %CC% %CFLAGS% -c %%f -o build\lib\%%~nf.o
+    if !errorlevel! neq 0 (
+        echo Error compiling %%f
+        exit /b 1
+    )
+)
+
+echo Archiving build\libternuino.a...
+ar rcs build\libternuino.a build\lib\*.o
+if !errorlevel! neq 0 (
+    echo Error creating static library
+    exit /b 1
+)
+
+echo Linking build\ternuino.dll...
+%CC% -shared build\lib\*.o -o build\ternuino.dll -Wl,--out-implib,build\libternuino.dll.a
+if !errorlevel! neq 0 (
+    echo Error linking shared library
+    exit /b 1
+)
+
+echo.
+echo Build successful! Libraries created: build\libternuino.a, build\ternuino.dll
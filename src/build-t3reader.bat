@@ -23,7 +23,7 @@ set CFLAGS=-Wall -Wextra -std=c99 -O2 -Iinclude
 set TARGET=build\t3reader.exe
 
 echo Compiling T3 Reader...
-%CC% %CFLAGS% src\t3reader.c src\ternio.c -o %TARGET%
+%CC% %CFLAGS% src\t3reader.c src\ternio.c src\mapfile.c src\tritconv.c src\runtime.c -o %TARGET%
 if !errorlevel! neq 0 (
     echo Error compiling T3 Reader
     exit /b 1
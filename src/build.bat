@@ -46,7 +46,7 @@ if not exist "build\obj" mkdir build\obj
 REM Compiler settings
 set CC=gcc
 set CFLAGS=-Wall -Wextra -std=c99 -O2 -Iinclude
-set SOURCES=src\main.c src\ternuino.c src\assembler.c src\tritlogic.c src\tritarith.c src\tritword.c src\ternio.c src\devices.c
+set SOURCES=src\main.c src\ternuino.c src\assembler.c src\tritlogic.c src\tritarith.c src\tritword.c src\ternio.c src\devices.c src\mapfile.c src\tritconv.c src\stream.c src\shmem.c src\t3async.c src\lexer.c src\tbo.c src\linker.c src\optimizer.c src\runtime.c src\libternuino.c src\server.c src\multicore.c src\mailbox.c src\scheduler.c
 set TARGET=build\ternuino.exe
 
 echo Building Ternuino CPU Simulator...
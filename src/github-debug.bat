@@ -61,6 +61,96 @@ if errorlevel 1 (
     exit /b 1
 )
 
+gcc -Wall -Wextra -std=c99 -g -O0 -Iinclude -c src/mapfile.c -o build/obj/mapfile.o
+if errorlevel 1 (
+    echo Error compiling mapfile.c
+    exit /b 1
+)
+
+gcc -Wall -Wextra -std=c99 -g -O0 -Iinclude -c src/tritconv.c -o build/obj/tritconv.o
+if errorlevel 1 (
+    echo Error compiling tritconv.c
+    exit /b 1
+)
+
+gcc -Wall -Wextra -std=c99 -g -O0 -Iinclude -c src/stream.c -o build/obj/stream.o
+if errorlevel 1 (
+    echo Error compiling stream.c
+    exit /b 1
+)
+
+gcc -Wall -Wextra -std=c99 -g -O0 -Iinclude -c src/shmem.c -o build/obj/shmem.o
+if errorlevel 1 (
+    echo Error compiling shmem.c
+    exit /b 1
+)
+
+gcc -Wall -Wextra -std=c99 -g -O0 -Iinclude -c src/t3async.c -o build/obj/t3async.o
+if errorlevel 1 (
+    echo Error compiling t3async.c
+    exit /b 1
+)
+
+gcc -Wall -Wextra -std=c99 -g -O0 -Iinclude -c src/lexer.c -o build/obj/lexer.o
+if errorlevel 1 (
+    echo Error compiling lexer.c
+    exit /b 1
+)
+
+gcc -Wall -Wextra -std=c99 -g -O0 -Iinclude -c src/tbo.c -o build/obj/tbo.o
+if errorlevel 1 (
+    echo Error compiling tbo.c
+    exit /b 1
+)
+
+gcc -Wall -Wextra -std=c99 -g -O0 -Iinclude -c src/linker.c -o build/obj/linker.o
+if errorlevel 1 (
+    echo Error compiling linker.c
+    exit /b 1
+)
+
+gcc -Wall -Wextra -std=c99 -g -O0 -Iinclude -c src/optimizer.c -o build/obj/optimizer.o
+if errorlevel 1 (
+    echo Error compiling optimizer.c
+    exit /b 1
+)
+
+gcc -Wall -Wextra -std=c99 -g -O0 -Iinclude -c src/runtime.c -o build/obj/runtime.o
+if errorlevel 1 (
+    echo Error compiling runtime.c
+    exit /b 1
+)
+
+gcc -Wall -Wextra -std=c99 -g -O0 -Iinclude -c src/libternuino.c -o build/obj/libternuino.o
+if errorlevel 1 (
+    echo Error compiling libternuino.c
+    exit /b 1
+)
+
+gcc -Wall -Wextra -std=c99 -g -O0 -Iinclude -c src/server.c -o build/obj/server.o
+if errorlevel 1 (
+    echo Error compiling server.c
+    exit /b 1
+)
+
+gcc -Wall -Wextra -std=c99 -g -O0 -Iinclude -c src/multicore.c -o build/obj/multicore.o
+if errorlevel 1 (
+    echo Error compiling multicore.c
+    exit /b 1
+)
+
+gcc -Wall -Wextra -std=c99 -g -O0 -Iinclude -c src/mailbox.c -o build/obj/mailbox.o
+if errorlevel 1 (
+    echo Error compiling mailbox.c
+    exit /b 1
+)
+
+gcc -Wall -Wextra -std=c99 -g -O0 -Iinclude -c src/scheduler.c -o build/obj/scheduler.o
+if errorlevel 1 (
+    echo Error compiling scheduler.c
+    exit /b 1
+)
+
 echo Linking executable...
 
 REM Link all object files into the final executable
@@ -5,51 +5,87 @@
 #include <stdbool.h>
 #include "ternuino.h"
 
-#define MAX_LABELS 128
 #define MAX_LABEL_LENGTH 64
-#define MAX_LINE_LENGTH 256
-#define MAX_TOKEN_LENGTH 64
-#define MAX_TOKENS_PER_LINE 8
-#define MAX_UNRESOLVED_REFS 256
 
-// Label structure
+// Label structure (one slot of the open-addressing label table)
 typedef struct {
     char name[MAX_LABEL_LENGTH];
     int32_t address;
     bool is_data_label;
+    bool is_global;         // Exported with .global
+    bool is_extern;         // Declared with .extern; defined in another file
+    bool used;              // Slot holds a label
+    uint32_t hash;
 } label_t;
 
 // Unresolved label reference
 typedef struct {
     char label_name[MAX_LABEL_LENGTH];
     int32_t instruction_address;
-    int32_t operand_number; // 1 or 2
+    int32_t operand_number; // 1 or 2, 0 for an .irq handler (address is the vector)
+    uint32_t line;          // Source position of the reference
+    uint32_t column;
 } unresolved_ref_t;
 
-// Assembler state
+// Relocation kinds: what a resolved address is relative to
+typedef enum {
+    RELOC_TEXT,             // Code label of this file
+    RELOC_DATA,             // Data label of this file
+    RELOC_EXTERN            // Label of another file, resolved by the linker
+} reloc_kind_t;
+
+// A resolved label reference, kept so the linker can move the file
+typedef struct {
+    int32_t instruction_address;   // Or the vector for an .irq handler
+    int32_t operand_number;        // 1 or 2, 0 for an .irq handler
+    reloc_kind_t kind;
+    char symbol[MAX_LABEL_LENGTH]; // Label name (RELOC_EXTERN)
+} relocation_t;
+
+// Assembler state for one source file. Labels and references grow on
+// demand; release them with assembler_free.
 typedef struct {
-    label_t labels[MAX_LABELS];
+    const char *source_name;    // Prefixed to diagnostics when set
+    bool relocatable;           // Allow .extern references (object files)
+    label_t *labels;        // Hash table, capacity is a power of two
+    int32_t label_capacity;
     int32_t label_count;
     int32_t data_image[MAX_DATA_MEMORY_SIZE];
     int32_t data_size;
     bool in_data_section;
-    unresolved_ref_t unresolved_refs[MAX_UNRESOLVED_REFS];
+    int32_t irq_handlers[MAX_IRQ_VECTORS]; // Set by .irq, -1 if not given
+    unresolved_ref_t *unresolved_refs;
+    int32_t unresolved_capacity;
     int32_t unresolved_count;
+    unresolved_ref_t *exports;  // .global names, checked once all labels are known
+    int32_t export_capacity;
+    int32_t export_count;
+    relocation_t *relocations;
+    int32_t relocation_capacity;
+    int32_t relocation_count;
 } assembler_t;
 
 // Assembler functions
 void assembler_init(assembler_t *asm_state);
+void assembler_free(assembler_t *asm_state);
 bool assembler_parse_file(assembler_t *asm_state, const char *filename, 
                          instruction_t *program, int32_t *program_size);
+bool assembler_parse_source(assembler_t *asm_state, const char *source, size_t size,
+                            instruction_t *program, int32_t *program_size);
 bool parse_instruction_line(assembler_t *asm_state, const char *line, 
                            instruction_t *instr, bool *has_instruction, int32_t instruction_address);
 bool resolve_labels(assembler_t *asm_state, instruction_t *program, int32_t program_size);
 
+// Label table access for tools that build a program without source
+bool assembler_define_label(assembler_t *asm_state, const char *name, int32_t address, bool is_data);
+const label_t* assembler_find_label(const assembler_t *asm_state, const char *name, bool is_data);
+
 // Helper functions
 bool parse_operand(const char *token, operand_t *operand);
 bool parse_operand_with_labels(assembler_t *asm_state, const char *token, operand_t *operand, 
                               int32_t instruction_address, int32_t operand_number);
 opcode_t string_to_opcode(const char *str);
+bool lookup_opcode(const char *str, size_t len, opcode_t *opcode);
 ternuino_register_t string_to_register(const char *str);
 bool is_valid_register(const char *str);
 bool is_indirect_operand(const char *str, char *reg_name);
@@ -4,12 +4,18 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include "ternio.h"
+#include "t3async.h"
 
 // Device types
 typedef enum {
     DEVICE_NONE = 0,
     DEVICE_TERMINAL = 1,
-    DEVICE_FILE = 2
+    DEVICE_FILE = 2,
+    DEVICE_STREAM = 3,
+    DEVICE_SHMEM = 4,
+    DEVICE_TIMER = 5,
+    DEVICE_MAILBOX = 6
 } device_type_t;
 
 // Device status flags
@@ -17,12 +23,15 @@ typedef enum {
     DEVICE_READY = 0x01,
     DEVICE_BUSY = 0x02,
     DEVICE_ERROR = 0x04,
-    DEVICE_IRQ_PENDING = 0x08
+    DEVICE_IRQ_PENDING = 0x08,
+    DEVICE_EOF = 0x10
 } device_status_t;
 
 // Forward declaration
 struct ternuino_s;
 
+#define DEVICE_NO_DEADLINE UINT64_MAX
+
 // Device interface structure
 typedef struct device_s {
     device_type_t type;
@@ -36,7 +45,31 @@ typedef struct device_s {
     int32_t (*write)(struct device_s *dev, int32_t value);
     int32_t (*open)(struct device_s *dev, int32_t mode);
     int32_t (*close)(struct device_s *dev);
+    int32_t (*seek)(struct device_s *dev, int32_t index);
     void (*tick)(struct device_s *dev, struct ternuino_s *cpu);
+    void (*destroy)(struct device_s *dev);  // Release what device_data holds before the device is freed
+    
+    // Optional bulk transfers; return the number of values moved or -1
+    int32_t (*read_block)(struct device_s *dev, int32_t *values, int32_t count);
+    int32_t (*write_block)(struct device_s *dev, const int32_t *values, int32_t count);
+    
+    // Cycle-scheduled work: timeout runs once cpu->cycles reaches deadline.
+    // Devices set the deadline through ternuino_schedule().
+    uint64_t deadline;                      // DEVICE_NO_DEADLINE if nothing is scheduled
+    void (*timeout)(struct device_s *dev, struct ternuino_s *cpu);
+    struct ternuino_s *cpu;                 // Owning CPU, set on registration
+    int32_t handle;                         // Handle selected by the current channel
+    
+    // Events for other CPUs. While a quantum run sets deferred, the device
+    // holds them until sync, which the run calls between quanta for every
+    // device in a fixed order.
+    bool deferred;
+    void (*sync)(struct device_s *dev);
+    
+    // For parking CPUs (see park_blocked): whether a read that reported
+    // DEVICE_BUSY may now get input. If not, the device can set *wait_fd
+    // to a host descriptor that turns readable when it might; -1 otherwise.
+    bool (*input_ready)(struct device_s *dev, int *wait_fd);
     
     // Device-specific data
     void *device_data;
@@ -51,17 +84,125 @@ typedef struct {
     bool echo_enabled;
 } terminal_data_t;
 
-// File device data
+// Handles per file device. Guests address handle h of device d as
+// channel d + 256 * h in TOPEN/TREAD/TWRITE/TCLOSE/TSEEK/TBREAD/TBWRITE.
+#define FILE_MAX_HANDLES 8
+#define DEVICE_CHANNEL_SHIFT 8
+
+// Open mode a host binding imposes on a handle
+typedef enum {
+    FILE_MODE_ANY = -1,     // Guest chooses with TOPEN
+    FILE_MODE_READ = 0,
+    FILE_MODE_WRITE = 1
+} file_mode_t;
+
+// One open file of a file device
 typedef struct {
-    FILE *file;
-    char filename[256];
+    t3_writer_t writer;     // Write mode: streaming writer with value index
+    t3_reader_t reader;     // Read mode: mapped reader
+    char filename[256];     // Host-bound path, empty for the default name
+    file_mode_t bound_mode;
     bool is_open;
     bool is_write_mode;
+    t3_async_t *async;      // Read-ahead/write-behind helper, NULL when synchronous
+} file_handle_t;
+
+// File device data
+typedef struct {
+    file_handle_t handles[FILE_MAX_HANDLES];
+    size_t buffer_size;     // stdio buffer for written files, 0 for the default
+    bool async;             // Overlap file I/O with simulation using helper threads
+    bool nonblocking;       // Report DEVICE_BUSY instead of waiting for a helper
+    uint32_t events;        // Bumped by helpers when a buffer completes
+    uint32_t events_seen;
 } file_data_t;
 
+// Stream device value encodings
+typedef enum {
+    STREAM_FORMAT_TEXT,   // Whitespace-separated decimal integers
+    STREAM_FORMAT_BINARY  // Little-endian 32-bit integers
+} stream_format_t;
+
+#define STREAM_BUFFER_SIZE 65536
+
+// Stream device data
+typedef struct {
+    int in_fd;              // -1 if the stream has no input side
+    int out_fd;             // -1 if the stream has no output side
+    bool owns_in_fd;        // Opened from a path, closed on destroy
+    bool owns_out_fd;
+    stream_format_t format;
+    bool blocking;          // false: report DEVICE_BUSY instead of waiting
+    uint8_t in_buffer[STREAM_BUFFER_SIZE];
+    size_t in_pos;
+    size_t in_len;
+    bool in_eof;
+    uint8_t out_buffer[STREAM_BUFFER_SIZE];
+    size_t out_len;
+} stream_data_t;
+
+// Timer modes, selected with TOPEN
+typedef enum {
+    TIMER_MODE_ONESHOT = 0,
+    TIMER_MODE_PERIODIC = 1
+} timer_mode_t;
+
+// How often a host-clock timer checks the clock, in cycles
+#define TIMER_HOST_POLL_CYCLES 64
+
+// Timer device data
+typedef struct {
+    timer_mode_t mode;
+    bool host_clock;        // Count host microseconds instead of cycles
+    bool armed;
+    uint64_t period;        // Interval in cycles or microseconds
+    uint64_t compare;       // Next expiry in the same unit
+} timer_data_t;
+
+// Shared-memory object layout: this header followed by `cells` int32_t
+// values. Doorbells are counters that each side increments to signal the
+// other; on Linux they are also futex words.
+#define SHMEM_MAGIC 0x4D485354u  // "TSHM"
+#define SHMEM_DEFAULT_CELLS 243
+#define SHMEM_WAIT_MS 10         // Longest a read waits for the host doorbell
+
+typedef struct {
+    uint32_t magic;
+    uint32_t cells;             // Number of int32_t cells after the header
+    uint32_t host_doorbell;     // Rung by the host process
+    uint32_t guest_doorbell;    // Rung by the guest
+} shmem_header_t;
+
+// Shared-memory device data
+typedef struct {
+    shmem_header_t *header;     // Start of the mapping
+    size_t map_size;
+    uint32_t cells;             // Cells mapped; the header's count is the host's to change
+    uint32_t host_seen;         // Last host doorbell value acknowledged by the guest
+} shmem_data_t;
+
+// Mailbox: a bounded lock-free queue of values between CPUs on different
+// host threads. Any number of mailbox devices may write into a mailbox
+// created for several producers, but only one device reads it.
+#define MAILBOX_DEFAULT_CAPACITY 256
+
+typedef struct mailbox_s mailbox_t;
+
+// Mailbox device data: TREAD takes from inbox, TWRITE puts into outbox
+typedef struct {
+    mailbox_t *inbox;       // NULL for a write-only device
+    mailbox_t *outbox;      // NULL for a read-only device
+    int32_t *staged;        // Writes held while deferred, a ring the size of outbox
+    uint32_t staged_capacity;
+    uint32_t staged_first;
+    uint32_t staged_count;
+} mailbox_data_t;
+
 // Device management functions
 void device_init(device_t *dev, device_type_t type, uint8_t device_id, uint8_t irq_vector);
+device_t* device_create(device_type_t type, uint8_t device_id, uint8_t irq_vector, size_t data_size);
 void device_cleanup(device_t *dev);
+void device_destroy(device_t *dev);
 
 // Terminal device functions
 device_t* terminal_device_create(uint8_t device_id, uint8_t irq_vector);
@@ -73,10 +214,73 @@ void terminal_tick(device_t *dev, struct ternuino_s *cpu);
 
 // File device functions
 device_t* file_device_create(uint8_t device_id, uint8_t irq_vector);
+bool file_device_bind(device_t *dev, int32_t handle, const char *path, file_mode_t mode);
+void file_device_set_buffer(device_t *dev, size_t buffer_size);
+void file_device_set_async(device_t *dev, bool async, bool nonblocking);
 int32_t file_read(device_t *dev, int32_t *value);
 int32_t file_write(device_t *dev, int32_t value);
 int32_t file_open(device_t *dev, int32_t mode);
 int32_t file_close(device_t *dev);
+int32_t file_seek(device_t *dev, int32_t index);
+int32_t file_read_block(device_t *dev, int32_t *values, int32_t count);
+int32_t file_write_block(device_t *dev, const int32_t *values, int32_t count);
 void file_tick(device_t *dev, struct ternuino_s *cpu);
+bool file_input_ready(device_t *dev, int *wait_fd);
+void file_destroy(device_t *dev);
+
+// Timer device functions
+device_t* timer_device_create(uint8_t device_id, uint8_t irq_vector, bool host_clock);
+int32_t timer_read(device_t *dev, int32_t *value);
+int32_t timer_write(device_t *dev, int32_t value);
+int32_t timer_open(device_t *dev, int32_t mode);
+int32_t timer_close(device_t *dev);
+void timer_timeout(device_t *dev, struct ternuino_s *cpu);
+
+// Stream device functions
+device_t* stream_device_create(uint8_t device_id, uint8_t irq_vector, int in_fd, int out_fd,
+                               stream_format_t format, bool blocking);
+int stream_open_spec(const char *spec, bool for_write, bool *owned);
+int32_t stream_read(device_t *dev, int32_t *value);
+int32_t stream_write(device_t *dev, int32_t value);
+int32_t stream_read_block(device_t *dev, int32_t *values, int32_t count);
+int32_t stream_write_block(device_t *dev, const int32_t *values, int32_t count);
+int32_t stream_open(device_t *dev, int32_t mode);
+int32_t stream_close(device_t *dev);
+void stream_tick(device_t *dev, struct ternuino_s *cpu);
+bool stream_input_ready(device_t *dev, int *wait_fd);
+void stream_destroy(device_t *dev);
+
+// Shared-memory device functions
+device_t* shmem_device_create(uint8_t device_id, uint8_t irq_vector, const char *spec, uint32_t cells);
+int32_t* shmem_cells(device_t *dev, uint32_t *count);
+int32_t shmem_read(device_t *dev, int32_t *value);
+int32_t shmem_write(device_t *dev, int32_t value);
+int32_t shmem_open(device_t *dev, int32_t mode);
+int32_t shmem_close(device_t *dev);
+void shmem_tick(device_t *dev, struct ternuino_s *cpu);
+void shmem_destroy(device_t *dev);
+
+// Mailbox functions. A mailbox lives until its creator and every device
+// using it have released it. capacity is rounded up to a power of two.
+mailbox_t* mailbox_create(uint32_t capacity, bool multi_producer);
+void mailbox_retain(mailbox_t *mailbox);
+void mailbox_release(mailbox_t *mailbox);
+bool mailbox_push(mailbox_t *mailbox, int32_t value);
+bool mailbox_pop(mailbox_t *mailbox, int32_t *value);
+bool mailbox_empty(const mailbox_t *mailbox);
+
+// Mailbox device functions. The device retains both mailboxes; it fails if
+// inbox already has a reader, or outbox a writer and is single-producer.
+device_t* mailbox_device_create(uint8_t device_id, uint8_t irq_vector, mailbox_t *inbox, mailbox_t *outbox);
+int32_t mailbox_read(device_t *dev, int32_t *value);
+int32_t mailbox_write(device_t *dev, int32_t value);
+int32_t mailbox_read_block(device_t *dev, int32_t *values, int32_t count);
+int32_t mailbox_write_block(device_t *dev, const int32_t *values, int32_t count);
+int32_t mailbox_open(device_t *dev, int32_t mode);
+int32_t mailbox_close(device_t *dev);
+void mailbox_tick(device_t *dev, struct ternuino_s *cpu);
+void mailbox_sync(device_t *dev);
+bool mailbox_input_ready(device_t *dev, int *wait_fd);
+void mailbox_destroy(device_t *dev);
 
 #endif // DEVICES_H
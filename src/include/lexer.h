@@ -0,0 +1,43 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Token types. Whitespace, commas and comments ('#' or ';' to end of
+// line) separate tokens and are never returned.
+typedef enum {
+    TOKEN_WORD,     // Mnemonic, operand, label name or directive
+    TOKEN_COLON,
+    TOKEN_NEWLINE,
+    TOKEN_EOF
+} token_type_t;
+
+// A token is a view into the source buffer; the text is not terminated
+typedef struct {
+    token_type_t type;
+    const char *text;
+    size_t length;
+    uint32_t line;          // 1-based
+    uint32_t column;        // 1-based, in bytes
+} token_t;
+
+// Single-pass lexer over a source buffer that outlives its tokens
+typedef struct {
+    const char *pos;
+    const char *end;
+    const char *line_start;
+    uint32_t line;
+} lexer_t;
+
+void lexer_init(lexer_t *lex, const char *source, size_t size);
+void lexer_next(lexer_t *lex, token_t *token);
+void lexer_peek(const lexer_t *lex, token_t *token);
+
+// Token helpers
+bool token_equals(const token_t *token, const char *text);
+bool token_equals_nocase(const token_t *token, const char *text);
+bool token_to_int(const token_t *token, long *value);
+
+#endif // LEXER_H
@@ -0,0 +1,89 @@
+#ifndef LIBTERNUINO_H
+#define LIBTERNUINO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "ternuino.h"
+#include "devices.h"
+#include "runtime.h"
+
+// Embedding API (libternuino.a / libternuino.so): a simulator instance a
+// host drives in-process. Nothing here writes to stdout; diagnostics go
+// through the log hook (stderr by default) and memory through the
+// allocator hook in runtime.h. A machine
+// starts without devices, so guest output only appears where the host's
+// devices put it.
+//
+// Running does not allocate: the CPU, program and devices are set up by
+// create, load and add_device, and ternuino_vm_run only steps them. The
+// exception is a guest TOPEN on the file device, which opens a host file.
+
+typedef struct ternuino_vm_s ternuino_vm_t;
+
+// An assembled program, as built by the calls below. Loading it gives the
+// machine an image of its own; hosts that run one program on many
+// machines can share a single image instead (ternuino_program_share).
+typedef struct {
+    instruction_t code[MAX_MEMORY_SIZE];
+    int32_t code_size;
+    int32_t data[MAX_DATA_MEMORY_SIZE];         // Initial data memory
+    int32_t data_size;
+    int32_t irq_handlers[MAX_IRQ_VECTORS];      // From .irq, -1 if not given
+} ternuino_program_t;
+
+bool ternuino_program_assemble(ternuino_program_t *program, const char *source, size_t size,
+                               const char *name);
+bool ternuino_program_assemble_file(ternuino_program_t *program, const char *path);
+bool ternuino_program_load_image(ternuino_program_t *program, const char *path);
+bool ternuino_program_load_image_memory(ternuino_program_t *program, const void *data, size_t size);
+
+ternuino_vm_t* ternuino_vm_create(void);
+void ternuino_vm_destroy(ternuino_vm_t *vm);
+
+// Load a program, replacing the previous one, and reset the CPU to run
+// it. On failure the previous program stays loaded. name labels
+// diagnostics and may be NULL.
+bool ternuino_vm_load_source(ternuino_vm_t *vm, const char *source, size_t size, const char *name);
+bool ternuino_vm_load_file(ternuino_vm_t *vm, const char *path);
+bool ternuino_vm_load_image(ternuino_vm_t *vm, const char *path);
+void ternuino_vm_load_program(ternuino_vm_t *vm, const ternuino_program_t *program);
+
+// Build the read-only image of a program, with one reference for the
+// caller. Machines given it with ternuino_vm_load_shared run that one copy
+// of the code and keep their own registers and data memory; each holds a
+// reference until it loads something else or is destroyed. Returns NULL if
+// out of memory. Release the caller's reference with ternuino_image_release.
+ternuino_image_t* ternuino_program_share(const ternuino_program_t *program);
+void ternuino_vm_load_shared(ternuino_vm_t *vm, ternuino_image_t *image);
+
+// Restart the loaded program with its initial data. The cycle counter
+// keeps counting, since devices schedule against it.
+void ternuino_vm_reset(ternuino_vm_t *vm);
+
+// Run until the program stops or max_cycles more cycles pass (0 for no
+// limit). A run stopped by the limit continues where it left off.
+stop_reason_t ternuino_vm_run(ternuino_vm_t *vm, uint64_t max_cycles, engine_t engine);
+
+// Machine state
+int32_t ternuino_vm_get_register(const ternuino_vm_t *vm, ternuino_register_t reg);
+void ternuino_vm_set_register(ternuino_vm_t *vm, ternuino_register_t reg, int32_t value);
+int32_t ternuino_vm_get_pc(const ternuino_vm_t *vm);
+void ternuino_vm_set_pc(ternuino_vm_t *vm, int32_t pc);
+uint64_t ternuino_vm_cycles(const ternuino_vm_t *vm);
+
+// Copy count cells from or to data memory starting at address. Fails
+// without copying anything if the range is outside data memory.
+bool ternuino_vm_read_data(const ternuino_vm_t *vm, int32_t address, int32_t *values, int32_t count);
+bool ternuino_vm_write_data(ternuino_vm_t *vm, int32_t address, const int32_t *values, int32_t count);
+
+// The CPU itself, for anything the calls above do not cover
+ternuino_t* ternuino_vm_cpu(ternuino_vm_t *vm);
+
+// Attach a device made with device_create or one of the built-in
+// *_device_create functions; the machine destroys it. handler_address is
+// used for the device's IRQ vector unless the program sets one with .irq
+// (-1 for none). If adding fails the caller still owns the device.
+bool ternuino_vm_add_device(ternuino_vm_t *vm, device_t *device, int32_t handler_address);
+
+#endif // LIBTERNUINO_H
@@ -0,0 +1,18 @@
+#ifndef LINKER_H
+#define LINKER_H
+
+#include <stdbool.h>
+
+// Assemble each source into a relocatable object next to it (prog.asm
+// becomes prog.tobj) on up to jobs threads, then link the objects into the
+// program image output. Objects and an output that are already current
+// are reused, so only changed files are reassembled. jobs <= 0 uses one
+// thread per CPU.
+bool linker_build(const char *const *sources, int count, const char *output, int jobs);
+
+// Link object files into a program image. Text and data sections are
+// placed in argument order and every reference is relocated; externals
+// must be exported by exactly one object.
+bool linker_link(const char *const *objects, int count, const char *output);
+
+#endif // LINKER_H
@@ -0,0 +1,22 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Read-only view of a whole file. On POSIX systems and Windows the file is
+// memory-mapped; the contents are never copied.
+typedef struct {
+    const uint8_t *data;   // First byte of the file (NULL for empty files)
+    size_t size;           // File size in bytes
+#ifdef _WIN32
+    void *mapping;         // Windows file mapping handle
+#endif
+} mapped_file_t;
+
+// Map a file for reading. Returns false if the file cannot be opened or mapped.
+bool mapfile_open(mapped_file_t *mf, const char *filename);
+void mapfile_close(mapped_file_t *mf);
+
+#endif // MAPFILE_H
@@ -0,0 +1,40 @@
+#ifndef MULTICORE_H
+#define MULTICORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ternuino.h"
+
+// Several cores running one program against one data memory. Each core
+// is an ordinary ternuino_t with its own registers, PC and devices; the
+// others use core 0's data memory through ternuino_share_data and tell
+// themselves apart with CID. CAS, TCAS and XADD are the cores' atomics.
+
+#define MULTICORE_MAX_CORES 64
+
+// Cycles one core runs before the next takes a turn when the cores share
+// a host thread
+#define MULTICORE_SLICE_CYCLES TERNUINO_BATCH_CYCLES
+
+// Number the cores and point cores 1..count-1 at core 0's data memory.
+// Load the program into every core, but its data only into core 0.
+void multicore_attach(ternuino_t *const *cores, int32_t count);
+
+// Run every core on its own host thread (the calling thread runs core 0)
+// until each one stops or has run max_cycles more cycles (0 for no limit).
+// reasons receives each core's stop reason. Cores whose thread cannot be
+// started, and all of them on Windows, take turns on the calling thread.
+void multicore_run(ternuino_t *const *cores, int32_t count, uint64_t max_cycles, engine_t engine,
+                   stop_reason_t *reasons);
+
+// Like multicore_run, but the cores run in lockstep quanta of `quantum`
+// cycles and meet at a barrier after each one. Devices hold events for
+// other CPUs (mailbox writes) during a quantum and pass them on at the
+// barrier, core by core in order, so what each core receives and when
+// does not depend on host timing. An event takes effect up to one quantum
+// late: a smaller quantum is more accurate, a larger one faster. Loads
+// and stores to shared data memory are not held back.
+void multicore_run_quantum(ternuino_t *const *cores, int32_t count, uint64_t quantum,
+                           uint64_t max_cycles, engine_t engine, stop_reason_t *reasons);
+
+#endif // MULTICORE_H
@@ -0,0 +1,34 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ternuino.h"
+#include "assembler.h"
+
+// What the optimizer did, for the -O report
+typedef struct {
+    int32_t original_size;
+    int32_t final_size;
+    int32_t passes;
+    int32_t unreachable;        // Instructions no path reaches
+    int32_t folded;             // Replaced by a constant load or a cheaper move
+    int32_t redundant;          // No-ops and loads of a value already in place
+    int32_t dead_stores;        // Register writes that are never read
+    int32_t branches_resolved;  // Conditional branches with a known outcome
+    int32_t jumps_threaded;     // Jumps retargeted past a chain of jumps
+    int32_t jumps_removed;      // Jumps to the next instruction
+    const char *skipped;        // Why the program was left alone, or NULL
+} optimize_report_t;
+
+// Optimize an assembled program in place. Entry points are address 0 and
+// every IRQ handler in asm_state->irq_handlers. Removed instructions close
+// up; jump targets, IRQ handlers and code labels are remapped to match.
+// Register values are only tracked in programs without EI, since an
+// interrupt handler may change any register between two instructions.
+void assembler_optimize(assembler_t *asm_state, instruction_t *program, int32_t *program_size,
+                        optimize_report_t *report);
+
+void print_optimize_report(const optimize_report_t *report);
+
+#endif // OPTIMIZER_H
@@ -0,0 +1,39 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include <stddef.h>
+
+// Host hooks for the simulator core: where its diagnostics go and where
+// its memory comes from. The hooks are process-wide; set them before
+// creating machines and leave them alone while any are alive.
+
+typedef enum {
+    TERNUINO_LOG_ERROR,
+    TERNUINO_LOG_INFO       // Progress, e.g. what the linker built
+} ternuino_log_level_t;
+
+// Receives one message per call, without a trailing newline
+typedef void (*ternuino_log_fn)(ternuino_log_level_t level, const char *message, void *user);
+
+// Replacement for malloc/realloc/free. resize and release see only
+// pointers alloc or resize returned; release may be given NULL.
+typedef struct {
+    void *(*alloc)(size_t size, void *user);
+    void *(*resize)(void *ptr, size_t size, void *user);
+    void (*release)(void *ptr, void *user);
+    void *user;
+} ternuino_allocator_t;
+
+// NULL restores the defaults: messages are printed to stderr and memory
+// comes from malloc
+void ternuino_set_log(ternuino_log_fn log, void *user);
+void ternuino_set_allocator(const ternuino_allocator_t *allocator);
+
+// Used by the core in place of printf and malloc
+void ternuino_log(ternuino_log_level_t level, const char *format, ...);
+void* ternuino_alloc(size_t size);
+void* ternuino_calloc(size_t count, size_t size);
+void* ternuino_realloc(void *ptr, size_t size);
+void ternuino_free(void *ptr);
+
+#endif // RUNTIME_H
@@ -0,0 +1,49 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ternuino.h"
+
+// Many CPUs multiplexed on a few host threads. Each thread takes a CPU
+// off the run queue, runs it for a slice of cycles and queues it again.
+// A CPU whose read finds no input (see park_blocked) is parked instead and
+// only queued again once its device has input, so an idle machine costs a
+// readiness check rather than a thread. Virtual time stands still while a
+// CPU is parked.
+
+// Cycles a CPU runs before it yields to the next one
+#define SCHEDULER_SLICE_CYCLES 4096
+
+// Longest a thread waits in poll() before checking devices without a
+// descriptor again, in milliseconds
+#define SCHEDULER_POLL_MS 10
+
+// How long every live CPU may stay parked on devices without a
+// descriptor before scheduler_run gives up on them, in milliseconds
+#define SCHEDULER_IDLE_MS 1000
+
+typedef struct scheduler_s scheduler_t;
+
+// threads counts the caller of scheduler_run (0 for one; always one on
+// Windows). slice is the cycles per turn, 0 for SCHEDULER_SLICE_CYCLES.
+scheduler_t* scheduler_create(int32_t threads, uint64_t slice, engine_t engine);
+void scheduler_destroy(scheduler_t *sched);
+
+// Queue a loaded CPU to run until it stops or has run max_cycles more
+// cycles (0 for no limit), and set its park_blocked. Returns its index,
+// or -1 if out of memory. Not while scheduler_run is running.
+int32_t scheduler_add(scheduler_t *sched, ternuino_t *cpu, uint64_t max_cycles);
+
+// Run until every CPU has stopped, or the ones left are parked on devices
+// without a descriptor and none has woken for SCHEDULER_IDLE_MS. Those
+// report STOP_BLOCKED, and a later call waits for them again.
+void scheduler_run(scheduler_t *sched);
+
+int32_t scheduler_count(const scheduler_t *sched);
+ternuino_t* scheduler_cpu(const scheduler_t *sched, int32_t index);
+
+// Why a CPU stopped, STOP_CYCLE_LIMIT if it has not run yet
+stop_reason_t scheduler_reason(const scheduler_t *sched, int32_t index);
+
+#endif // SCHEDULER_H
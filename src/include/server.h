@@ -0,0 +1,44 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ternuino.h"
+
+// Simulation server (ternuino --serve PATH). Clients connect to a Unix
+// domain socket and submit jobs; each job is one header line followed by
+// a payload of exactly LENGTH bytes:
+//
+//   RUN <id> source|image <length> [cycles=N] [timeout=MS] [engine=step|batch]
+//       [data=ADDR:V,V,...]
+//
+// A source payload is assembly text and an image payload the bytes of a
+// .tbo file. data= overwrites data memory from ADDR after the program's
+// own data is loaded. cycles= and timeout= can only lower the server's
+// limits; 0 keeps them. For every job the server writes one JSON line back
+// on the same connection once it finishes, so results can arrive out of
+// submission order; match them by id.
+//
+// Worker threads each keep a warm machine, and assembled programs are
+// cached by content. When the queue is full the server stops reading
+// from connections until a worker frees a slot.
+
+#define SERVER_DEFAULT_QUEUE_DEPTH 256
+#define SERVER_MAX_PAYLOAD (1 << 20)    // Largest job payload in bytes
+#define SERVER_CACHE_SLOTS 64           // Assembled programs kept
+#define SERVER_SLICE_CYCLES 65536       // Cycles between time-limit checks
+#define SERVER_DEFAULT_TIMEOUT_MS 10000 // Time limit when the operator sets none
+
+typedef struct {
+    int workers;            // Worker threads, <= 0 for one per CPU
+    int queue_depth;        // Jobs waiting for a worker, <= 0 for the default
+    uint64_t max_cycles;    // Cycle limit for every job, 0 for none
+    uint32_t timeout_ms;    // Time limit for every job, 0 for SERVER_DEFAULT_TIMEOUT_MS
+    engine_t engine;        // Engine for jobs that set none
+} server_options_t;
+
+// Serve until SIGINT or SIGTERM. Returns false if the socket cannot be
+// set up.
+bool server_run(const char *socket_path, const server_options_t *opts);
+
+#endif // SERVER_H
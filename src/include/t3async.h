@@ -0,0 +1,56 @@
+#ifndef T3ASYNC_H
+#define T3ASYNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "ternio.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// Values per buffer; each direction double-buffers this many
+#define T3_ASYNC_BLOCK 4096
+
+// Read-ahead / write-behind for one T3 file. A helper thread fills (or
+// drains) the back buffer while the caller works on the front one; the
+// buffers are swapped when the front one runs out.
+typedef struct {
+#ifndef _WIN32
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+#endif
+    bool write_mode;
+    t3_reader_t *reader;
+    t3_writer_t *writer;
+    uint32_t *events;       // Incremented whenever the helper finishes a buffer
+
+    int32_t buffers[2][T3_ASYNC_BLOCK];
+    size_t fill[2];         // Values in each buffer
+    int front;              // Buffer owned by the caller
+    size_t pos;             // Next value of the front buffer (read mode)
+    bool back_pending;      // The helper owns the back buffer
+    bool stop;
+    bool error;
+} t3_async_t;
+
+// Start a helper for an open reader or writer. Returns false if no thread
+// could be started; the caller then uses the reader or writer directly.
+bool t3_async_start_read(t3_async_t *async, t3_reader_t *reader, uint32_t *events);
+bool t3_async_start_write(t3_async_t *async, t3_writer_t *writer, uint32_t *events);
+
+// Transfer up to count values. Returns the number moved, 0 if nothing was
+// ready and wait is false, or -1 at end of file or on error.
+int32_t t3_async_read(t3_async_t *async, int32_t *values, size_t count, bool wait);
+int32_t t3_async_write(t3_async_t *async, const int32_t *values, size_t count, bool wait);
+
+// Discard read-ahead and reposition the reader at value index
+bool t3_async_seek(t3_async_t *async, uint32_t index);
+
+// Write out buffered values (write mode) and stop the helper. Returns false
+// if any write failed.
+bool t3_async_stop(t3_async_t *async);
+
+#endif // T3ASYNC_H
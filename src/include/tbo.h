@@ -0,0 +1,117 @@
+#ifndef TBO_H
+#define TBO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "ternuino.h"
+#include "assembler.h"
+#include "mapfile.h"
+
+// Binary program image ("ternuino binary object"). The file is a header
+// followed by fixed-size tables, all in host byte order like the T3 format,
+// so a loader only has to map it and check the header.
+#define TBO_FILE_EXTENSION ".tbo"
+#define TBO_OBJECT_EXTENSION ".tobj"
+#define TBO_MAGIC "TBO"
+// Version 2 added relocations, object files and symbol bindings
+#define TBO_FORMAT_VERSION 2
+
+// Image flags
+#define TBO_IMAGE_OBJECT 0x01   // Relocatable object; must be linked to run
+
+// Instruction flags
+#define TBO_HAS_OPERAND1 0x01
+#define TBO_HAS_OPERAND2 0x02
+
+// Symbol flags
+#define TBO_SYMBOL_DATA 0x01
+#define TBO_SYMBOL_GLOBAL 0x02
+#define TBO_SYMBOL_EXTERN 0x04
+
+typedef struct {
+    char magic[4];              // "TBO\0"
+    uint16_t version;           // Format version
+    uint16_t header_size;       // sizeof(tbo_header_t)
+    uint64_t source_hash;       // tbo_hash of the assembly source
+    uint64_t image_hash;        // tbo_hash of everything after the header
+    uint32_t image_size;        // Size of the whole file
+    uint32_t flags;             // TBO_IMAGE_OBJECT
+    uint32_t instruction_count;
+    uint32_t instruction_offset;
+    uint32_t data_count;
+    uint32_t data_offset;
+    uint32_t symbol_count;
+    uint32_t symbol_offset;
+    uint32_t string_offset;     // Symbol names, not terminated
+    uint32_t string_size;
+    uint32_t relocation_count;  // Objects only
+    uint32_t relocation_offset;
+    int32_t irq_handlers[MAX_IRQ_VECTORS]; // -1 where the program sets none
+} tbo_header_t;
+
+// Packed instruction
+typedef struct {
+    uint8_t opcode;
+    uint8_t flags;              // TBO_HAS_OPERAND1 | TBO_HAS_OPERAND2
+    uint8_t mode1;              // addr_mode_t of each operand
+    uint8_t mode2;
+    int32_t value1;             // Immediate, register number or address
+    int32_t value2;
+} tbo_instruction_t;
+
+typedef struct {
+    uint32_t name_offset;       // Into the string table
+    uint32_t name_length;
+    int32_t address;
+    uint32_t flags;             // TBO_SYMBOL_DATA, _GLOBAL, _EXTERN
+} tbo_symbol_t;
+
+// Address operand that depends on where the linker places a file
+typedef struct {
+    uint32_t target;            // Instruction index, or IRQ vector if operand is 0
+    uint8_t operand;            // 1 or 2, 0 for an IRQ handler
+    uint8_t kind;               // reloc_kind_t
+    uint16_t reserved;
+    uint32_t symbol;            // Symbol index of the external (RELOC_EXTERN)
+} tbo_relocation_t;
+
+// Mapped image. The table pointers point into the mapping.
+typedef struct {
+    mapped_file_t map;
+    bool borrowed;              // map refers to the caller's buffer (tbo_open_memory)
+    const tbo_header_t *header;
+    const tbo_instruction_t *instructions;
+    const int32_t *data;
+    const tbo_symbol_t *symbols;
+    const char *strings;
+    const tbo_relocation_t *relocations;
+} tbo_image_t;
+
+// 64-bit FNV-1a, used for both the source and the image hash
+uint64_t tbo_hash(const void *data, size_t size);
+bool tbo_hash_file(const char *filename, uint64_t *hash);
+
+// Write the result of assembling a source with the given hash. A
+// relocatable assembler state produces an object file.
+bool tbo_write(const char *filename, const assembler_t *asm_state,
+               const instruction_t *program, int32_t program_size, uint64_t source_hash);
+
+// Map and validate an image
+bool tbo_open(tbo_image_t *image, const char *filename);
+// Validate an image already in memory, e.g. received over a socket. data
+// must be 4-byte aligned and outlive the image.
+bool tbo_open_memory(tbo_image_t *image, const void *data, size_t size);
+void tbo_close(tbo_image_t *image);
+
+// True if filename is a valid image (or object) built from a source with
+// this hash
+bool tbo_is_current(const char *filename, uint64_t source_hash, bool object);
+
+// Unpack the instructions into program (MAX_MEMORY_SIZE entries).
+// Returns the instruction count.
+int32_t tbo_unpack_program(const tbo_image_t *image, instruction_t *program);
+
+bool tbo_find_symbol(const tbo_image_t *image, const char *name, bool is_data, int32_t *address);
+
+#endif // TBO_H
@@ -4,11 +4,22 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include "mapfile.h"
 
 // Ternary I/O format constants
 #define TERNARY_FILE_EXTENSION ".t3"
 #define TERNARY_FILE_HEADER "T3FMT"
 #define TERNARY_FORMAT_VERSION 1
+// Version 2 files append a sparse value index after the last value
+#define TERNARY_FORMAT_VERSION_INDEXED 2
+#define TERNARY_INDEX_MAGIC "T3INDEX"
+// Default number of values between two index entries
+#define T3_DEFAULT_INDEX_STRIDE 1024
+
+// Largest value record: length byte plus 21 trits
+#define T3_MAX_RECORD_SIZE 22
+// Values converted per batch by the bulk read/write helpers
+#define T3_BATCH_SIZE 256
 
 // Ternary file format header
 typedef struct {
@@ -17,16 +28,70 @@ typedef struct {
     uint32_t data_size; // Number of ternary values in file
 } t3_header_t;
 
+// Trailer of an indexed file. The index itself is an array of uint64_t
+// byte offsets, one for every index_stride-th value, stored at index_offset.
+typedef struct {
+    uint64_t index_offset; // File offset of the first index entry
+    uint32_t stride;       // Values between two index entries
+    uint32_t entries;      // Number of index entries
+    char magic[8];         // "T3INDEX\0"
+} t3_index_footer_t;
+
+// Streaming T3 writer. Counts values, records index offsets and patches
+// the header when finished.
+typedef struct {
+    FILE *file;
+    uint32_t count;         // Values written so far
+    uint64_t offset;        // File offset of the next record
+    uint32_t index_stride;  // 0 writes a plain version 1 file
+    uint64_t *index;        // Offsets of values 0, stride, 2 * stride, ...
+    uint32_t index_len;
+    uint32_t index_cap;
+    char *buffer;           // stdio buffer set by t3_writer_open_buffered
+} t3_writer_t;
+
+// Memory-mapped T3 reader: the file is mapped once and values are decoded
+// straight from the mapping, without stdio calls or copies per value
+typedef struct {
+    mapped_file_t map;
+    t3_header_t header;
+    const uint8_t *cursor;  // Next value record
+    const uint8_t *end;     // End of the value area
+    uint32_t values_read;   // Number of values returned so far
+    const uint8_t *index;   // Sparse index inside the mapping (NULL if none)
+    uint32_t index_stride;
+    uint32_t index_entries;
+} t3_reader_t;
+
 // Ternary I/O functions
 bool t3_create_file(const char *filename);
 bool t3_write_value(FILE *file, int32_t value);
+bool t3_write_values(FILE *file, const int32_t *values, size_t count);
+size_t t3_encode_values(const int32_t *values, size_t count, uint8_t *out);
 bool t3_read_value(FILE *file, int32_t *value);
 bool t3_write_header(FILE *file, uint32_t data_size);
 bool t3_read_header(FILE *file, t3_header_t *header);
+bool t3_seek(FILE *file, uint32_t index);
+
+// Writer functions
+bool t3_writer_open(t3_writer_t *writer, const char *filename, uint32_t index_stride);
+bool t3_writer_open_buffered(t3_writer_t *writer, const char *filename, uint32_t index_stride,
+                             size_t buffer_size);
+bool t3_writer_put(t3_writer_t *writer, int32_t value);
+bool t3_writer_put_values(t3_writer_t *writer, const int32_t *values, size_t count);
+bool t3_writer_finish(t3_writer_t *writer);
+
+// Mapped reader functions
+bool t3_reader_open(t3_reader_t *reader, const char *filename);
+bool t3_reader_next(t3_reader_t *reader, int32_t *value);
+size_t t3_reader_read(t3_reader_t *reader, int32_t *values, size_t count);
+bool t3_reader_seek(t3_reader_t *reader, uint32_t index);
+void t3_reader_close(t3_reader_t *reader);
 
 // Balanced ternary string conversion
 void int_to_balanced_ternary(int32_t value, char *buffer, int buffer_size);
 int32_t balanced_ternary_to_int(const char *bt_string);
+int32_t balanced_ternary_to_int_n(const char *bt_string, size_t len);
 bool is_valid_balanced_ternary(const char *bt_string);
 
 // Utility functions
@@ -11,19 +11,39 @@ struct device_s;
 // Ternary values: -1, 0, 1
 typedef int8_t trit_t;
 
-#define MAX_MEMORY_SIZE 27
-#define MAX_DATA_MEMORY_SIZE 27
-#define MAX_OPEN_FILES 8
+// Instruction and data memory size. Builds for large workloads can raise
+// it (make MEMORY_SIZE=243). Both memories share one size because code
+// addresses wrap at the data size like every direct address.
+#ifndef TERNUINO_MEMORY_SIZE
+#define TERNUINO_MEMORY_SIZE 27
+#endif
+#define MAX_MEMORY_SIZE TERNUINO_MEMORY_SIZE
+#define MAX_DATA_MEMORY_SIZE TERNUINO_MEMORY_SIZE
 #define MAX_DEVICES 8
 #define MAX_IRQ_VECTORS 8
 
-// File handle structure for I/O operations
-typedef struct {
-    FILE *file;
-    char filename[256];
-    bool is_open;
-    bool is_write_mode;
-} tfile_t;
+// Memory-mapped I/O window: one page of MMIO_PAGE_SIZE cells per device ID,
+// placed above any data address so ordinary loads and stores are unaffected
+#define MMIO_BASE 243
+#define MMIO_PAGE_SIZE 9
+#define MMIO_PAGE_COUNT MAX_DEVICES
+#define MMIO_WINDOW_SIZE (MMIO_PAGE_SIZE * MMIO_PAGE_COUNT)
+
+// Host-shared memory window, mapped by the shared-memory device
+#define SHARED_BASE 729
+#define SHARED_MAX_CELLS 531441     // 3^12 cells, 2 MiB
+
+#if TERNUINO_MEMORY_SIZE < 1 || TERNUINO_MEMORY_SIZE > MMIO_BASE
+#error "TERNUINO_MEMORY_SIZE must be between 1 and MMIO_BASE"
+#endif
+
+// Register offsets within a device page
+typedef enum {
+    MMIO_REG_DATA = 0,       // LD reads a value, ST writes one
+    MMIO_REG_STATUS = 1,     // Device status flags; ST clears the bits written
+    MMIO_REG_CONTROL = 2,    // ST mode opens, ST -1 closes; LD returns the last result
+    MMIO_REG_IRQ_ENABLE = 3  // Device interrupt enable (0 or 1)
+} mmio_register_t;
 
 // Instruction types
 typedef enum {
@@ -57,9 +77,18 @@ typedef enum {
     OP_IRQ,    // Software interrupt
     OP_IRET,   // Return from interrupt
     OP_EI,     // Enable interrupts
-    OP_DI      // Disable interrupts
+    OP_DI,     // Disable interrupts
+    OP_TSEEK,  // Seek device to a value index
+    OP_TBREAD, // Block read from device into data memory
+    OP_TBWRITE, // Block write from data memory to device
+    OP_CAS,    // Atomic compare-and-swap
+    OP_TCAS,   // Atomic compare-and-swap with a three-way result
+    OP_XADD,   // Atomic fetch-and-add
+    OP_CID     // Read the core ID
 } opcode_t;
 
+#define OPCODE_COUNT (OP_CID + 1)
+
 // Addressing modes
 typedef enum {
     ADDR_IMMEDIATE,
@@ -94,6 +123,18 @@ typedef struct {
     bool has_operand2;
 } instruction_t;
 
+// A decoded program and its initial data, read-only once built. Every CPU
+// running the program shares one image and holds a reference to it; the
+// last release frees it.
+typedef struct ternuino_image_s {
+    uint32_t refs;
+    int32_t code_size;
+    int32_t data_size;
+    int32_t *data;                          // Initial data memory, stored after code
+    int32_t irq_handlers[MAX_IRQ_VECTORS];  // From .irq, -1 if not given
+    instruction_t code[];
+} ternuino_image_t;
+
 // Interrupt vector table entry
 typedef struct {
     int32_t handler_address;
@@ -106,13 +147,20 @@ typedef struct ternuino_s {
     int32_t pc;            // Program counter
     int32_t sp;            // Stack pointer (for interrupt handling)
     bool running;          // CPU running state
+    bool halted;           // Stopped by HLT rather than by leaving the program
     bool interrupts_enabled; // Global interrupt enable flag
     bool in_interrupt;     // Currently handling interrupt
-    instruction_t memory[MAX_MEMORY_SIZE];  // Instruction memory
-    int32_t data_mem[MAX_DATA_MEMORY_SIZE]; // Data memory
+    uint64_t cycles;       // Instructions executed since reset (virtual time)
+    uint64_t next_deadline; // Earliest device deadline, checked once per cycle
+    ternuino_image_t *image;       // Program image, NULL until one is loaded
+    const instruction_t *code;     // The image's code, cached for the fetch
+    int32_t code_size;             // Addresses past it hold no instructions
+    int32_t *data_mem;     // Data memory: local_mem, or cells shared with other cores
+    int32_t local_mem[MAX_DATA_MEMORY_SIZE];
     int32_t dmem_size;     // Actual data memory size
-    bool memory_valid[MAX_MEMORY_SIZE];     // Track which memory slots have valid instructions
-    tfile_t files[MAX_OPEN_FILES];          // File handles for I/O operations (legacy)
+    int32_t core_id;       // Read by CID, 0 unless the host numbers its cores
+    bool park_blocked;     // A read that finds no input stops the CPU (STOP_BLOCKED)
+    struct device_s *blocked_on; // Device the read was waiting for, NULL if not parked
     
     // Interrupt and device management
     irq_entry_t irq_table[MAX_IRQ_VECTORS]; // Interrupt vector table
@@ -120,15 +168,43 @@ typedef struct ternuino_s {
     int32_t device_count;                   // Number of registered devices
     int32_t pending_irq;                    // Pending interrupt vector (-1 if none)
     int32_t saved_pc;                       // Saved PC for interrupt return
+    
+    // Memory-mapped I/O
+    uint32_t mmio_limit;                          // Window size, 0 while MMIO is disabled
+    struct device_s *mmio_pages[MMIO_PAGE_COUNT]; // Page to device dispatch table
+    int32_t mmio_control[MMIO_PAGE_COUNT];        // Result of the last control write
+    int32_t *shared_mem;                          // Cells at SHARED_BASE, NULL if unmapped
+    uint32_t shared_size;
 } ternuino_t;
 
+// Why ternuino_run_for returned
+typedef enum {
+    STOP_HALTED,            // HLT
+    STOP_END_OF_PROGRAM,    // PC left instruction memory
+    STOP_CYCLE_LIMIT,       // The cycle budget ran out; the CPU can be resumed
+    STOP_BLOCKED            // With park_blocked set, a read found no input. The CPU
+                            // retries it when resumed; blocked_on says which device.
+} stop_reason_t;
+
+// How ternuino_run_for interleaves instructions with device ticks
+typedef enum {
+    ENGINE_STEP,            // Tick devices after every instruction
+    ENGINE_BATCH            // Tick devices once per TERNUINO_BATCH_CYCLES instructions
+} engine_t;
+
+// Longest a batch can delay a device tick. Deadlines (the timer) are still
+// checked every cycle; only polled devices see the extra latency.
+#define TERNUINO_BATCH_CYCLES 64
+
 // Core CPU functions
 void ternuino_init(ternuino_t *cpu, int32_t dmem_size);
 void ternuino_reset(ternuino_t *cpu);
 void ternuino_load_program(ternuino_t *cpu, instruction_t *program, int32_t program_size, 
                           int32_t *data, int32_t data_size);
+void ternuino_unload(ternuino_t *cpu);
 void ternuino_step(ternuino_t *cpu);
 void ternuino_run(ternuino_t *cpu);
+stop_reason_t ternuino_run_for(ternuino_t *cpu, uint64_t max_cycles, engine_t engine);
 
 // Interrupt handling functions
 void ternuino_set_irq_handler(ternuino_t *cpu, int32_t vector, int32_t handler_address);
@@ -141,7 +217,32 @@ void ternuino_check_interrupts(ternuino_t *cpu);
 int32_t ternuino_register_device(ternuino_t *cpu, struct device_s *device);
 void ternuino_unregister_device(ternuino_t *cpu, int32_t device_id);
 struct device_s* ternuino_get_device(ternuino_t *cpu, int32_t device_id);
+struct device_s* ternuino_get_channel(ternuino_t *cpu, int32_t channel);
 void ternuino_tick_devices(ternuino_t *cpu);
+void ternuino_schedule(ternuino_t *cpu, struct device_s *device, uint64_t deadline);
+void ternuino_run_deadlines(ternuino_t *cpu);
+
+// Memory-mapped I/O functions
+void ternuino_enable_mmio(ternuino_t *cpu, bool enabled);
+int32_t ternuino_mmio_load(ternuino_t *cpu, uint32_t offset);
+void ternuino_mmio_store(ternuino_t *cpu, uint32_t offset, int32_t value);
+void ternuino_map_shared(ternuino_t *cpu, int32_t *cells, uint32_t count);
+
+// Use cells (at least dmem_size of them) as data memory instead of the
+// CPU's own, e.g. another core's data_mem. NULL switches back.
+void ternuino_share_data(ternuino_t *cpu, int32_t *cells);
+
+// Program images. create copies code and data (code_size is capped at
+// MAX_MEMORY_SIZE, data_size at MAX_DATA_MEMORY_SIZE) and returns NULL if
+// out of memory; fill in irq_handlers before sharing the image.
+// ternuino_load_image runs image on cpu, dropping the CPU's previous one,
+// and with load_data copies the initial data over all of data memory.
+// ternuino_unload drops the CPU's image when the CPU is done.
+ternuino_image_t* ternuino_image_create(const instruction_t *code, int32_t code_size,
+                                        const int32_t *data, int32_t data_size);
+void ternuino_image_retain(ternuino_image_t *image);
+void ternuino_image_release(ternuino_image_t *image);
+void ternuino_load_image(ternuino_t *cpu, ternuino_image_t *image, bool load_data);
 
 // Helper functions
 const char* opcode_to_string(opcode_t opcode);
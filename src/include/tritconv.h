@@ -0,0 +1,39 @@
+#ifndef TRITCONV_H
+#define TRITCONV_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Any int32_t fits in 21 balanced trits (3^21 / 2 > 2^31)
+#define BT_MAX_TRITS 21
+#define BT_STRING_SIZE (BT_MAX_TRITS + 1)
+
+// Packed trits: 2 bits per trit, trit i (weight 3^i) in bits 2i..2i+1.
+// Codes: 00 = 0, 01 = +1, 11 = -1. Bits above 2 * BT_MAX_TRITS are ignored.
+typedef uint64_t packed_trits_t;
+
+// Conversion kernels. AUTO picks the widest one the host CPU supports.
+typedef enum {
+    BT_KERNEL_AUTO,
+    BT_KERNEL_SCALAR,
+    BT_KERNEL_SSE41,
+    BT_KERNEL_AVX2
+} bt_kernel_t;
+
+bool bt_set_kernel(bt_kernel_t kernel);
+bt_kernel_t bt_get_kernel(void);
+const char* bt_kernel_name(bt_kernel_t kernel);
+
+// Single values. bt_format writes the trits most significant first without
+// a terminator and returns their count (1..BT_MAX_TRITS).
+int bt_format(int32_t value, char *out);
+int32_t bt_parse(const char *str, size_t len);
+
+// Batch conversion between int32 arrays and packed trits or fixed-size strings
+void bt_pack_batch(const int32_t *values, packed_trits_t *packed, size_t count);
+void bt_unpack_batch(const packed_trits_t *packed, int32_t *values, size_t count);
+void bt_format_batch(const int32_t *values, char (*strings)[BT_STRING_SIZE], size_t count);
+void bt_parse_batch(const char (*strings)[BT_STRING_SIZE], int32_t *values, size_t count);
+
+#endif // TRITCONV_H
@@ -0,0 +1,27 @@
+# Atomic demo: XADD, TCAS and CAS on shared cells, CID for the core number
+# With --cores N every core runs this: counter ends at N and total at
+# 0 + 1 + ... + (N-1)
+
+.data
+counter: .word 0
+lock:    .word 0
+total:   .word 0
+
+.text
+        MOV B, 1
+        XADD B, counter     # counter += 1, B = the old count
+acquire:
+        MOV A, 0
+        MOV B, 1
+        TCAS B, lock        # Take the lock if it is free (A = 0 on success)
+        TJZ A, locked
+        JMP acquire
+locked:
+        CID C               # C = this core's ID
+        LD B, total
+        ADD B, C
+        ST B, total         # total += ID while holding the lock
+        MOV A, 1
+        MOV B, 0
+        CAS B, lock         # Release: the lock holds 1, so it becomes 0
+        HLT
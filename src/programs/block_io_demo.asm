@@ -0,0 +1,20 @@
+# Block I/O demo: TBWRITE sends three cells through the mailbox in one
+# instruction and TBREAD takes them back. C holds the count, A gets the
+# number of values moved. Run with --mailbox 3 or more (and --cores N).
+
+.data
+out:    .word 13
+        .word -5
+        .word 27
+in:     .zero 3
+
+.text
+        MOV C, 3
+        TBWRITE 5, out      # Send out[0..2]
+        TJN A, done         # No mailbox device
+        MOV C, 3
+wait:
+        TBREAD 5, in        # Receive what has arrived, up to 3 values
+        TJN A, wait
+done:
+        HLT
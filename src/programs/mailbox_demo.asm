@@ -0,0 +1,12 @@
+# Mailbox demo: every core sends its ID to the next core and receives the
+# previous core's. Run with --cores N --mailbox M; a single core with
+# --mailbox gets its own ID back, and without a mailbox it just halts.
+
+        CID B               # B = this core's ID
+        TWRITE 5, B         # Send it to the next core
+        TJN A, done         # No mailbox device: nothing to exchange
+wait:
+        TREAD 5, C          # C = the previous core's ID
+        TJN A, wait         # Inbox still empty, try again
+done:
+        HLT
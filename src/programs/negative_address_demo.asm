@@ -0,0 +1,9 @@
+# Negative address demo: addresses below 0 wrap to the end of data memory
+
+.text
+        MOV B, -1
+        MOV A, 5
+        ST  A, [B]      # -1 wraps to the last data cell
+        LD  C, 3        # Unrelated cells are untouched (C = 0)
+        LD  C, [B]      # Read the wrapped cell back (C = 5)
+        HLT
@@ -1,6 +1,7 @@
 # Ternary I/O Demo Program
 # This program demonstrates file I/O operations with balanced ternary format
-# It writes some values to a file and then reads them back
+# It writes three values to a file and then reads them back, keeping within
+# the default 27-instruction memory
 
 # Demo 1: Write some ternary values to file
 MOV A, 0        # File ID 0
@@ -20,9 +21,6 @@ TWRITE A, B
 MOV B, 0        # Write zero
 TWRITE A, B
 
-MOV B, 27       # Write decimal 27 (balanced ternary: 1000)
-TWRITE A, B
-
 # Close the file
 TCLOSE A
 
@@ -41,11 +39,7 @@ TJN A, read_end # If error, jump to end
 TREAD A, C      # Read second value into C
 TJN A, read_end
 
-# Continue reading (values will overwrite B and C)
-TREAD A, B      # Read third value
-TJN A, read_end
-
-TREAD A, C      # Read fourth value
+TREAD A, B      # Read third value (overwrites B)
 TJN A, read_end
 
 read_end:
@@ -0,0 +1,377 @@
+// Workload generator: writes parameterized assembly programs for measuring
+// how the assembler, loader and interpreter scale with program and data
+// size. The same kind, sizes and seed always produce the same program.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "ternuino.h"
+
+// Largest register value the arithmetic kernels allow, far from overflow
+#define VALUE_LIMIT (1 << 28)
+
+// Instructions of the loop tail shared by every kind:
+// LD C, count / MOV A, 1 / SUB C, A / ST C, count / TJP C, top
+#define LOOP_TAIL_SIZE 5
+
+typedef struct {
+    int32_t size;           // Instructions
+    int32_t data;           // Data cells
+    int32_t iterations;     // Passes of the main loop
+    int32_t labels;         // Labels for the label-dense kind
+    uint64_t seed;
+    uint64_t state;         // PRNG state
+    FILE *out;
+} gen_t;
+
+typedef bool (*generator_fn)(gen_t *gen);
+
+// splitmix64: small, fast and identical on every platform
+static uint64_t next_random(gen_t *gen) {
+    uint64_t z = (gen->state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static int32_t random_below(gen_t *gen, int32_t limit) {
+    return (int32_t)(next_random(gen) % (uint64_t)limit);
+}
+
+// Random value in [-range, range]
+static int32_t random_value(gen_t *gen, int32_t range) {
+    return random_below(gen, 2 * range + 1) - range;
+}
+
+static const char *const register_names[] = { "A", "B", "C" };
+
+static void emit_loop_counter(gen_t *gen) {
+    fprintf(gen->out, ".data\ncount: .word %d\n", gen->iterations);
+}
+
+// Count down and repeat from top; C holds the remaining passes afterwards
+static void emit_loop_tail(gen_t *gen, const char *top) {
+    fprintf(gen->out, "    LD C, count\n    MOV A, 1\n    SUB C, A\n    ST C, count\n    TJP C, %s\n", top);
+}
+
+static bool check_size(const gen_t *gen, const char *kind, int32_t min_size, int32_t min_data) {
+    if (gen->size < min_size || gen->data < min_data) {
+        fprintf(stderr, "Error: '%s' needs at least %d instructions and %d data cells.\n", kind, min_size, min_data);
+        return false;
+    }
+    return true;
+}
+
+// Emit one random arithmetic or logic instruction on the given registers,
+// tracking an upper bound of each register's magnitude so no sequence can
+// overflow
+static void emit_random_op(gen_t *gen, int64_t bound[3], int reg_count) {
+    static const char *const binary_ops[] = { "ADD", "SUB", "MUL", "DIV", "TAND", "TOR", "TCMPR" };
+    static const char *const unary_ops[] = { "TNOT", "NEG", "TSIGN", "TABS", "TSHL3", "TSHR3" };
+
+    for (;;) {
+        int r = random_below(gen, reg_count);
+        int s = random_below(gen, reg_count);
+        int kind = random_below(gen, 15);
+        int64_t result;
+
+        if (kind < 7) {
+            const char *op = binary_ops[kind];
+            switch (kind) {
+                case 0: case 1: result = bound[r] + bound[s]; break;
+                case 2:         result = bound[r] * bound[s]; break;
+                case 3:         result = bound[r]; break;
+                case 6:         result = 1; break;
+                // Trit-wise results have no more trits than the wider operand
+                default:        result = 3 * (bound[r] > bound[s] ? bound[r] : bound[s]) + 1; break;
+            }
+            if (result > VALUE_LIMIT) continue;
+            fprintf(gen->out, "    %s %s, %s\n", op, register_names[r], register_names[s]);
+        } else if (kind < 13) {
+            const char *op = unary_ops[kind - 7];
+            switch (kind - 7) {
+                case 2:  result = 1; break;
+                case 4:  result = 3 * bound[r]; break;
+                case 0:  result = bound[r] * 3 + 1; break;
+                default: result = bound[r]; break;
+            }
+            if (result > VALUE_LIMIT) continue;
+            fprintf(gen->out, "    %s %s\n", op, register_names[r]);
+        } else {
+            int32_t value = random_value(gen, 40);
+            result = value < 0 ? -value : value;
+            fprintf(gen->out, "    MOV %s, %d\n", register_names[r], value);
+        }
+        bound[r] = result;
+        return;
+    }
+}
+
+// Reset registers to small constants so every pass starts from known bounds
+static void emit_register_reset(gen_t *gen, int64_t bound[3], int reg_count) {
+    for (int r = 0; r < reg_count; r++) {
+        int32_t value = random_value(gen, 13);
+        fprintf(gen->out, "    MOV %s, %d\n", register_names[r], value);
+        bound[r] = value < 0 ? -value : value;
+    }
+}
+
+// Straight-line arithmetic kernel repeated in a loop
+static bool generate_arith(gen_t *gen) {
+    int32_t body = gen->size - 3 - LOOP_TAIL_SIZE - 1;
+    if (!check_size(gen, "arith", 3 + LOOP_TAIL_SIZE + 1 + 1, 1)) return false;
+
+    int64_t bound[3];
+    emit_loop_counter(gen);
+    fprintf(gen->out, ".text\ntop:\n");
+    emit_register_reset(gen, bound, 3);
+    for (int32_t i = 0; i < body; i++) {
+        emit_random_op(gen, bound, 3);
+    }
+    emit_loop_tail(gen, "top");
+    fprintf(gen->out, "    HLT\n");
+    return true;
+}
+
+// State machine: each state reads an input trit and picks one of three
+// successors. The state is a code address stored in data memory and
+// dispatched with JMP A.
+#define STATE_SIZE 9
+
+static bool generate_branchy(gen_t *gen) {
+    // MOV A, s0 / tick (ST + tail + HLT) / dispatch (LD + JMP)
+    int32_t fixed = 1 + 1 + LOOP_TAIL_SIZE + 1 + 2;
+    int32_t states = (gen->size - fixed) / STATE_SIZE;
+    if (!check_size(gen, "branchy", fixed + STATE_SIZE, 3)) return false;
+
+    // Inputs fill the data memory that the counter and state leave free;
+    // LD B, [C] reads the cell the countdown points at
+    fprintf(gen->out, ".data\ncount: .word %d\nstate: .word 0\n", gen->iterations);
+    for (int32_t i = 2; i < gen->data; i++) {
+        fprintf(gen->out, "input%d: .word %d\n", i, random_value(gen, 1));
+    }
+
+    fprintf(gen->out, ".text\n    MOV A, s0\n");
+    fprintf(gen->out, "tick:\n    ST A, state\n");
+    emit_loop_tail(gen, "dispatch");
+    fprintf(gen->out, "    HLT\n");
+    fprintf(gen->out, "dispatch:\n    LD A, state\n    JMP A\n");
+
+    for (int32_t s = 0; s < states; s++) {
+        fprintf(gen->out, "s%d:\n", s);
+        fprintf(gen->out, "    LD B, [C]\n");
+        fprintf(gen->out, "    TJN B, s%d_negative\n", s);
+        fprintf(gen->out, "    TJZ B, s%d_zero\n", s);
+        fprintf(gen->out, "    MOV A, s%d\n    JMP tick\n", random_below(gen, states));
+        fprintf(gen->out, "s%d_negative:\n    MOV A, s%d\n    JMP tick\n", s, random_below(gen, states));
+        fprintf(gen->out, "s%d_zero:\n    MOV A, s%d\n    JMP tick\n", s, random_below(gen, states));
+    }
+    return true;
+}
+
+// Copy a .word array into a .zero buffer, negating each value, until the
+// zero sentinel at the end of the array
+static bool generate_stream(gen_t *gen) {
+    // Per element: LD / TJZ / NEG / MOV / ADD / ST / MOV / ADD
+    const int32_t element_size = 8;
+    int32_t fixed = 1 + 1 + LOOP_TAIL_SIZE + 1;  // LEA, JMP back, tail, HLT
+    if (!check_size(gen, "stream", fixed + element_size, 5)) return false;
+
+    int32_t cells = (gen->data - 2) / 2;      // Array and buffer, plus sentinel and counter
+    int32_t unroll = (gen->size - fixed) / element_size;
+
+    emit_loop_counter(gen);
+    fprintf(gen->out, "source:\n");
+    for (int32_t i = 0; i < cells; i++) {
+        int32_t value = random_value(gen, 12);
+        fprintf(gen->out, "    .word %d\n", value == 0 ? 13 : value);
+    }
+    fprintf(gen->out, "    .word 0\n");
+    fprintf(gen->out, "buffer:\n    .zero %d\n", cells);
+
+    // The buffer starts cells + 1 after the source element A points at
+    fprintf(gen->out, ".text\ntop:\n    LEA A, source\nnext:\n");
+    for (int32_t i = 0; i < unroll; i++) {
+        fprintf(gen->out, "    LD B, [A]\n    TJZ B, done\n    NEG B\n");
+        fprintf(gen->out, "    MOV C, %d\n    ADD C, A\n    ST B, [C]\n", cells + 1);
+        fprintf(gen->out, "    MOV B, 1\n    ADD A, B\n");
+    }
+    fprintf(gen->out, "    JMP next\ndone:\n");
+    emit_loop_tail(gen, "top");
+    fprintf(gen->out, "    HLT\n");
+    return true;
+}
+
+// Compute, raise a software interrupt whose handler writes B to the file
+// device, repeat. Run with --file 0=PATH to choose the output file.
+static bool generate_irq(gen_t *gen) {
+    // TOPEN, EI, 2 resets, IRQ, tail, DI, TCLOSE, HLT, handler (2), stub
+    int32_t fixed = 2 + 2 + 1 + LOOP_TAIL_SIZE + 3 + 2 + 1;
+    if (!check_size(gen, "irq", fixed, 1)) return false;
+
+    int64_t bound[3];
+    fprintf(gen->out, ".irq 5, handler\n");
+    // Device vectors default to fixed addresses inside the program
+    for (int v = 0; v < 5; v++) {
+        fprintf(gen->out, ".irq %d, ignore\n", v);
+    }
+    emit_loop_counter(gen);
+    fprintf(gen->out, ".text\n    TOPEN 1, 1\n    EI\ntop:\n");
+    emit_register_reset(gen, bound, 2);
+    for (int32_t i = 0; i < gen->size - fixed; i++) {
+        emit_random_op(gen, bound, 2);
+    }
+    fprintf(gen->out, "    IRQ 5\n");
+    emit_loop_tail(gen, "top");
+    fprintf(gen->out, "    DI\n    TCLOSE 1\n    HLT\n");
+    fprintf(gen->out, "handler:\n    TWRITE 1, B\n    IRET\n");
+    fprintf(gen->out, "ignore:\n    IRET\n");
+    return true;
+}
+
+// A chain of jumps through many label aliases, with long random names
+static bool generate_labels(gen_t *gen) {
+    int32_t chain = gen->size - LOOP_TAIL_SIZE - 1;
+    if (!check_size(gen, "labels", LOOP_TAIL_SIZE + 2, 1)) return false;
+
+    int32_t labels = gen->labels > chain ? gen->labels : chain;
+    int32_t *first = malloc(((size_t)chain + 1) * sizeof(int32_t));
+    if (!first) return false;
+
+    // Instruction i owns labels first[i] .. first[i + 1] - 1
+    for (int32_t i = 0; i <= chain; i++) {
+        first[i] = (int32_t)((int64_t)labels * i / chain);
+    }
+
+    char (*names)[48] = malloc((size_t)labels * sizeof(*names));
+    if (!names) {
+        free(first);
+        return false;
+    }
+    for (int32_t l = 0; l < labels; l++) {
+        int len = snprintf(names[l], sizeof(names[l]), "L%d_", l);
+        int extra = random_below(gen, 24);
+        for (int c = 0; c < extra; c++) {
+            names[l][len++] = (char)('a' + random_below(gen, 26));
+        }
+        names[l][len] = '\0';
+    }
+
+    emit_loop_counter(gen);
+    fprintf(gen->out, ".text\n");
+    for (int32_t i = 0; i < chain; i++) {
+        for (int32_t l = first[i]; l < first[i + 1]; l++) {
+            fprintf(gen->out, "%s:\n", names[l]);
+        }
+        if (i + 1 < chain) {
+            int32_t target = first[i + 1] + random_below(gen, first[i + 2 > chain ? chain : i + 2] - first[i + 1]);
+            fprintf(gen->out, "    JMP %s\n", names[target]);
+        } else {
+            fprintf(gen->out, "    NOP\n");
+        }
+    }
+    emit_loop_tail(gen, names[0]);
+    fprintf(gen->out, "    HLT\n");
+
+    free(names);
+    free(first);
+    return true;
+}
+
+typedef struct {
+    const char *name;
+    generator_fn generate;
+    const char *description;
+} generator_t;
+
+static const generator_t generators[] = {
+    { "arith", generate_arith, "straight-line arithmetic and trit logic kernel" },
+    { "branchy", generate_branchy, "state machine driven by input trits in data memory" },
+    { "stream", generate_stream, "copy a .word array into a .zero buffer" },
+    { "irq", generate_irq, "software interrupts whose handler writes to the file device" },
+    { "labels", generate_labels, "jump chain through many long label aliases" },
+};
+
+#define GENERATOR_COUNT ((int)(sizeof(generators) / sizeof(generators[0])))
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s KIND [options]\n", prog);
+    printf("Kinds:\n");
+    for (int i = 0; i < GENERATOR_COUNT; i++) {
+        printf("  %-10s %s\n", generators[i].name, generators[i].description);
+    }
+    printf("Options:\n");
+    printf("  --size N         Instructions to generate (default %d)\n", MAX_MEMORY_SIZE);
+    printf("  --data N         Data cells to use (default %d)\n", MAX_DATA_MEMORY_SIZE);
+    printf("  --iterations N   Passes of the main loop (default 1000)\n");
+    printf("  --labels N       Labels for 'labels' (default 1000)\n");
+    printf("  --seed N         Random seed (default 1)\n");
+    printf("  -o FILE          Write to FILE instead of stdout\n");
+    printf("Programs larger than %d instructions or data cells need a simulator built\n", MAX_MEMORY_SIZE);
+    printf("with a larger MEMORY_SIZE.\n");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const generator_t *generator = NULL;
+    for (int i = 0; i < GENERATOR_COUNT; i++) {
+        if (strcmp(argv[1], generators[i].name) == 0) {
+            generator = &generators[i];
+        }
+    }
+    if (!generator) {
+        print_usage(argv[0]);
+        return strcmp(argv[1], "--help") == 0 ? 0 : 1;
+    }
+
+    gen_t gen;
+    memset(&gen, 0, sizeof(gen));
+    gen.size = MAX_MEMORY_SIZE;
+    gen.data = MAX_DATA_MEMORY_SIZE;
+    gen.iterations = 1000;
+    gen.labels = 1000;
+    gen.seed = 1;
+    gen.out = stdout;
+    const char *output = NULL;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            gen.size = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--data") == 0 && i + 1 < argc) {
+            gen.data = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            gen.iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--labels") == 0 && i + 1 < argc) {
+            gen.labels = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            gen.seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (gen.iterations < 1) gen.iterations = 1;
+    gen.state = gen.seed;
+
+    if (output) {
+        gen.out = fopen(output, "w");
+        if (!gen.out) {
+            fprintf(stderr, "Error: Cannot write '%s'.\n", output);
+            return 1;
+        }
+    }
+
+    fprintf(gen.out, "# Generated by asmgen: %s --size %d --data %d --iterations %d --labels %d --seed %llu\n",
+            generator->name, gen.size, gen.data, gen.iterations, gen.labels, (unsigned long long)gen.seed);
+    bool success = generator->generate(&gen);
+
+    if (output) fclose(gen.out);
+    return success ? 0 : 1;
+}
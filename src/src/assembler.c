@@ -1,109 +1,275 @@
 #include "assembler.h"
+#include "lexer.h"
+#include "mapfile.h"
+#include "runtime.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
 #include <ctype.h>
 
 void assembler_init(assembler_t *asm_state) {
+    asm_state->source_name = NULL;
+    asm_state->relocatable = false;
+    asm_state->labels = NULL;
+    asm_state->label_capacity = 0;
     asm_state->label_count = 0;
     asm_state->data_size = 0;
     asm_state->in_data_section = false;
+    for (int i = 0; i < MAX_IRQ_VECTORS; i++) {
+        asm_state->irq_handlers[i] = -1;
+    }
+    asm_state->unresolved_refs = NULL;
+    asm_state->unresolved_capacity = 0;
     asm_state->unresolved_count = 0;
-    memset(asm_state->labels, 0, sizeof(asm_state->labels));
+    asm_state->exports = NULL;
+    asm_state->export_capacity = 0;
+    asm_state->export_count = 0;
+    asm_state->relocations = NULL;
+    asm_state->relocation_capacity = 0;
+    asm_state->relocation_count = 0;
     memset(asm_state->data_image, 0, sizeof(asm_state->data_image));
-    memset(asm_state->unresolved_refs, 0, sizeof(asm_state->unresolved_refs));
 }
 
-static void trim_string(char *str) {
-    // Remove leading whitespace
-    char *start = str;
-    while (isspace(*start)) start++;
+void assembler_free(assembler_t *asm_state) {
+    ternuino_free(asm_state->labels);
+    ternuino_free(asm_state->unresolved_refs);
+    ternuino_free(asm_state->exports);
+    ternuino_free(asm_state->relocations);
+    asm_state->labels = NULL;
+    asm_state->unresolved_refs = NULL;
+    asm_state->exports = NULL;
+    asm_state->relocations = NULL;
+    asm_state->label_capacity = 0;
+    asm_state->label_count = 0;
+    asm_state->unresolved_capacity = 0;
+    asm_state->unresolved_count = 0;
+    asm_state->export_capacity = 0;
+    asm_state->export_count = 0;
+    asm_state->relocation_capacity = 0;
+    asm_state->relocation_count = 0;
+}
+
+// Make room for one more element in a growable array
+static bool reserve_one(void **items, int32_t *capacity, int32_t count, size_t item_size) {
+    if (count < *capacity) return true;
+    
+    int32_t new_capacity = *capacity ? *capacity * 2 : 64;
+    void *grown = ternuino_realloc(*items, (size_t)new_capacity * item_size);
+    if (!grown) {
+        ternuino_log(TERNUINO_LOG_ERROR, "Error: Out of memory in assembler");
+        return false;
+    }
+    *items = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+// Diagnostics are logged in one call, so files assembled on different
+// threads do not interleave within a line
+static void report_error(const assembler_t *asm_state, uint32_t line, uint32_t column,
+                         const char *format, ...) {
+    char message[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    
+    if (asm_state->source_name) {
+        ternuino_log(TERNUINO_LOG_ERROR, "Error in %s on line %u, column %u: %s", asm_state->source_name, line, column, message);
+    } else {
+        ternuino_log(TERNUINO_LOG_ERROR, "Error on line %u, column %u: %s", line, column, message);
+    }
+}
+
+// Names longer than a label slot are truncated, as they always have been
+static size_t label_length(size_t length) {
+    return length < MAX_LABEL_LENGTH - 1 ? length : MAX_LABEL_LENGTH - 1;
+}
+
+// FNV-1a over the stored name; code and data labels live in separate
+// namespaces
+static uint32_t label_hash(const char *name, size_t length, bool is_data) {
+    uint32_t hash = is_data ? 0x050c5d1fu : 0x811c9dc5u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Slot holding the label, or the empty slot where it would go
+static label_t* label_slot(label_t *table, int32_t capacity, const char *name, size_t length,
+                           bool is_data, uint32_t hash) {
+    uint32_t mask = (uint32_t)capacity - 1;
+    for (uint32_t i = hash & mask; ; i = (i + 1) & mask) {
+        label_t *slot = &table[i];
+        if (!slot->used) return slot;
+        if (slot->hash == hash && slot->is_data_label == is_data &&
+            memcmp(slot->name, name, length) == 0 && slot->name[length] == '\0') {
+            return slot;
+        }
+    }
+}
+
+// Double the table, keeping it at most half full
+static bool grow_labels(assembler_t *asm_state) {
+    int32_t capacity = asm_state->label_capacity ? asm_state->label_capacity * 2 : 64;
+    label_t *table = ternuino_calloc((size_t)capacity, sizeof(label_t));
+    if (!table) {
+        ternuino_log(TERNUINO_LOG_ERROR, "Error: Out of memory for labels");
+        return false;
+    }
     
-    // Remove trailing whitespace
-    char *end = start + strlen(start) - 1;
-    while (end > start && isspace(*end)) end--;
+    for (int32_t i = 0; i < asm_state->label_capacity; i++) {
+        label_t *old = &asm_state->labels[i];
+        if (old->used) {
+            *label_slot(table, capacity, old->name, strlen(old->name), old->is_data_label, old->hash) = *old;
+        }
+    }
     
-    // Move trimmed string to beginning and null-terminate
-    int len = end - start + 1;
-    memmove(str, start, len);
-    str[len] = '\0';
+    ternuino_free(asm_state->labels);
+    asm_state->labels = table;
+    asm_state->label_capacity = capacity;
+    return true;
 }
 
-static void remove_comments(char *line) {
-    char *comment = strchr(line, '#');
-    if (comment) *comment = '\0';
+static const label_t* find_label(const assembler_t *asm_state, const char *name, bool is_data) {
+    if (asm_state->label_count == 0) return NULL;
     
-    comment = strchr(line, ';');
-    if (comment) *comment = '\0';
+    size_t length = label_length(strlen(name));
+    const label_t *slot = label_slot(asm_state->labels, asm_state->label_capacity, name, length,
+                                     is_data, label_hash(name, length, is_data));
+    return slot->used ? slot : NULL;
 }
 
-static bool add_label(assembler_t *asm_state, const char *name, int32_t address, bool is_data) {
-    if (asm_state->label_count >= MAX_LABELS) {
-        printf("Error: Too many labels (max %d)\n", MAX_LABELS);
-        return false;
+static label_t* add_label(assembler_t *asm_state, const token_t *name, int32_t address, bool is_data) {
+    if ((asm_state->label_count + 1) * 2 > asm_state->label_capacity && !grow_labels(asm_state)) {
+        return NULL;
     }
     
+    size_t length = label_length(name->length);
+    uint32_t hash = label_hash(name->text, length, is_data);
+    label_t *slot = label_slot(asm_state->labels, asm_state->label_capacity, name->text, length,
+                               is_data, hash);
+    
     // Check for duplicate labels
-    for (int i = 0; i < asm_state->label_count; i++) {
-        if (strcmp(asm_state->labels[i].name, name) == 0 && 
-            asm_state->labels[i].is_data_label == is_data) {
-            printf("Error: Duplicate label '%s'\n", name);
-            return false;
-        }
+    if (slot->used) {
+        report_error(asm_state, name->line, name->column, "Duplicate label '%.*s'", (int)name->length, name->text);
+        return NULL;
     }
     
-    snprintf(asm_state->labels[asm_state->label_count].name, MAX_LABEL_LENGTH, "%s", name);
-    asm_state->labels[asm_state->label_count].address = address;
-    asm_state->labels[asm_state->label_count].is_data_label = is_data;
+    memcpy(slot->name, name->text, length);
+    slot->name[length] = '\0';
+    slot->address = address;
+    slot->is_data_label = is_data;
+    slot->is_global = false;
+    slot->is_extern = false;
+    slot->used = true;
+    slot->hash = hash;
     asm_state->label_count++;
     
-    return true;
+    return slot;
+}
+
+bool assembler_define_label(assembler_t *asm_state, const char *name, int32_t address, bool is_data) {
+    if (find_label(asm_state, name, is_data)) return false;
+    
+    token_t token = { TOKEN_WORD, name, strlen(name), 0, 0 };
+    label_t *label = add_label(asm_state, &token, address, is_data);
+    if (label) label->is_global = true;
+    return label != NULL;
+}
+
+const label_t* assembler_find_label(const assembler_t *asm_state, const char *name, bool is_data) {
+    return find_label(asm_state, name, is_data);
+}
+
+// Code labels take precedence over data labels of the same name
+static const label_t* find_any_label(const assembler_t *asm_state, const char *name) {
+    const label_t *label = find_label(asm_state, name, false);
+    return label ? label : find_label(asm_state, name, true);
+}
+
+// Mnemonic lookup: switch on length and first characters, then a single
+// comparison against each remaining candidate
+bool lookup_opcode(const char *str, size_t len, opcode_t *opcode) {
+#define MATCH(name, op) if (memcmp(str, name, len) == 0) { *opcode = op; return true; }
+    switch (len) {
+        case 2:
+            switch (str[0]) {
+                case 'D': MATCH("DI", OP_DI); break;
+                case 'E': MATCH("EI", OP_EI); break;
+                case 'L': MATCH("LD", OP_LD); break;
+                case 'S': MATCH("ST", OP_ST); break;
+            }
+            break;
+        case 3:
+            switch (str[0]) {
+                case 'A': MATCH("ADD", OP_ADD); break;
+                case 'C': MATCH("CAS", OP_CAS); MATCH("CID", OP_CID); break;
+                case 'D': MATCH("DIV", OP_DIV); break;
+                case 'H': MATCH("HLT", OP_HLT); break;
+                case 'I': MATCH("IRQ", OP_IRQ); break;
+                case 'J': MATCH("JMP", OP_JMP); break;
+                case 'L': MATCH("LEA", OP_LEA); break;
+                case 'M': MATCH("MOV", OP_MOV); MATCH("MUL", OP_MUL); break;
+                case 'N': MATCH("NOP", OP_NOP); MATCH("NEG", OP_NEG); break;
+                case 'S': MATCH("SUB", OP_SUB); break;
+                case 'T':
+                    switch (str[2]) {
+                        case 'R': MATCH("TOR", OP_TOR); break;
+                        case 'Z': MATCH("TJZ", OP_TJZ); break;
+                        case 'N': MATCH("TJN", OP_TJN); break;
+                        case 'P': MATCH("TJP", OP_TJP); break;
+                    }
+                    break;
+            }
+            break;
+        case 4:
+            switch (str[1]) {
+                case 'A': MATCH("TAND", OP_TAND); MATCH("TABS", OP_TABS); MATCH("XADD", OP_XADD); break;
+                case 'C': MATCH("TCAS", OP_TCAS); break;
+                case 'N': MATCH("TNOT", OP_TNOT); break;
+                case 'R': MATCH("IRET", OP_IRET); break;
+            }
+            break;
+        case 5:
+            switch (str[2]) {
+                case 'I': MATCH("TSIGN", OP_TSIGN); break;
+                case 'H': MATCH("TSHL3", OP_TSHL3); MATCH("TSHR3", OP_TSHR3); break;
+                case 'M': MATCH("TCMPR", OP_TCMPR); break;
+                case 'P': MATCH("TOPEN", OP_TOPEN); break;
+                case 'E': MATCH("TREAD", OP_TREAD); MATCH("TSEEK", OP_TSEEK); break;
+            }
+            break;
+        case 6:
+            switch (str[1]) {
+                case 'W': MATCH("TWRITE", OP_TWRITE); break;
+                case 'C': MATCH("TCLOSE", OP_TCLOSE); break;
+                case 'B': MATCH("TBREAD", OP_TBREAD); break;
+            }
+            break;
+        case 7:
+            MATCH("TBWRITE", OP_TBWRITE);
+            break;
+    }
+#undef MATCH
+    return false;
 }
 
 opcode_t string_to_opcode(const char *str) {
-    if (strcmp(str, "NOP") == 0) return OP_NOP;
-    if (strcmp(str, "MOV") == 0) return OP_MOV;
-    if (strcmp(str, "ADD") == 0) return OP_ADD;
-    if (strcmp(str, "SUB") == 0) return OP_SUB;
-    if (strcmp(str, "MUL") == 0) return OP_MUL;
-    if (strcmp(str, "DIV") == 0) return OP_DIV;
-    if (strcmp(str, "JMP") == 0) return OP_JMP;
-    if (strcmp(str, "HLT") == 0) return OP_HLT;
-    if (strcmp(str, "LEA") == 0) return OP_LEA;
-    if (strcmp(str, "LD") == 0) return OP_LD;
-    if (strcmp(str, "ST") == 0) return OP_ST;
-    if (strcmp(str, "TAND") == 0) return OP_TAND;
-    if (strcmp(str, "TOR") == 0) return OP_TOR;
-    if (strcmp(str, "TNOT") == 0) return OP_TNOT;
-    if (strcmp(str, "NEG") == 0) return OP_NEG;
-    if (strcmp(str, "TSIGN") == 0) return OP_TSIGN;
-    if (strcmp(str, "TABS") == 0) return OP_TABS;
-    if (strcmp(str, "TSHL3") == 0) return OP_TSHL3;
-    if (strcmp(str, "TSHR3") == 0) return OP_TSHR3;
-    if (strcmp(str, "TCMPR") == 0) return OP_TCMPR;
-    if (strcmp(str, "TJZ") == 0) return OP_TJZ;
-    if (strcmp(str, "TJN") == 0) return OP_TJN;
-    if (strcmp(str, "TJP") == 0) return OP_TJP;
-    if (strcmp(str, "TOPEN") == 0) return OP_TOPEN;
-    if (strcmp(str, "TREAD") == 0) return OP_TREAD;
-    if (strcmp(str, "TWRITE") == 0) return OP_TWRITE;
-    if (strcmp(str, "TCLOSE") == 0) return OP_TCLOSE;
-    if (strcmp(str, "IRQ") == 0) return OP_IRQ;
-    if (strcmp(str, "IRET") == 0) return OP_IRET;
-    if (strcmp(str, "EI") == 0) return OP_EI;
-    if (strcmp(str, "DI") == 0) return OP_DI;
+    opcode_t opcode;
+    if (lookup_opcode(str, strlen(str), &opcode)) return opcode;
     return OP_NOP;  // Default for unknown opcodes
 }
 
 ternuino_register_t string_to_register(const char *str) {
-    if (strcmp(str, "A") == 0) return REG_A;
-    if (strcmp(str, "B") == 0) return REG_B;
-    if (strcmp(str, "C") == 0) return REG_C;
+    if (is_valid_register(str)) return (ternuino_register_t)(str[0] - 'A');
     return REG_A;  // Default
 }
 
 bool is_valid_register(const char *str) {
-    return (strcmp(str, "A") == 0 || strcmp(str, "B") == 0 || strcmp(str, "C") == 0);
+    return str[0] >= 'A' && str[0] <= 'C' && str[1] == '\0';
 }
 
 bool is_indirect_operand(const char *str, char *reg_name) {
@@ -116,45 +282,70 @@ bool is_indirect_operand(const char *str, char *reg_name) {
     return false;
 }
 
-static bool add_unresolved_ref(assembler_t *asm_state, const char *label_name, 
+static void fill_ref(unresolved_ref_t *ref, const token_t *label, 
+                     int32_t instruction_address, int32_t operand_number) {
+    size_t length = label_length(label->length);
+    memcpy(ref->label_name, label->text, length);
+    ref->label_name[length] = '\0';
+    ref->instruction_address = instruction_address;
+    ref->operand_number = operand_number;
+    ref->line = label->line;
+    ref->column = label->column;
+}
+
+static bool add_unresolved_ref(assembler_t *asm_state, const token_t *label, 
                               int32_t instruction_address, int32_t operand_number) {
-    if (asm_state->unresolved_count >= MAX_UNRESOLVED_REFS) {
-        printf("Error: Too many unresolved label references\n");
+    if (!reserve_one((void**)&asm_state->unresolved_refs, &asm_state->unresolved_capacity,
+                     asm_state->unresolved_count, sizeof(unresolved_ref_t))) {
         return false;
     }
     
-    unresolved_ref_t *ref = &asm_state->unresolved_refs[asm_state->unresolved_count];
-    strncpy(ref->label_name, label_name, MAX_LABEL_LENGTH - 1);
-    ref->label_name[MAX_LABEL_LENGTH - 1] = '\0';
-    ref->instruction_address = instruction_address;
-    ref->operand_number = operand_number;
-    asm_state->unresolved_count++;
-    
+    fill_ref(&asm_state->unresolved_refs[asm_state->unresolved_count++], label,
+             instruction_address, operand_number);
     return true;
 }
 
-bool parse_operand_with_labels(assembler_t *asm_state, const char *token, operand_t *operand, 
-                              int32_t instruction_address, int32_t operand_number) {
-    char reg_name[4];
+static bool add_relocation(assembler_t *asm_state, const unresolved_ref_t *ref, reloc_kind_t kind) {
+    if (!reserve_one((void**)&asm_state->relocations, &asm_state->relocation_capacity,
+                     asm_state->relocation_count, sizeof(relocation_t))) {
+        return false;
+    }
     
+    relocation_t *reloc = &asm_state->relocations[asm_state->relocation_count++];
+    reloc->instruction_address = ref->instruction_address;
+    reloc->operand_number = ref->operand_number;
+    reloc->kind = kind;
+    memcpy(reloc->symbol, ref->label_name, sizeof(reloc->symbol));
+    return true;
+}
+
+// Register name: a single letter A-C
+static bool token_register(const char *text, size_t length, ternuino_register_t *reg) {
+    if (length != 1 || text[0] < 'A' || text[0] > 'C') return false;
+    *reg = (ternuino_register_t)(text[0] - 'A');
+    return true;
+}
+
+// Parse an operand token. Labels are recorded for resolution when
+// asm_state is given.
+static bool parse_operand_token(assembler_t *asm_state, const token_t *token, operand_t *operand,
+                                int32_t instruction_address, int32_t operand_number) {
     // Check for indirect addressing [A], [B], [C]
-    if (is_indirect_operand(token, reg_name)) {
+    if (token->length == 3 && token->text[0] == '[' && token->text[2] == ']' &&
+        token_register(token->text + 1, 1, &operand->value.reg)) {
         operand->mode = ADDR_INDIRECT;
-        operand->value.reg = string_to_register(reg_name);
         return true;
     }
     
     // Check for register
-    if (is_valid_register(token)) {
+    if (token_register(token->text, token->length, &operand->value.reg)) {
         operand->mode = ADDR_REGISTER;
-        operand->value.reg = string_to_register(token);
         return true;
     }
     
     // Check for immediate integer
-    char *endptr;
-    long val = strtol(token, &endptr, 10);
-    if (*endptr == '\0') {
+    long val;
+    if (token_to_int(token, &val)) {
         operand->mode = ADDR_IMMEDIATE;
         operand->value.immediate = (int32_t)val;
         return true;
@@ -164,348 +355,392 @@ bool parse_operand_with_labels(assembler_t *asm_state, const char *token, operan
     operand->mode = ADDR_DIRECT;
     operand->value.address = -1;  // Mark as unresolved
     
-    // Add to unresolved references
+    if (!asm_state) return true;
     return add_unresolved_ref(asm_state, token, instruction_address, operand_number);
 }
 
+static void string_token(const char *str, token_t *token) {
+    token->type = TOKEN_WORD;
+    token->text = str;
+    token->length = strlen(str);
+    token->line = 1;
+    token->column = 1;
+}
+
+bool parse_operand_with_labels(assembler_t *asm_state, const char *token, operand_t *operand, 
+                              int32_t instruction_address, int32_t operand_number) {
+    token_t view;
+    string_token(token, &view);
+    return parse_operand_token(asm_state, &view, operand, instruction_address, operand_number);
+}
+
 bool parse_operand(const char *token, operand_t *operand) {
-    char reg_name[4];
-    
-    // Check for indirect addressing [A], [B], [C]
-    if (is_indirect_operand(token, reg_name)) {
-        operand->mode = ADDR_INDIRECT;
-        operand->value.reg = string_to_register(reg_name);
-        return true;
+    token_t view;
+    string_token(token, &view);
+    return parse_operand_token(NULL, &view, operand, 0, 0);
+}
+
+static int operand_count(opcode_t opcode) {
+    switch (opcode) {
+        case OP_NOP:
+        case OP_HLT:
+        case OP_IRET:
+        case OP_EI:
+        case OP_DI:
+            return 0;
+            
+        case OP_TNOT:
+        case OP_NEG:
+        case OP_TSIGN:
+        case OP_TABS:
+        case OP_TSHL3:
+        case OP_TSHR3:
+        case OP_JMP:
+        case OP_IRQ:
+        case OP_TCLOSE:
+        case OP_CID:
+            return 1;
+            
+        case OP_MOV:
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_TAND:
+        case OP_TOR:
+        case OP_TJZ:
+        case OP_TJN:
+        case OP_TJP:
+        case OP_TCMPR:
+        case OP_LD:
+        case OP_ST:
+        case OP_LEA:
+        case OP_TOPEN:
+        case OP_TREAD:
+        case OP_TWRITE:
+        case OP_TSEEK:
+        case OP_TBREAD:
+        case OP_TBWRITE:
+        case OP_CAS:
+        case OP_TCAS:
+        case OP_XADD:
+            return 2;
+    }
+    return 0;
+}
+
+// .irq VECTOR, HANDLER: the handler is a code label or an address
+static bool parse_irq_directive(assembler_t *asm_state, const token_t *tokens, int token_count) {
+    if (token_count != 3) {
+        report_error(asm_state, tokens[0].line, tokens[0].column, ".irq expects a vector and a handler");
+        return false;
     }
     
-    // Check for register
-    if (is_valid_register(token)) {
-        operand->mode = ADDR_REGISTER;
-        operand->value.reg = string_to_register(token);
-        return true;
+    long vector;
+    if (!token_to_int(&tokens[1], &vector) || vector < 0 || vector >= MAX_IRQ_VECTORS) {
+        report_error(asm_state, tokens[1].line, tokens[1].column, "IRQ vector must be 0 to %d", MAX_IRQ_VECTORS - 1);
+        return false;
     }
     
-    // Check for immediate integer
-    char *endptr;
-    long val = strtol(token, &endptr, 10);
-    if (*endptr == '\0') {
-        operand->mode = ADDR_IMMEDIATE;
-        operand->value.immediate = (int32_t)val;
+    long address;
+    if (token_to_int(&tokens[2], &address)) {
+        asm_state->irq_handlers[vector] = (int32_t)address;
         return true;
     }
     
-    // Otherwise, it's a label (will be resolved later)
-    operand->mode = ADDR_DIRECT;
-    operand->value.address = -1;  // Mark as unresolved
-    return true;
+    return add_unresolved_ref(asm_state, &tokens[2], (int32_t)vector, 0);
 }
 
-static bool parse_data_directive(assembler_t *asm_state, char *line, const char *directive) {
-    if (strncasecmp(line, directive, strlen(directive)) == 0) {
-        char *args = line + strlen(directive);
-        trim_string(args);
-        
-        if (strcmp(directive, ".word") == 0) {
-            if (strlen(args) == 0) {
-                printf("Error: .word expects a value\n");
-                return false;
-            }
-            
-            char *endptr;
-            long val = strtol(args, &endptr, 10);
-            if (*endptr != '\0') {
-                printf("Error: .word expects an integer\n");
-                return false;
-            }
-            
-            if (asm_state->data_size >= MAX_DATA_MEMORY_SIZE) {
-                printf("Error: Data memory overflow\n");
-                return false;
-            }
-            
-            asm_state->data_image[asm_state->data_size++] = (int32_t)val;
-            return true;
-        }
-        
-        if (strcmp(directive, ".zero") == 0) {
-            if (strlen(args) == 0) {
-                printf("Error: .zero expects a count\n");
-                return false;
-            }
-            
-            char *endptr;
-            long count = strtol(args, &endptr, 10);
-            if (*endptr != '\0' || count < 0) {
-                printf("Error: .zero expects a non-negative integer\n");
-                return false;
-            }
-            
-            if (asm_state->data_size + count > MAX_DATA_MEMORY_SIZE) {
-                printf("Error: Data memory overflow\n");
-                return false;
-            }
-            
-            for (int i = 0; i < count; i++) {
-                asm_state->data_image[asm_state->data_size++] = 0;
-            }
-            return true;
-        }
+// .global NAME exports a label of this file; .extern NAME imports one
+// that another file exports
+static bool parse_symbol_directive(assembler_t *asm_state, const token_t *tokens, int token_count,
+                                   bool is_extern) {
+    if (token_count != 2) {
+        report_error(asm_state, tokens[0].line, tokens[0].column, "'%.*s' expects a label name",
+                     (int)tokens[0].length, tokens[0].text);
+        return false;
     }
     
-    return false;
+    if (is_extern) {
+        label_t *label = add_label(asm_state, &tokens[1], 0, false);
+        if (label) label->is_extern = true;
+        return label != NULL;
+    }
+    
+    if (!reserve_one((void**)&asm_state->exports, &asm_state->export_capacity,
+                     asm_state->export_count, sizeof(unresolved_ref_t))) {
+        return false;
+    }
+    fill_ref(&asm_state->exports[asm_state->export_count++], &tokens[1], 0, 0);
+    return true;
 }
 
-bool parse_instruction_line(assembler_t *asm_state, const char *line, 
-                           instruction_t *instr, bool *has_instruction, int32_t instruction_address) {
-    char working_line[MAX_LINE_LENGTH];
-    strncpy(working_line, line, MAX_LINE_LENGTH - 1);
-    working_line[MAX_LINE_LENGTH - 1] = '\0';
-    
-    *has_instruction = false;
+// .data, .text, .irq, .global, .extern, and in the data section .word VALUE
+// and .zero COUNT
+static bool parse_directive(assembler_t *asm_state, const token_t *tokens, int token_count) {
+    const token_t *directive = &tokens[0];
     
-    // Remove comments and trim
-    remove_comments(working_line);
-    trim_string(working_line);
+    if (token_equals_nocase(directive, ".irq")) {
+        return parse_irq_directive(asm_state, tokens, token_count);
+    }
     
-    if (strlen(working_line) == 0) {
-        return true;  // Empty line is OK
+    if (token_equals_nocase(directive, ".global") || token_equals_nocase(directive, ".extern")) {
+        return parse_symbol_directive(asm_state, tokens, token_count, token_equals_nocase(directive, ".extern"));
     }
     
-    // Skip lines that start with # (full line comments)
-    if (working_line[0] == '#') {
+    if (token_equals_nocase(directive, ".data") || token_equals_nocase(directive, ".text")) {
+        if (token_count != 1) {
+            report_error(asm_state, tokens[1].line, tokens[1].column, "'%.*s' takes no arguments",
+                         (int)directive->length, directive->text);
+            return false;
+        }
+        asm_state->in_data_section = token_equals_nocase(directive, ".data");
         return true;
     }
     
-    // Check for section directives
-    if (strcasecmp(working_line, ".data") == 0) {
-        asm_state->in_data_section = true;
-        return true;
+    bool is_word = token_equals_nocase(directive, ".word");
+    bool is_zero = token_equals_nocase(directive, ".zero");
+    if (!is_word && !is_zero) {
+        report_error(asm_state, directive->line, directive->column, "Unknown directive '%.*s'",
+                     (int)directive->length, directive->text);
+        return false;
     }
     
-    if (strcasecmp(working_line, ".text") == 0) {
-        asm_state->in_data_section = false;
-        return true;
+    if (!asm_state->in_data_section) {
+        report_error(asm_state, directive->line, directive->column, "'%.*s' is only allowed in .data",
+                     (int)directive->length, directive->text);
+        return false;
     }
     
-    // Handle data directives
-    if (asm_state->in_data_section) {
-        return parse_data_directive(asm_state, working_line, ".word") ||
-               parse_data_directive(asm_state, working_line, ".zero");
+    if (token_count != 2) {
+        report_error(asm_state, directive->line, directive->column, is_word ? ".word expects a value" : ".zero expects a count");
+        return false;
     }
     
-    // Parse instruction
-    char tokens[MAX_TOKENS_PER_LINE][MAX_TOKEN_LENGTH];
+    long val;
+    if (!token_to_int(&tokens[1], &val) || (is_zero && val < 0)) {
+        report_error(asm_state, tokens[1].line, tokens[1].column,
+                     is_word ? ".word expects an integer" : ".zero expects a non-negative integer");
+        return false;
+    }
+    
+    long count = is_word ? 1 : val;
+    if (asm_state->data_size + count > MAX_DATA_MEMORY_SIZE) {
+        report_error(asm_state, directive->line, directive->column, "Data memory overflow");
+        return false;
+    }
+    
+    if (is_word) {
+        asm_state->data_image[asm_state->data_size++] = (int32_t)val;
+    } else {
+        for (long i = 0; i < count; i++) {
+            asm_state->data_image[asm_state->data_size++] = 0;
+        }
+    }
+    return true;
+}
+
+// Parse one statement, starting at first and consuming the rest of its line
+static bool parse_statement(assembler_t *asm_state, lexer_t *lex, const token_t *first,
+                            instruction_t *instr, bool *has_instruction, int32_t instruction_address) {
+    token_t tokens[3];
     int token_count = 0;
     
-    // Tokenize
-    char *token = strtok(working_line, " ,\t");
-    while (token && token_count < MAX_TOKENS_PER_LINE) {
-        strncpy(tokens[token_count], token, MAX_TOKEN_LENGTH - 1);
-        tokens[token_count][MAX_TOKEN_LENGTH - 1] = '\0';
-        
-        // Convert to uppercase for opcodes
-        if (token_count == 0) {
-            for (int i = 0; tokens[0][i]; i++) {
-                tokens[0][i] = toupper(tokens[0][i]);
-            }
+    *has_instruction = false;
+    
+    // Collect the mnemonic or directive and its operands
+    for (token_t tok = *first; tok.type != TOKEN_NEWLINE && tok.type != TOKEN_EOF; lexer_next(lex, &tok)) {
+        if (tok.type != TOKEN_WORD || token_count == 3) {
+            report_error(asm_state, tok.line, tok.column, "Unexpected '%.*s'", (int)tok.length, tok.text);
+            return false;
         }
-        
-        token_count++;
-        token = strtok(NULL, " ,\t");
+        tokens[token_count++] = tok;
     }
     
     if (token_count == 0) {
-        return true;  // Empty line
+        return true;  // Empty line is OK
     }
     
-    // Parse opcode
-    opcode_t opcode = string_to_opcode(tokens[0]);
-    if (opcode == OP_NOP && strcmp(tokens[0], "NOP") != 0) {
-        printf("Error: Unknown instruction '%s'\n", tokens[0]);
+    if (tokens[0].text[0] == '.') {
+        return parse_directive(asm_state, tokens, token_count);
+    }
+    
+    if (asm_state->in_data_section) {
+        report_error(asm_state, tokens[0].line, tokens[0].column, "Expected a data directive, got '%.*s'",
+                     (int)tokens[0].length, tokens[0].text);
+        return false;
+    }
+    
+    // Mnemonics are case-insensitive
+    char mnemonic[8];
+    size_t length = tokens[0].length;
+    opcode_t opcode;
+    bool known = length < sizeof(mnemonic);
+    if (known) {
+        for (size_t i = 0; i < length; i++) {
+            mnemonic[i] = (char)toupper((unsigned char)tokens[0].text[i]);
+        }
+        mnemonic[length] = '\0';
+        known = lookup_opcode(mnemonic, length, &opcode);
+    }
+    if (!known) {
+        report_error(asm_state, tokens[0].line, tokens[0].column, "Unknown instruction '%.*s'",
+                     (int)length, tokens[0].text);
+        return false;
+    }
+    
+    int expected = operand_count(opcode);
+    if (token_count - 1 != expected) {
+        report_error(asm_state, tokens[0].line, tokens[0].column, "'%s' expects %d argument%s",
+                     mnemonic, expected, expected == 1 ? "" : "s");
         return false;
     }
     
     instr->opcode = opcode;
-    instr->has_operand1 = false;
-    instr->has_operand2 = false;
+    instr->has_operand1 = expected >= 1;
+    instr->has_operand2 = expected >= 2;
     
-    // Parse operands based on instruction type
-    switch (opcode) {
-        case OP_NOP:
-        case OP_HLT:
-        case OP_IRET:
-        case OP_EI:
-        case OP_DI:
-            // No operands
-            break;
-            
-        case OP_TNOT:
-        case OP_NEG:
-        case OP_TSIGN:
-        case OP_TABS:
-        case OP_TSHL3:
-        case OP_TSHR3:
-        case OP_JMP:
-        case OP_IRQ:
-        case OP_TCLOSE:
-            // One operand
-            if (token_count < 2) {
-                printf("Error: '%s' expects 1 argument\n", tokens[0]);
-                return false;
-            }
-            parse_operand_with_labels(asm_state, tokens[1], &instr->operand1, instruction_address, 1);
-            instr->has_operand1 = true;
-            break;
-            
-        case OP_MOV:
-        case OP_ADD:
-        case OP_SUB:
-        case OP_MUL:
-        case OP_DIV:
-        case OP_TAND:
-        case OP_TOR:
-        case OP_TJZ:
-        case OP_TJN:
-        case OP_TJP:
-        case OP_TCMPR:
-        case OP_LD:
-        case OP_ST:
-        case OP_LEA:
-        case OP_TOPEN:
-        case OP_TREAD:
-        case OP_TWRITE:
-            // Two operands
-            if (token_count < 3) {
-                printf("Error: '%s' expects 2 arguments\n", tokens[0]);
-                return false;
-            }
-            parse_operand_with_labels(asm_state, tokens[1], &instr->operand1, instruction_address, 1);
-            parse_operand_with_labels(asm_state, tokens[2], &instr->operand2, instruction_address, 2);
-            instr->has_operand1 = true;
-            instr->has_operand2 = true;
-            break;
+    if (instr->has_operand1 &&
+        !parse_operand_token(asm_state, &tokens[1], &instr->operand1, instruction_address, 1)) {
+        return false;
+    }
+    if (instr->has_operand2 &&
+        !parse_operand_token(asm_state, &tokens[2], &instr->operand2, instruction_address, 2)) {
+        return false;
     }
     
     *has_instruction = true;
     return true;
 }
 
+bool parse_instruction_line(assembler_t *asm_state, const char *line, 
+                           instruction_t *instr, bool *has_instruction, int32_t instruction_address) {
+    lexer_t lex;
+    token_t first;
+    
+    lexer_init(&lex, line, strlen(line));
+    lexer_next(&lex, &first);
+    return parse_statement(asm_state, &lex, &first, instr, has_instruction, instruction_address);
+}
+
 bool resolve_labels(assembler_t *asm_state, instruction_t *program, int32_t program_size) {
     bool success = true;
     
-    // Resolve all unresolved label references
+    // Mark exported labels
+    for (int i = 0; i < asm_state->export_count; i++) {
+        const unresolved_ref_t *export = &asm_state->exports[i];
+        label_t *label = (label_t*)find_any_label(asm_state, export->label_name);
+        if (!label || label->is_extern) {
+            report_error(asm_state, export->line, export->column, "Exported label '%s' is not defined",
+                         export->label_name);
+            success = false;
+        } else {
+            label->is_global = true;
+        }
+    }
+    
+    // Resolve all unresolved label references. Each one is kept as a
+    // relocation so the linker can move this file's code and data.
     for (int i = 0; i < asm_state->unresolved_count; i++) {
         unresolved_ref_t *ref = &asm_state->unresolved_refs[i];
-        bool found = false;
         
         // Look for the label in our label table
-        for (int j = 0; j < asm_state->label_count; j++) {
-            if (strcmp(asm_state->labels[j].name, ref->label_name) == 0 && 
-                !asm_state->labels[j].is_data_label) {
-                // Found the label - resolve the address
-                if (ref->instruction_address >= 0 && ref->instruction_address < program_size) {
-                    instruction_t *instr = &program[ref->instruction_address];
-                    
-                    if (ref->operand_number == 1 && instr->has_operand1) {
-                        instr->operand1.value.address = asm_state->labels[j].address;
-                    } else if (ref->operand_number == 2 && instr->has_operand2) {
-                        instr->operand2.value.address = asm_state->labels[j].address;
-                    }
-                }
-                found = true;
-                break;
-            }
+        const label_t *label = find_any_label(asm_state, ref->label_name);
+        if (!label || (label->is_extern && !asm_state->relocatable)) {
+            report_error(asm_state, ref->line, ref->column, "Undefined label '%s'", ref->label_name);
+            success = false;
+            continue;
         }
         
-        if (!found) {
-            printf("Error: Undefined label '%s'\n", ref->label_name);
-            success = false;
+        reloc_kind_t kind = label->is_extern ? RELOC_EXTERN :
+                            label->is_data_label ? RELOC_DATA : RELOC_TEXT;
+        if (!add_relocation(asm_state, ref, kind)) return false;
+        
+        // Found the label - resolve the address (externals stay 0 until linked)
+        int32_t address = label->is_extern ? 0 : label->address;
+        if (ref->operand_number == 0) {
+            asm_state->irq_handlers[ref->instruction_address] = address;
+        } else if (ref->instruction_address >= 0 && ref->instruction_address < program_size) {
+            instruction_t *instr = &program[ref->instruction_address];
+            
+            if (ref->operand_number == 1 && instr->has_operand1) {
+                instr->operand1.value.address = address;
+            } else if (ref->operand_number == 2 && instr->has_operand2) {
+                instr->operand2.value.address = address;
+            }
         }
     }
     
     return success;
 }
 
-bool assembler_parse_file(assembler_t *asm_state, const char *filename, 
-                         instruction_t *program, int32_t *program_size) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        printf("Error: Cannot open file '%s'\n", filename);
-        return false;
-    }
-    
-    char line[MAX_LINE_LENGTH];
-    int line_num = 0;
+bool assembler_parse_source(assembler_t *asm_state, const char *source, size_t size,
+                            instruction_t *program, int32_t *program_size) {
+    lexer_t lex;
+    token_t tok;
     int address = 0;
-    int data_address = 0;
     
-    // First pass: collect labels and build program
-    while (fgets(line, sizeof(line), file) && address < MAX_MEMORY_SIZE) {
-        line_num++;
-        
-        // Make a copy for processing
-        char working_line[MAX_LINE_LENGTH];
-        strncpy(working_line, line, MAX_LINE_LENGTH - 1);
-        working_line[MAX_LINE_LENGTH - 1] = '\0';
-        
-        // Remove comments first
-        remove_comments(working_line);
-        trim_string(working_line);
-        
-        // Skip empty lines
-        if (strlen(working_line) == 0) {
-            continue;
-        }
-        
-        // Handle labels
-        char *colon = strchr(working_line, ':');
-        if (colon) {
-            *colon = '\0';
-            char label_name[MAX_LABEL_LENGTH];
-            strncpy(label_name, working_line, MAX_LABEL_LENGTH - 1);
-            label_name[MAX_LABEL_LENGTH - 1] = '\0';
-            trim_string(label_name);
+    lexer_init(&lex, source, size);
+    lexer_next(&lex, &tok);
+    
+    // First pass: collect labels and build program, one line at a time
+    while (tok.type != TOKEN_EOF) {
+        // Labels: NAME ':' before the statement, possibly several
+        for (;;) {
+            token_t next;
+            lexer_peek(&lex, &next);
+            if (tok.type != TOKEN_WORD || next.type != TOKEN_COLON) break;
             
-            if (strlen(label_name) > 0) {
-                if (!add_label(asm_state, label_name, 
-                              asm_state->in_data_section ? data_address : address, 
-                              asm_state->in_data_section)) {
-                    fclose(file);
-                    return false;
-                }
+            if (!add_label(asm_state, &tok,
+                           asm_state->in_data_section ? asm_state->data_size : address,
+                           asm_state->in_data_section)) {
+                return false;
             }
             
-            // Continue with the rest of the line after the colon
-            strcpy(working_line, colon + 1);
-            trim_string(working_line);
-        }
-        
-        // Skip if nothing left after label processing
-        if (strlen(working_line) == 0) {
-            continue;
+            lexer_next(&lex, &next);  // The colon
+            lexer_next(&lex, &tok);
         }
         
         instruction_t instr;
         bool has_instruction;
+        uint32_t line = tok.line;
+        uint32_t column = tok.column;
         
-        if (!parse_instruction_line(asm_state, working_line, &instr, &has_instruction, address)) {
-            printf("Error on line %d\n", line_num);
-            fclose(file);
+        if (!parse_statement(asm_state, &lex, &tok, &instr, &has_instruction, address)) {
             return false;
         }
         
-        if (has_instruction && !asm_state->in_data_section) {
+        if (has_instruction) {
+            if (address == MAX_MEMORY_SIZE) {
+                report_error(asm_state, line, column, "Program has more than %d instructions", MAX_MEMORY_SIZE);
+                return false;
+            }
             program[address] = instr;
             address++;
-        } else if (asm_state->in_data_section) {
-            data_address = asm_state->data_size;
         }
+        
+        lexer_next(&lex, &tok);
     }
     
-    fclose(file);
-    
     *program_size = address;
     
     // Second pass: resolve labels
     return resolve_labels(asm_state, program, *program_size);
 }
+
+bool assembler_parse_file(assembler_t *asm_state, const char *filename, 
+                         instruction_t *program, int32_t *program_size) {
+    mapped_file_t source;
+    if (!mapfile_open(&source, filename)) {
+        ternuino_log(TERNUINO_LOG_ERROR, "Error: Cannot open file '%s'", filename);
+        return false;
+    }
+    
+    // Tokens point straight into the mapping, so it stays open until the
+    // labels are resolved
+    bool ok = assembler_parse_source(asm_state, (const char*)source.data, source.size,
+                                     program, program_size);
+    
+    mapfile_close(&source);
+    return ok;
+}
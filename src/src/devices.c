@@ -1,13 +1,18 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "devices.h"
 #include "ternuino.h"
 #include "ternio.h"
+#include "runtime.h"
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 
 #ifdef _WIN32
+#include <windows.h>
 #include <conio.h>
 #else
+#include <time.h>
 #include <termios.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -27,40 +32,68 @@ void device_init(device_t *dev, device_type_t type, uint8_t device_id, uint8_t i
     dev->write = NULL;
     dev->open = NULL;
     dev->close = NULL;
+    dev->seek = NULL;
     dev->tick = NULL;
+    dev->destroy = NULL;
+    dev->read_block = NULL;
+    dev->write_block = NULL;
+    dev->deadline = DEVICE_NO_DEADLINE;
+    dev->timeout = NULL;
+    dev->cpu = NULL;
+    dev->handle = 0;
+    dev->deferred = false;
+    dev->sync = NULL;
+    dev->input_ready = NULL;
+}
+
+// Device data starts at this alignment after the device_t
+#define DEVICE_DATA_ALIGN 16
+
+// Allocate a device together with data_size bytes of zeroed device data,
+// so each device is a single allocation. Release it with device_destroy.
+device_t* device_create(device_type_t type, uint8_t device_id, uint8_t irq_vector, size_t data_size) {
+    size_t offset = (sizeof(device_t) + DEVICE_DATA_ALIGN - 1) & ~(size_t)(DEVICE_DATA_ALIGN - 1);
+    device_t *dev = ternuino_calloc(1, offset + data_size);
+    if (!dev) return NULL;
+    
+    device_init(dev, type, device_id, irq_vector);
+    if (data_size > 0) {
+        dev->device_data = (uint8_t *)dev + offset;
+    }
+    return dev;
 }
 
+// Close the device and release what it holds. The device data is part of
+// the device's allocation and goes with device_destroy.
 void device_cleanup(device_t *dev) {
     if (dev->close) {
         dev->close(dev);
     }
-    if (dev->device_data) {
-        free(dev->device_data);
-        dev->device_data = NULL;
+    if (dev->destroy) {
+        dev->destroy(dev);
     }
+    dev->device_data = NULL;
+}
+
+void device_destroy(device_t *dev) {
+    if (!dev) return;
+    
+    device_cleanup(dev);
+    ternuino_free(dev);
 }
 
 // Terminal device implementation
 device_t* terminal_device_create(uint8_t device_id, uint8_t irq_vector) {
-    device_t *dev = malloc(sizeof(device_t));
+    device_t *dev = device_create(DEVICE_TERMINAL, device_id, irq_vector, sizeof(terminal_data_t));
     if (!dev) return NULL;
     
-    device_init(dev, DEVICE_TERMINAL, device_id, irq_vector);
-    
-    terminal_data_t *tdata = malloc(sizeof(terminal_data_t));
-    if (!tdata) {
-        free(dev);
-        return NULL;
-    }
-    
     // Initialize terminal data
-    memset(tdata->input_buffer, 0, sizeof(tdata->input_buffer));
+    terminal_data_t *tdata = dev->device_data;
     tdata->input_pos = 0;
     tdata->input_len = 0;
     tdata->input_ready = false;
     tdata->echo_enabled = true;
     
-    dev->device_data = tdata;
     dev->read = terminal_read;
     dev->write = terminal_write;
     dev->open = terminal_open;
@@ -193,103 +226,392 @@ void terminal_tick(device_t *dev, struct ternuino_s *cpu) {
 
 // File device implementation
 device_t* file_device_create(uint8_t device_id, uint8_t irq_vector) {
-    device_t *dev = malloc(sizeof(device_t));
+    device_t *dev = device_create(DEVICE_FILE, device_id, irq_vector, sizeof(file_data_t));
     if (!dev) return NULL;
     
-    device_init(dev, DEVICE_FILE, device_id, irq_vector);
-    
-    file_data_t *fdata = malloc(sizeof(file_data_t));
-    if (!fdata) {
-        free(dev);
-        return NULL;
-    }
-    
     // Initialize file data
-    fdata->file = NULL;
-    memset(fdata->filename, 0, sizeof(fdata->filename));
-    fdata->is_open = false;
-    fdata->is_write_mode = false;
+    file_data_t *fdata = dev->device_data;
+    for (int i = 0; i < FILE_MAX_HANDLES; i++) {
+        fdata->handles[i].bound_mode = FILE_MODE_ANY;
+    }
     
-    dev->device_data = fdata;
     dev->read = file_read;
     dev->write = file_write;
     dev->open = file_open;
     dev->close = file_close;
+    dev->seek = file_seek;
+    dev->read_block = file_read_block;
+    dev->write_block = file_write_block;
     dev->tick = file_tick;
+    dev->input_ready = file_input_ready;
+    dev->destroy = file_destroy;
     
     return dev;
 }
 
-int32_t file_read(device_t *dev, int32_t *value) {
-    if (!dev || !dev->device_data || !value) return -1;
+// Bind a handle to a host path, optionally fixing its open mode
+bool file_device_bind(device_t *dev, int32_t handle, const char *path, file_mode_t mode) {
+    if (!dev || !dev->device_data || !path) return false;
+    if (handle < 0 || handle >= FILE_MAX_HANDLES) return false;
     
     file_data_t *fdata = (file_data_t*)dev->device_data;
+    file_handle_t *fh = &fdata->handles[handle];
     
-    if (!fdata->is_open || fdata->is_write_mode || !fdata->file) {
-        return -1;
-    }
+    if (strlen(path) >= sizeof(fh->filename)) return false;
     
-    return t3_read_value(fdata->file, value) ? 0 : -1;
+    strcpy(fh->filename, path);
+    fh->bound_mode = mode;
+    return true;
 }
 
-int32_t file_write(device_t *dev, int32_t value) {
-    if (!dev || !dev->device_data) return -1;
+void file_device_set_buffer(device_t *dev, size_t buffer_size) {
+    if (!dev || !dev->device_data) return;
+    
+    file_data_t *fdata = (file_data_t*)dev->device_data;
+    fdata->buffer_size = buffer_size;
+}
+
+void file_device_set_async(device_t *dev, bool async, bool nonblocking) {
+    if (!dev || !dev->device_data) return;
     
     file_data_t *fdata = (file_data_t*)dev->device_data;
+    fdata->async = async;
+    fdata->nonblocking = async && nonblocking;
+}
+
+// Handle selected by the current channel, NULL if out of range
+static file_handle_t* file_current_handle(device_t *dev) {
+    if (!dev || !dev->device_data) return NULL;
+    if (dev->handle < 0 || dev->handle >= FILE_MAX_HANDLES) return NULL;
+    
+    file_data_t *fdata = (file_data_t*)dev->device_data;
+    return &fdata->handles[dev->handle];
+}
+
+int32_t file_read(device_t *dev, int32_t *value) {
+    return file_read_block(dev, value, 1) == 1 ? 0 : -1;
+}
+
+int32_t file_write(device_t *dev, int32_t value) {
+    return file_write_block(dev, &value, 1) == 1 ? 0 : -1;
+}
+
+// Account for an asynchronous transfer: a helper that is not ready yet
+// leaves the device busy until file_tick sees it finish
+static int32_t file_async_result(device_t *dev, int32_t n, int32_t count) {
+    if (n == 0 && count > 0) {
+        dev->status |= DEVICE_BUSY;
+        return -1;
+    }
+    dev->status &= ~DEVICE_IRQ_PENDING;
+    return n;
+}
+
+int32_t file_read_block(device_t *dev, int32_t *values, int32_t count) {
+    file_handle_t *fh = file_current_handle(dev);
+    if (!fh || !values || count < 0) return -1;
     
-    if (!fdata->is_open || !fdata->is_write_mode || !fdata->file) {
+    if (!fh->is_open || fh->is_write_mode) {
         return -1;
     }
     
-    return t3_write_value(fdata->file, value) ? 0 : -1;
+    if (fh->async) {
+        file_data_t *fdata = (file_data_t*)dev->device_data;
+        int32_t n = t3_async_read(fh->async, values, (size_t)count, !fdata->nonblocking);
+        if (n < 0) {
+            dev->status |= DEVICE_EOF;
+        }
+        return file_async_result(dev, n, count);
+    }
+    
+    size_t n = t3_reader_read(&fh->reader, values, (size_t)count);
+    if (n == 0 && count > 0) {
+        dev->status |= DEVICE_EOF;
+        return -1;
+    }
+    return (int32_t)n;
+}
+
+int32_t file_write_block(device_t *dev, const int32_t *values, int32_t count) {
+    file_handle_t *fh = file_current_handle(dev);
+    if (!fh || !values || count < 0) return -1;
+    
+    if (!fh->is_open || !fh->is_write_mode) {
+        return -1;
+    }
+    
+    if (fh->async) {
+        file_data_t *fdata = (file_data_t*)dev->device_data;
+        int32_t n = t3_async_write(fh->async, values, (size_t)count, !fdata->nonblocking);
+        return file_async_result(dev, n, count);
+    }
+    
+    return t3_writer_put_values(&fh->writer, values, (size_t)count) ? count : -1;
 }
 
 int32_t file_open(device_t *dev, int32_t mode) {
-    if (!dev || !dev->device_data) return -1;
+    file_handle_t *fh = file_current_handle(dev);
+    if (!fh) return -1;
     
     file_data_t *fdata = (file_data_t*)dev->device_data;
     
     // Close existing file if open
-    if (fdata->is_open && fdata->file) {
-        fclose(fdata->file);
-        fdata->file = NULL;
-        fdata->is_open = false;
+    if (fh->is_open) {
+        file_close(dev);
+    }
+    
+    bool write_mode = (mode != 0);
+    if (fh->bound_mode != FILE_MODE_ANY && write_mode != (fh->bound_mode == FILE_MODE_WRITE)) {
+        return -1; // The host only allows the other direction
+    }
+    
+    // Unbound handles use a name based on device ID and handle
+    char default_name[64];
+    const char *filename = fh->filename;
+    if (filename[0] == '\0') {
+        if (dev->handle == 0) {
+            snprintf(default_name, sizeof(default_name), "ternary_%d.t3", dev->device_id);
+        } else {
+            snprintf(default_name, sizeof(default_name), "ternary_%d_%d.t3", dev->device_id, dev->handle);
+        }
+        filename = default_name;
     }
     
-    // Generate filename based on device ID
-    snprintf(fdata->filename, sizeof(fdata->filename), "ternary_%d.t3", dev->device_id);
+    fh->is_write_mode = write_mode;
+    dev->status &= ~(DEVICE_EOF | DEVICE_BUSY);
     
-    const char* file_mode = (mode == 0) ? "rb" : "wb";
-    fdata->file = fopen(fdata->filename, file_mode);
-    fdata->is_open = (fdata->file != NULL);
-    fdata->is_write_mode = (mode != 0);
+    if (fh->is_write_mode) {
+        // Header is finalized with the value count and index on close
+        fh->is_open = t3_writer_open_buffered(&fh->writer, filename, T3_DEFAULT_INDEX_STRIDE,
+                                              fdata->buffer_size);
+    } else {
+        // Reads are served from a mapping of the whole file
+        fh->is_open = t3_reader_open(&fh->reader, filename);
+    }
     
-    // If writing, create header
-    if (fdata->is_open && fdata->is_write_mode) {
-        t3_write_header(fdata->file, 0);
+    // Hand the file to a helper thread; without one, I/O stays synchronous
+    if (fh->is_open && fdata->async) {
+        fh->async = ternuino_alloc(sizeof(t3_async_t));
+        bool started = fh->async &&
+                       (fh->is_write_mode ? t3_async_start_write(fh->async, &fh->writer, &fdata->events)
+                                          : t3_async_start_read(fh->async, &fh->reader, &fdata->events));
+        if (!started) {
+            ternuino_free(fh->async);
+            fh->async = NULL;
+        }
+        dev->irq_enabled = fdata->nonblocking;
     }
     
-    return fdata->is_open ? 0 : -1;
+    return fh->is_open ? 0 : -1;
 }
 
 int32_t file_close(device_t *dev) {
-    if (!dev || !dev->device_data) return -1;
+    file_handle_t *fh = file_current_handle(dev);
+    if (!fh) return -1;
     
-    file_data_t *fdata = (file_data_t*)dev->device_data;
+    if (!fh->is_open) {
+        return -1;
+    }
     
-    if (fdata->is_open && fdata->file) {
-        fclose(fdata->file);
-        fdata->file = NULL;
-        fdata->is_open = false;
-        fdata->filename[0] = '\0';
-        return 0;
+    bool success = true;
+    if (fh->async) {
+        success = t3_async_stop(fh->async);
+        ternuino_free(fh->async);
+        fh->async = NULL;
+    }
+    
+    if (fh->is_write_mode) {
+        success = t3_writer_finish(&fh->writer) && success;
+    } else {
+        t3_reader_close(&fh->reader);
+    }
+    
+    fh->is_open = false;
+    return success ? 0 : -1;
+}
+
+int32_t file_seek(device_t *dev, int32_t index) {
+    file_handle_t *fh = file_current_handle(dev);
+    if (!fh || index < 0) return -1;
+    
+    // Only files opened for reading are seekable
+    if (!fh->is_open || fh->is_write_mode) {
+        return -1;
+    }
+    
+    dev->status &= ~DEVICE_EOF;
+    
+    if (fh->async) {
+        return t3_async_seek(fh->async, (uint32_t)index) ? 0 : -1;
     }
     
-    return -1;
+    return t3_reader_seek(&fh->reader, (uint32_t)index) ? 0 : -1;
+}
+
+// Close every handle still open, finishing written files
+void file_destroy(device_t *dev) {
+    if (!dev || !dev->device_data) return;
+    
+    for (int32_t h = 0; h < FILE_MAX_HANDLES; h++) {
+        dev->handle = h;
+        file_close(dev);
+    }
+    dev->handle = 0;
 }
 
 void file_tick(device_t *dev, struct ternuino_s *cpu) {
-    // File devices don't need regular ticking
-    (void)dev;
     (void)cpu;
+    if (!dev || !dev->device_data) return;
+    
+    file_data_t *fdata = (file_data_t*)dev->device_data;
+    
+    // A helper finished a buffer: a busy transfer can be retried now
+    uint32_t events = __atomic_load_n(&fdata->events, __ATOMIC_ACQUIRE);
+    if (events != fdata->events_seen) {
+        fdata->events_seen = events;
+        if (dev->status & DEVICE_BUSY) {
+            dev->status &= ~DEVICE_BUSY;
+            if (dev->irq_enabled) {
+                dev->status |= DEVICE_IRQ_PENDING;
+            }
+        }
+    }
+}
+
+// A busy transfer waits for a helper; the helpers have no descriptor
+bool file_input_ready(device_t *dev, int *wait_fd) {
+    *wait_fd = -1;
+    if (!dev || !dev->device_data) return true;
+    
+    file_data_t *fdata = (file_data_t*)dev->device_data;
+    return __atomic_load_n(&fdata->events, __ATOMIC_ACQUIRE) != fdata->events_seen;
+}
+
+// Timer device implementation
+device_t* timer_device_create(uint8_t device_id, uint8_t irq_vector, bool host_clock) {
+    device_t *dev = device_create(DEVICE_TIMER, device_id, irq_vector, sizeof(timer_data_t));
+    if (!dev) return NULL;
+    
+    // Initialize timer data
+    timer_data_t *tdata = dev->device_data;
+    tdata->mode = TIMER_MODE_ONESHOT;
+    tdata->host_clock = host_clock;
+    tdata->armed = false;
+    tdata->period = 0;
+    tdata->compare = 0;
+    
+    // No tick callback: the CPU only calls back when the deadline is reached
+    dev->read = timer_read;
+    dev->write = timer_write;
+    dev->open = timer_open;
+    dev->close = timer_close;
+    dev->timeout = timer_timeout;
+    
+    return dev;
+}
+
+// Current time in the timer's unit
+static uint64_t timer_now(device_t *dev, timer_data_t *tdata) {
+    if (!tdata->host_clock) {
+        return dev->cpu ? dev->cpu->cycles : 0;
+    }
+    
+#ifdef _WIN32
+    return (uint64_t)GetTickCount64() * 1000;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+#endif
+}
+
+// Schedule the next callback: at the compare value in virtual time, or at
+// the next clock check in host-clock mode
+static void timer_schedule(device_t *dev, timer_data_t *tdata) {
+    if (!dev->cpu) return;
+    
+    if (!tdata->armed) {
+        ternuino_schedule(dev->cpu, dev, DEVICE_NO_DEADLINE);
+    } else if (tdata->host_clock) {
+        ternuino_schedule(dev->cpu, dev, dev->cpu->cycles + TIMER_HOST_POLL_CYCLES);
+    } else {
+        ternuino_schedule(dev->cpu, dev, tdata->compare);
+    }
+}
+
+// Reading returns the low 31 bits of the current time and acknowledges
+// a pending timer interrupt
+int32_t timer_read(device_t *dev, int32_t *value) {
+    if (!dev || !dev->device_data || !value) return -1;
+    
+    timer_data_t *tdata = (timer_data_t*)dev->device_data;
+    
+    *value = (int32_t)(timer_now(dev, tdata) & 0x7FFFFFFF);
+    dev->status &= ~DEVICE_IRQ_PENDING;
+    return 0;
+}
+
+// Writing arms the timer to expire after value cycles (or microseconds);
+// 0 or a negative value stops it
+int32_t timer_write(device_t *dev, int32_t value) {
+    if (!dev || !dev->device_data) return -1;
+    
+    timer_data_t *tdata = (timer_data_t*)dev->device_data;
+    
+    tdata->armed = (value > 0);
+    tdata->period = tdata->armed ? (uint64_t)value : 0;
+    tdata->compare = timer_now(dev, tdata) + tdata->period;
+    
+    timer_schedule(dev, tdata);
+    return 0;
+}
+
+int32_t timer_open(device_t *dev, int32_t mode) {
+    if (!dev || !dev->device_data) return -1;
+    if (mode != TIMER_MODE_ONESHOT && mode != TIMER_MODE_PERIODIC) return -1;
+    
+    timer_data_t *tdata = (timer_data_t*)dev->device_data;
+    
+    tdata->mode = (timer_mode_t)mode;
+    dev->irq_enabled = true;
+    dev->status = DEVICE_READY;
+    return 0;
+}
+
+int32_t timer_close(device_t *dev) {
+    if (!dev || !dev->device_data) return -1;
+    
+    timer_data_t *tdata = (timer_data_t*)dev->device_data;
+    
+    tdata->armed = false;
+    timer_schedule(dev, tdata);
+    dev->irq_enabled = false;
+    return 0;
+}
+
+void timer_timeout(device_t *dev, struct ternuino_s *cpu) {
+    (void)cpu;
+    if (!dev || !dev->device_data) return;
+    
+    timer_data_t *tdata = (timer_data_t*)dev->device_data;
+    if (!tdata->armed) return;
+    
+    uint64_t now = timer_now(dev, tdata);
+    if (now >= tdata->compare) {
+        if (dev->irq_enabled) {
+            dev->status |= DEVICE_IRQ_PENDING;
+        }
+        
+        if (tdata->mode == TIMER_MODE_PERIODIC) {
+            // Skip periods that were missed entirely instead of firing a burst
+            tdata->compare += tdata->period;
+            if (tdata->compare <= now) {
+                tdata->compare = now + tdata->period;
+            }
+        } else {
+            tdata->armed = false;
+        }
+    }
+    
+    timer_schedule(dev, tdata);
 }
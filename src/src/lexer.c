@@ -0,0 +1,133 @@
+#include "lexer.h"
+#include <limits.h>
+#include <string.h>
+#include <ctype.h>
+
+// Character classes for the scanner
+enum {
+    CH_WORD = 0,
+    CH_SPACE,       // Blank or comma
+    CH_COMMENT,
+    CH_COLON,
+    CH_NEWLINE
+};
+
+static const uint8_t char_class[256] = {
+    [' '] = CH_SPACE, ['\t'] = CH_SPACE, ['\r'] = CH_SPACE,
+    ['\v'] = CH_SPACE, ['\f'] = CH_SPACE, [','] = CH_SPACE,
+    ['#'] = CH_COMMENT, [';'] = CH_COMMENT,
+    [':'] = CH_COLON,
+    ['\n'] = CH_NEWLINE
+};
+
+void lexer_init(lexer_t *lex, const char *source, size_t size) {
+    lex->pos = source;
+    lex->end = source + size;
+    lex->line_start = source;
+    lex->line = 1;
+}
+
+void lexer_next(lexer_t *lex, token_t *token) {
+    const char *p = lex->pos;
+    const char *end = lex->end;
+
+    // Skip separators and comments
+    while (p < end) {
+        uint8_t cls = char_class[(uint8_t)*p];
+        if (cls == CH_SPACE) {
+            p++;
+        } else if (cls == CH_COMMENT) {
+            const char *nl = memchr(p, '\n', (size_t)(end - p));
+            p = nl ? nl : end;
+        } else {
+            break;
+        }
+    }
+
+    token->text = p;
+    token->line = lex->line;
+    token->column = (uint32_t)(p - lex->line_start) + 1;
+
+    if (p == end) {
+        token->type = TOKEN_EOF;
+        token->length = 0;
+        lex->pos = p;
+        return;
+    }
+
+    switch (char_class[(uint8_t)*p]) {
+        case CH_NEWLINE:
+            token->type = TOKEN_NEWLINE;
+            token->length = 1;
+            p++;
+            lex->line++;
+            lex->line_start = p;
+            break;
+
+        case CH_COLON:
+            token->type = TOKEN_COLON;
+            token->length = 1;
+            p++;
+            break;
+
+        default: {
+            const char *start = p;
+            while (p < end && char_class[(uint8_t)*p] == CH_WORD) p++;
+            token->type = TOKEN_WORD;
+            token->length = (size_t)(p - start);
+            break;
+        }
+    }
+
+    lex->pos = p;
+}
+
+void lexer_peek(const lexer_t *lex, token_t *token) {
+    lexer_t copy = *lex;
+    lexer_next(&copy, token);
+}
+
+bool token_equals(const token_t *token, const char *text) {
+    return strlen(text) == token->length && memcmp(token->text, text, token->length) == 0;
+}
+
+bool token_equals_nocase(const token_t *token, const char *text) {
+    if (strlen(text) != token->length) return false;
+
+    for (size_t i = 0; i < token->length; i++) {
+        if (toupper((unsigned char)token->text[i]) != toupper((unsigned char)text[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Decimal integer with optional sign; the whole token must be consumed.
+// Out-of-range values saturate like strtol.
+bool token_to_int(const token_t *token, long *value) {
+    const char *p = token->text;
+    const char *end = p + token->length;
+    bool negative = false;
+
+    if (p < end && (*p == '+' || *p == '-')) {
+        negative = (*p == '-');
+        p++;
+    }
+    if (p == end) return false;
+
+    unsigned long limit = negative ? (unsigned long)LONG_MAX + 1 : (unsigned long)LONG_MAX;
+    unsigned long result = 0;
+    for (; p < end; p++) {
+        if (*p < '0' || *p > '9') return false;
+
+        unsigned digit = (unsigned)(*p - '0');
+        if (result > (limit - digit) / 10) {
+            result = limit;
+        } else {
+            result = result * 10 + digit;
+        }
+    }
+
+    *value = negative ? (long)(0 - result) : (long)result;
+    return true;
+}
@@ -0,0 +1,264 @@
+#include "libternuino.h"
+#include "assembler.h"
+#include "tbo.h"
+#include <string.h>
+
+struct ternuino_vm_s {
+    ternuino_t cpu;                             // Its image is what reset reinstalls
+    int32_t device_handlers[MAX_IRQ_VECTORS];   // From ternuino_vm_add_device
+};
+
+static void program_clear(ternuino_program_t *program) {
+    memset(program, 0, sizeof(*program));
+    for (int i = 0; i < MAX_IRQ_VECTORS; i++) {
+        program->irq_handlers[i] = -1;
+    }
+}
+
+static void program_from_assembler(ternuino_program_t *program, const assembler_t *assembler,
+                                   const instruction_t *code, int32_t code_size) {
+    program_clear(program);
+    memcpy(program->code, code, sizeof(instruction_t) * (size_t)code_size);
+    program->code_size = code_size;
+    memcpy(program->data, assembler->data_image, sizeof(int32_t) * (size_t)assembler->data_size);
+    program->data_size = assembler->data_size;
+    memcpy(program->irq_handlers, assembler->irq_handlers, sizeof(program->irq_handlers));
+}
+
+bool ternuino_program_assemble(ternuino_program_t *program, const char *source, size_t size,
+                               const char *name) {
+    assembler_t assembler;
+    assembler_init(&assembler);
+    assembler.source_name = name;
+
+    instruction_t code[MAX_MEMORY_SIZE];
+    int32_t code_size = 0;
+    bool success = assembler_parse_source(&assembler, source, size, code, &code_size);
+    if (success) {
+        program_from_assembler(program, &assembler, code, code_size);
+    }
+
+    assembler_free(&assembler);
+    return success;
+}
+
+bool ternuino_program_assemble_file(ternuino_program_t *program, const char *path) {
+    assembler_t assembler;
+    assembler_init(&assembler);
+
+    instruction_t code[MAX_MEMORY_SIZE];
+    int32_t code_size = 0;
+    bool success = assembler_parse_file(&assembler, path, code, &code_size);
+    if (success) {
+        program_from_assembler(program, &assembler, code, code_size);
+    }
+
+    assembler_free(&assembler);
+    return success;
+}
+
+// Unpack an open image and close it
+static bool program_from_image(ternuino_program_t *program, tbo_image_t *image, const char *name) {
+    if (image->header->flags & TBO_IMAGE_OBJECT) {
+        ternuino_log(TERNUINO_LOG_ERROR, "Error: '%s' is an object file; link it first.", name);
+        tbo_close(image);
+        return false;
+    }
+
+    program_clear(program);
+    program->code_size = tbo_unpack_program(image, program->code);
+    program->data_size = (int32_t)image->header->data_count;
+    memcpy(program->data, image->data, sizeof(int32_t) * (size_t)program->data_size);
+    memcpy(program->irq_handlers, image->header->irq_handlers, sizeof(program->irq_handlers));
+    tbo_close(image);
+    return true;
+}
+
+bool ternuino_program_load_image(ternuino_program_t *program, const char *path) {
+    tbo_image_t image;
+    if (!tbo_open(&image, path)) {
+        ternuino_log(TERNUINO_LOG_ERROR, "Error: '%s' is not a valid program image.", path);
+        return false;
+    }
+    return program_from_image(program, &image, path);
+}
+
+bool ternuino_program_load_image_memory(ternuino_program_t *program, const void *data, size_t size) {
+    tbo_image_t image;
+    if (!tbo_open_memory(&image, data, size)) {
+        ternuino_log(TERNUINO_LOG_ERROR, "Error: Not a valid program image.");
+        return false;
+    }
+    return program_from_image(program, &image, "image");
+}
+
+ternuino_vm_t* ternuino_vm_create(void) {
+    ternuino_vm_t *vm = ternuino_alloc(sizeof(ternuino_vm_t));
+    if (!vm) {
+        ternuino_log(TERNUINO_LOG_ERROR, "Error: Out of memory for a machine");
+        return NULL;
+    }
+
+    ternuino_init(&vm->cpu, MAX_DATA_MEMORY_SIZE);
+    for (int i = 0; i < MAX_IRQ_VECTORS; i++) {
+        vm->device_handlers[i] = -1;
+    }
+    vm->cpu.running = false; // Nothing to run until a program is loaded
+    return vm;
+}
+
+void ternuino_vm_destroy(ternuino_vm_t *vm) {
+    if (!vm) return;
+
+    for (int i = 0; i < vm->cpu.device_count; i++) {
+        if (vm->cpu.devices[i]) {
+            device_destroy(vm->cpu.devices[i]);
+            vm->cpu.devices[i] = NULL; // Closing later devices may still scan the table
+        }
+    }
+    ternuino_unload(&vm->cpu);
+    ternuino_free(vm);
+}
+
+void ternuino_vm_reset(ternuino_vm_t *vm) {
+    ternuino_t *cpu = &vm->cpu;
+    ternuino_image_t *image = cpu->image;
+    ternuino_reset(cpu);
+    if (!image) {
+        cpu->running = false;
+        return;
+    }
+
+    ternuino_load_image(cpu, image, true);
+    for (int i = 0; i < MAX_IRQ_VECTORS; i++) {
+        // ternuino_reset keeps the vector table, so the previous program's
+        // handlers would otherwise survive into this run
+        cpu->irq_table[i].handler_address = 0;
+        cpu->irq_table[i].enabled = false;
+
+        int32_t handler = image->irq_handlers[i] >= 0 ? image->irq_handlers[i] : vm->device_handlers[i];
+        if (handler >= 0) {
+            ternuino_set_irq_handler(cpu, i, handler);
+        }
+    }
+    cpu->running = image->code_size > 0;
+}
+
+ternuino_image_t* ternuino_program_share(const ternuino_program_t *program) {
+    ternuino_image_t *image = ternuino_image_create(program->code, program->code_size,
+                                                    program->data, program->data_size);
+    if (!image) {
+        ternuino_log(TERNUINO_LOG_ERROR, "Error: Out of memory for a program image");
+        return NULL;
+    }
+    memcpy(image->irq_handlers, program->irq_handlers, sizeof(image->irq_handlers));
+    return image;
+}
+
+void ternuino_vm_load_shared(ternuino_vm_t *vm, ternuino_image_t *image) {
+    ternuino_load_image(&vm->cpu, image, false);
+    ternuino_vm_reset(vm);
+}
+
+void ternuino_vm_load_program(ternuino_vm_t *vm, const ternuino_program_t *program) {
+    ternuino_image_t *image = ternuino_program_share(program);
+    if (image) {
+        ternuino_vm_load_shared(vm, image);
+        ternuino_image_release(image); // The machine holds the only reference
+    }
+}
+
+// Loads assemble into the machine's own program only once they succeed,
+// so a failed load leaves the previous program in place
+bool ternuino_vm_load_source(ternuino_vm_t *vm, const char *source, size_t size, const char *name) {
+    ternuino_program_t *program = ternuino_alloc(sizeof(ternuino_program_t));
+    bool success = program && ternuino_program_assemble(program, source, size, name);
+    if (success) {
+        ternuino_vm_load_program(vm, program);
+    }
+    ternuino_free(program);
+    return success;
+}
+
+bool ternuino_vm_load_file(ternuino_vm_t *vm, const char *path) {
+    ternuino_program_t *program = ternuino_alloc(sizeof(ternuino_program_t));
+    bool success = program && ternuino_program_assemble_file(program, path);
+    if (success) {
+        ternuino_vm_load_program(vm, program);
+    }
+    ternuino_free(program);
+    return success;
+}
+
+bool ternuino_vm_load_image(ternuino_vm_t *vm, const char *path) {
+    ternuino_program_t *program = ternuino_alloc(sizeof(ternuino_program_t));
+    bool success = program && ternuino_program_load_image(program, path);
+    if (success) {
+        ternuino_vm_load_program(vm, program);
+    }
+    ternuino_free(program);
+    return success;
+}
+
+stop_reason_t ternuino_vm_run(ternuino_vm_t *vm, uint64_t max_cycles, engine_t engine) {
+    return ternuino_run_for(&vm->cpu, max_cycles, engine);
+}
+
+int32_t ternuino_vm_get_register(const ternuino_vm_t *vm, ternuino_register_t reg) {
+    return (reg >= REG_A && reg <= REG_C) ? vm->cpu.registers[reg] : 0;
+}
+
+void ternuino_vm_set_register(ternuino_vm_t *vm, ternuino_register_t reg, int32_t value) {
+    if (reg >= REG_A && reg <= REG_C) {
+        vm->cpu.registers[reg] = value;
+    }
+}
+
+int32_t ternuino_vm_get_pc(const ternuino_vm_t *vm) {
+    return vm->cpu.pc;
+}
+
+void ternuino_vm_set_pc(ternuino_vm_t *vm, int32_t pc) {
+    vm->cpu.pc = pc;
+}
+
+uint64_t ternuino_vm_cycles(const ternuino_vm_t *vm) {
+    return vm->cpu.cycles;
+}
+
+static bool data_range_valid(const ternuino_vm_t *vm, int32_t address, int32_t count) {
+    return address >= 0 && count >= 0 && address <= vm->cpu.dmem_size - count;
+}
+
+bool ternuino_vm_read_data(const ternuino_vm_t *vm, int32_t address, int32_t *values, int32_t count) {
+    if (!data_range_valid(vm, address, count)) return false;
+
+    memcpy(values, &vm->cpu.data_mem[address], sizeof(int32_t) * (size_t)count);
+    return true;
+}
+
+bool ternuino_vm_write_data(ternuino_vm_t *vm, int32_t address, const int32_t *values, int32_t count) {
+    if (!data_range_valid(vm, address, count)) return false;
+
+    memcpy(&vm->cpu.data_mem[address], values, sizeof(int32_t) * (size_t)count);
+    return true;
+}
+
+ternuino_t* ternuino_vm_cpu(ternuino_vm_t *vm) {
+    return &vm->cpu;
+}
+
+bool ternuino_vm_add_device(ternuino_vm_t *vm, device_t *device, int32_t handler_address) {
+    if (!device || device->irq_vector >= MAX_IRQ_VECTORS) return false;
+    if (ternuino_register_device(&vm->cpu, device) < 0) {
+        ternuino_log(TERNUINO_LOG_ERROR, "Error: Cannot add device %d", device->device_id);
+        return false;
+    }
+
+    vm->device_handlers[device->irq_vector] = handler_address;
+    const ternuino_image_t *image = vm->cpu.image;
+    if (handler_address >= 0 && (!image || image->irq_handlers[device->irq_vector] < 0)) {
+        ternuino_set_irq_handler(&vm->cpu, device->irq_vector, handler_address);
+    }
+    return true;
+}
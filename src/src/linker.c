@@ -0,0 +1,317 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "linker.h"
+#include "tbo.h"
+#include "runtime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// One source of a build and its outcome
+typedef struct {
+    const char *source;
+    char *object;
+    bool success;
+    bool up_to_date;
+    int32_t instructions;
+    int32_t data_cells;
+} build_unit_t;
+
+typedef struct {
+    build_unit_t *units;
+    int count;
+    int next;               // Next unit to claim, shared by the workers
+} build_queue_t;
+
+// prog.asm -> prog.tobj, any other name gets the extension appended
+static char* object_path(const char *source) {
+    size_t len = strlen(source);
+    if (len > 4 && strcmp(source + len - 4, ".asm") == 0) len -= 4;
+
+    char *path = ternuino_alloc(len + sizeof(TBO_OBJECT_EXTENSION));
+    if (!path) return NULL;
+
+    memcpy(path, source, len);
+    memcpy(path + len, TBO_OBJECT_EXTENSION, sizeof(TBO_OBJECT_EXTENSION));
+    return path;
+}
+
+static void assemble_unit(build_unit_t *unit) {
+    uint64_t source_hash;
+    if (!tbo_hash_file(unit->source, &source_hash)) {
+        ternuino_log(TERNUINO_LOG_ERROR, "Error: File '%s' not found.", unit->source);
+        return;
+    }
+
+    if (tbo_is_current(unit->object, source_hash, true)) {
+        unit->up_to_date = true;
+        unit->success = true;
+        return;
+    }
+
+    assembler_t assembler;
+    assembler_init(&assembler);
+    assembler.source_name = unit->source;
+    assembler.relocatable = true;
+
+    instruction_t program[MAX_MEMORY_SIZE];
+    int32_t program_size;
+    if (assembler_parse_file(&assembler, unit->source, program, &program_size)) {
+        unit->success = tbo_write(unit->object, &assembler, program, program_size, source_hash);
+        if (!unit->success) {
+            ternuino_log(TERNUINO_LOG_ERROR, "Error: Cannot write object '%s'.", unit->object);
+        }
+        unit->instructions = program_size;
+        unit->data_cells = assembler.data_size;
+    }
+
+    assembler_free(&assembler);
+}
+
+// Worker: claim units until none are left. The assembler keeps no global
+// state, so units can be assembled concurrently.
+static void* build_worker(void *arg) {
+    build_queue_t *queue = (build_queue_t*)arg;
+
+    for (;;) {
+        int index = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED);
+        if (index >= queue->count) break;
+        assemble_unit(&queue->units[index]);
+    }
+
+    return NULL;
+}
+
+static void build_all(build_queue_t *queue, int jobs) {
+#ifdef _WIN32
+    (void)jobs;
+    build_worker(queue);
+#else
+    // Default to one thread per online CPU
+    if (jobs <= 0) jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs > queue->count) jobs = queue->count;
+    if (jobs < 1) jobs = 1;
+
+    pthread_t *threads = ternuino_alloc(sizeof(pthread_t) * (size_t)jobs);
+    int started = 0;
+    if (threads) {
+        while (started < jobs - 1 && pthread_create(&threads[started], NULL, build_worker, queue) == 0) {
+            started++;
+        }
+    }
+
+    // The calling thread works too, so the build finishes even if no
+    // helper could be started
+    build_worker(queue);
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    ternuino_free(threads);
+#endif
+}
+
+bool linker_build(const char *const *sources, int count, const char *output, int jobs) {
+    build_unit_t *units = ternuino_calloc((size_t)count, sizeof(build_unit_t));
+    const char **objects = ternuino_calloc((size_t)count, sizeof(char*));
+    bool success = units && objects;
+
+    for (int i = 0; success && i < count; i++) {
+        units[i].source = sources[i];
+        units[i].object = object_path(sources[i]);
+        objects[i] = units[i].object;
+        success = units[i].object != NULL;
+    }
+
+    if (success) {
+        build_queue_t queue = { units, count, 0 };
+        build_all(&queue, jobs);
+
+        // Report in argument order once every file is done
+        for (int i = 0; i < count; i++) {
+            if (!units[i].success) {
+                success = false;
+            } else if (units[i].up_to_date) {
+                ternuino_log(TERNUINO_LOG_INFO, "%s is up to date.", units[i].object);
+            } else {
+                ternuino_log(TERNUINO_LOG_INFO, "Assembled %s -> %s (%d instructions, %d data cells)", units[i].source,
+                       units[i].object, units[i].instructions, units[i].data_cells);
+            }
+        }
+    }
+
+    if (success) {
+        success = linker_link(objects, count, output);
+    }
+
+    for (int i = 0; units && i < count; i++) {
+        ternuino_free(units[i].object);
+    }
+    ternuino_free(units);
+    ternuino_free(objects);
+    return success;
+}
+
+// Name of symbol index in an object, as a C string
+static bool symbol_name(const tbo_image_t *image, uint32_t index, char *name) {
+    const tbo_symbol_t *symbol = &image->symbols[index];
+    if (symbol->name_length >= MAX_LABEL_LENGTH) return false;
+
+    memcpy(name, image->strings + symbol->name_offset, symbol->name_length);
+    name[symbol->name_length] = '\0';
+    return true;
+}
+
+// Final address of a relocated reference
+static bool relocate(const assembler_t *linked, const tbo_image_t *image, const char *filename,
+                     const tbo_relocation_t *reloc, int32_t text_base, int32_t data_base, int32_t *value) {
+    switch (reloc->kind) {
+        case RELOC_TEXT:
+            *value += text_base;
+            return true;
+
+        case RELOC_DATA:
+            *value += data_base;
+            return true;
+
+        case RELOC_EXTERN: {
+            char name[MAX_LABEL_LENGTH];
+            const label_t *label = NULL;
+            if (symbol_name(image, reloc->symbol, name)) {
+                label = assembler_find_label(linked, name, false);
+                if (!label) label = assembler_find_label(linked, name, true);
+            }
+            if (!label) {
+                ternuino_log(TERNUINO_LOG_ERROR, "Error: Undefined external '%s' in %s", name, filename);
+                return false;
+            }
+            *value = label->address;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool linker_link(const char *const *objects, int count, const char *output) {
+    tbo_image_t *images = ternuino_calloc((size_t)count, sizeof(tbo_image_t));
+    if (!images) return false;
+
+    // Open every object and hash their contents for the up-to-date check
+    bool success = true;
+    int opened = 0;
+    uint64_t link_hash = 0;
+    for (; opened < count; opened++) {
+        if (!tbo_open(&images[opened], objects[opened])) {
+            ternuino_log(TERNUINO_LOG_ERROR, "Error: '%s' is not a valid object file.", objects[opened]);
+            success = false;
+            break;
+        }
+        if (!(images[opened].header->flags & TBO_IMAGE_OBJECT)) {
+            ternuino_log(TERNUINO_LOG_ERROR, "Error: '%s' is a linked image, not an object file.", objects[opened]);
+            opened++;
+            success = false;
+            break;
+        }
+        uint64_t image_hash = images[opened].header->image_hash;
+        link_hash = tbo_hash(&image_hash, sizeof(image_hash)) ^ (link_hash * 31);
+    }
+
+    if (success && tbo_is_current(output, link_hash, false)) {
+        ternuino_log(TERNUINO_LOG_INFO, "%s is up to date.", output);
+        for (int i = 0; i < opened; i++) tbo_close(&images[i]);
+        ternuino_free(images);
+        return true;
+    }
+
+    assembler_t linked;
+    assembler_init(&linked);
+    instruction_t program[MAX_MEMORY_SIZE];
+    int32_t program_size = 0;
+
+    // Place sections in order and collect the exported symbols
+    int32_t *text_base = ternuino_calloc((size_t)count, sizeof(int32_t));
+    int32_t *data_base = ternuino_calloc((size_t)count, sizeof(int32_t));
+    if (!text_base || !data_base) success = false;
+
+    for (int i = 0; success && i < count; i++) {
+        const tbo_header_t *header = images[i].header;
+        text_base[i] = program_size;
+        data_base[i] = linked.data_size;
+
+        if (program_size + (int32_t)header->instruction_count > MAX_MEMORY_SIZE ||
+            linked.data_size + (int32_t)header->data_count > MAX_DATA_MEMORY_SIZE) {
+            ternuino_log(TERNUINO_LOG_ERROR, "Error: Linked program does not fit in memory (at %s)", objects[i]);
+            success = false;
+            break;
+        }
+
+        tbo_unpack_program(&images[i], program + program_size);
+        memcpy(linked.data_image + linked.data_size, images[i].data, header->data_count * sizeof(int32_t));
+        program_size += (int32_t)header->instruction_count;
+        linked.data_size += (int32_t)header->data_count;
+
+        for (uint32_t s = 0; s < header->symbol_count; s++) {
+            const tbo_symbol_t *symbol = &images[i].symbols[s];
+            char name[MAX_LABEL_LENGTH];
+            if (!(symbol->flags & TBO_SYMBOL_GLOBAL) || !symbol_name(&images[i], s, name)) continue;
+
+            bool is_data = (symbol->flags & TBO_SYMBOL_DATA) != 0;
+            int32_t address = symbol->address + (is_data ? data_base[i] : text_base[i]);
+            if (!assembler_define_label(&linked, name, address, is_data)) {
+                ternuino_log(TERNUINO_LOG_ERROR, "Error: '%s' is exported by more than one object (again in %s)", name, objects[i]);
+                success = false;
+            }
+        }
+    }
+
+    // Merge the IRQ tables and apply the relocations
+    for (int i = 0; success && i < count; i++) {
+        const tbo_header_t *header = images[i].header;
+        int32_t irq_handlers[MAX_IRQ_VECTORS];
+        memcpy(irq_handlers, header->irq_handlers, sizeof(irq_handlers));
+
+        for (uint32_t r = 0; success && r < header->relocation_count; r++) {
+            const tbo_relocation_t *reloc = &images[i].relocations[r];
+            int32_t *value;
+            if (reloc->operand == 0) {
+                value = &irq_handlers[reloc->target];
+            } else {
+                instruction_t *instr = &program[text_base[i] + (int32_t)reloc->target];
+                value = reloc->operand == 1 ? &instr->operand1.value.address : &instr->operand2.value.address;
+            }
+            success = relocate(&linked, &images[i], objects[i], reloc, text_base[i], data_base[i], value);
+        }
+
+        for (int v = 0; success && v < MAX_IRQ_VECTORS; v++) {
+            if (irq_handlers[v] < 0) continue;
+            if (linked.irq_handlers[v] >= 0) {
+                ternuino_log(TERNUINO_LOG_ERROR, "Error: IRQ vector %d is set by more than one object (again in %s)", v, objects[i]);
+                success = false;
+            }
+            linked.irq_handlers[v] = irq_handlers[v];
+        }
+    }
+
+    if (success) {
+        success = tbo_write(output, &linked, program, program_size, link_hash);
+        if (success) {
+            ternuino_log(TERNUINO_LOG_INFO, "Linked %d objects -> %s (%d instructions, %d data cells, %d symbols)",
+                   count, output, program_size, linked.data_size, linked.label_count);
+        } else {
+            ternuino_log(TERNUINO_LOG_ERROR, "Error: Cannot write image '%s'.", output);
+        }
+    }
+
+    assembler_free(&linked);
+    ternuino_free(text_base);
+    ternuino_free(data_base);
+    for (int i = 0; i < opened; i++) tbo_close(&images[i]);
+    ternuino_free(images);
+    return success;
+}
@@ -0,0 +1,281 @@
+#include "devices.h"
+#include "ternuino.h"
+#include "runtime.h"
+#include <string.h>
+
+// Largest mailbox, in values
+#define MAILBOX_MAX_CAPACITY (1u << 24)
+
+// Assumed cache line size; the two ends of a mailbox sit on separate lines
+#define MAILBOX_CACHE_LINE 64
+
+// A slot's sequence number says whose turn it is: the producer of
+// position pos may fill it when seq == pos, the consumer may take it when
+// seq == pos + 1
+typedef struct {
+    uint32_t seq;
+    int32_t value;
+} mailbox_slot_t;
+
+struct mailbox_s {
+    uint32_t tail;          // Next position to fill, claimed by producers
+    uint8_t tail_pad[MAILBOX_CACHE_LINE - sizeof(uint32_t)];
+    uint32_t head;          // Next position to take, owned by the consumer
+    uint8_t head_pad[MAILBOX_CACHE_LINE - sizeof(uint32_t)];
+    uint32_t mask;          // Capacity - 1
+    bool multi_producer;    // Producers claim positions with a CAS
+    uint32_t refs;
+    uint32_t producers;     // Devices writing into the mailbox
+    uint32_t consumers;     // Devices reading it, at most one
+    mailbox_slot_t slots[];
+};
+
+mailbox_t* mailbox_create(uint32_t capacity, bool multi_producer) {
+    if (capacity == 0) capacity = MAILBOX_DEFAULT_CAPACITY;
+    if (capacity > MAILBOX_MAX_CAPACITY) capacity = MAILBOX_MAX_CAPACITY;
+
+    uint32_t size = 1;
+    while (size < capacity) size <<= 1;
+
+    mailbox_t *mailbox = ternuino_alloc(sizeof(mailbox_t) + sizeof(mailbox_slot_t) * size);
+    if (!mailbox) return NULL;
+
+    memset(mailbox, 0, sizeof(mailbox_t));
+    mailbox->mask = size - 1;
+    mailbox->multi_producer = multi_producer;
+    mailbox->refs = 1;
+    for (uint32_t i = 0; i < size; i++) {
+        mailbox->slots[i].seq = i;
+        mailbox->slots[i].value = 0;
+    }
+    return mailbox;
+}
+
+void mailbox_retain(mailbox_t *mailbox) {
+    __atomic_fetch_add(&mailbox->refs, 1, __ATOMIC_RELAXED);
+}
+
+void mailbox_release(mailbox_t *mailbox) {
+    if (mailbox && __atomic_sub_fetch(&mailbox->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        ternuino_free(mailbox);
+    }
+}
+
+// Returns false if the mailbox is full
+bool mailbox_push(mailbox_t *mailbox, int32_t value) {
+    uint32_t pos = __atomic_load_n(&mailbox->tail, __ATOMIC_RELAXED);
+    mailbox_slot_t *slot;
+
+    for (;;) {
+        slot = &mailbox->slots[pos & mailbox->mask];
+        int32_t turn = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+
+        if (turn < 0) return false; // The consumer has not taken this slot yet
+
+        if (turn > 0) {
+            // Another producer filled this position first
+            pos = __atomic_load_n(&mailbox->tail, __ATOMIC_RELAXED);
+        } else if (!mailbox->multi_producer) {
+            __atomic_store_n(&mailbox->tail, pos + 1, __ATOMIC_RELAXED);
+            break;
+        } else if (__atomic_compare_exchange_n(&mailbox->tail, &pos, pos + 1, true,
+                                               __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    slot->value = value;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Returns false if the mailbox is empty. Only the one consumer may call it.
+bool mailbox_pop(mailbox_t *mailbox, int32_t *value) {
+    uint32_t pos = __atomic_load_n(&mailbox->head, __ATOMIC_RELAXED);
+    mailbox_slot_t *slot = &mailbox->slots[pos & mailbox->mask];
+
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1) return false;
+
+    *value = slot->value;
+    __atomic_store_n(&slot->seq, pos + mailbox->mask + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&mailbox->head, pos + 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+// Consumer side check, one shared load
+bool mailbox_empty(const mailbox_t *mailbox) {
+    uint32_t pos = __atomic_load_n(&mailbox->head, __ATOMIC_RELAXED);
+    return __atomic_load_n(&mailbox->slots[pos & mailbox->mask].seq, __ATOMIC_ACQUIRE) != pos + 1;
+}
+
+// Mailbox device implementation
+device_t* mailbox_device_create(uint8_t device_id, uint8_t irq_vector, mailbox_t *inbox, mailbox_t *outbox) {
+    if (!inbox && !outbox) return NULL;
+
+    // The queue is only lock-free for one reader, and for one writer unless
+    // it was made for several
+    bool claimed_in = !inbox || __atomic_add_fetch(&inbox->consumers, 1, __ATOMIC_RELAXED) == 1;
+    bool claimed_out = !outbox || outbox->multi_producer ||
+                       __atomic_add_fetch(&outbox->producers, 1, __ATOMIC_RELAXED) == 1;
+    uint32_t staged_capacity = outbox ? outbox->mask + 1 : 0;
+    device_t *dev = NULL;
+    if (claimed_in && claimed_out) {
+        dev = device_create(DEVICE_MAILBOX, device_id, irq_vector,
+                            sizeof(mailbox_data_t) + sizeof(int32_t) * staged_capacity);
+    }
+    if (!dev) {
+        if (inbox) __atomic_sub_fetch(&inbox->consumers, 1, __ATOMIC_RELAXED);
+        if (outbox && !outbox->multi_producer) __atomic_sub_fetch(&outbox->producers, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    mailbox_data_t *mdata = dev->device_data;
+    mdata->inbox = inbox;
+    mdata->outbox = outbox;
+    mdata->staged = (int32_t*)(mdata + 1);
+    mdata->staged_capacity = staged_capacity;
+    if (inbox) mailbox_retain(inbox);
+    if (outbox) mailbox_retain(outbox);
+
+    dev->read = mailbox_read;
+    dev->write = mailbox_write;
+    dev->read_block = mailbox_read_block;
+    dev->write_block = mailbox_write_block;
+    dev->open = mailbox_open;
+    dev->close = mailbox_close;
+    dev->tick = mailbox_tick;
+    dev->sync = mailbox_sync;
+    dev->input_ready = mailbox_input_ready;
+    dev->destroy = mailbox_destroy;
+
+    return dev;
+}
+
+void mailbox_destroy(device_t *dev) {
+    if (!dev || !dev->device_data) return;
+
+    mailbox_data_t *mdata = (mailbox_data_t*)dev->device_data;
+
+    if (mdata->inbox) {
+        __atomic_sub_fetch(&mdata->inbox->consumers, 1, __ATOMIC_RELAXED);
+        mailbox_release(mdata->inbox);
+        mdata->inbox = NULL;
+    }
+    if (mdata->outbox) {
+        if (!mdata->outbox->multi_producer) {
+            __atomic_sub_fetch(&mdata->outbox->producers, 1, __ATOMIC_RELAXED);
+        }
+        mailbox_release(mdata->outbox);
+        mdata->outbox = NULL;
+    }
+}
+
+// An empty inbox or a full outbox reports DEVICE_BUSY; nothing waits
+int32_t mailbox_read(device_t *dev, int32_t *value) {
+    if (!dev || !dev->device_data || !value) return -1;
+
+    mailbox_data_t *mdata = (mailbox_data_t*)dev->device_data;
+    if (!mdata->inbox) return -1;
+
+    dev->status &= ~DEVICE_IRQ_PENDING; // The next tick raises it again if more is waiting
+    if (!mailbox_pop(mdata->inbox, value)) {
+        dev->status |= DEVICE_BUSY;
+        return -1;
+    }
+    dev->status &= ~DEVICE_BUSY;
+    return 0;
+}
+
+int32_t mailbox_write(device_t *dev, int32_t value) {
+    if (!dev || !dev->device_data) return -1;
+
+    mailbox_data_t *mdata = (mailbox_data_t*)dev->device_data;
+    if (!mdata->outbox) return -1;
+
+    // Held values go first, so a write never overtakes them
+    if (!dev->deferred && mdata->staged_count > 0) {
+        mailbox_sync(dev);
+    }
+
+    bool sent;
+    if (dev->deferred || mdata->staged_count > 0) {
+        sent = mdata->staged_count < mdata->staged_capacity;
+        if (sent) {
+            mdata->staged[(mdata->staged_first + mdata->staged_count) % mdata->staged_capacity] = value;
+            mdata->staged_count++;
+        }
+    } else {
+        sent = mailbox_push(mdata->outbox, value);
+    }
+
+    if (!sent) {
+        dev->status |= DEVICE_BUSY;
+        return -1;
+    }
+    dev->status &= ~DEVICE_BUSY;
+    return 0;
+}
+
+// Block transfers move what fits and stop at an empty inbox or full outbox
+int32_t mailbox_read_block(device_t *dev, int32_t *values, int32_t count) {
+    int32_t moved = 0;
+    while (moved < count && mailbox_read(dev, &values[moved]) == 0) {
+        moved++;
+    }
+    return moved > 0 ? moved : -1;
+}
+
+int32_t mailbox_write_block(device_t *dev, const int32_t *values, int32_t count) {
+    int32_t moved = 0;
+    while (moved < count && mailbox_write(dev, values[moved]) == 0) {
+        moved++;
+    }
+    return moved > 0 ? moved : -1;
+}
+
+// Opening enables the interrupt raised while the inbox is not empty
+int32_t mailbox_open(device_t *dev, int32_t mode) {
+    (void)mode;
+    if (!dev || !dev->device_data) return -1;
+
+    dev->irq_enabled = true;
+    dev->status = DEVICE_READY;
+    return 0;
+}
+
+int32_t mailbox_close(device_t *dev) {
+    if (!dev) return -1;
+
+    dev->irq_enabled = false;
+    return 0;
+}
+
+// Pass held writes on to the outbox, as many as fit
+void mailbox_sync(device_t *dev) {
+    if (!dev || !dev->device_data) return;
+
+    mailbox_data_t *mdata = (mailbox_data_t*)dev->device_data;
+    while (mdata->staged_count > 0 && mailbox_push(mdata->outbox, mdata->staged[mdata->staged_first])) {
+        mdata->staged_first = (mdata->staged_first + 1) % mdata->staged_capacity;
+        mdata->staged_count--;
+    }
+}
+
+// Values arrive from other CPUs, not through a descriptor
+bool mailbox_input_ready(device_t *dev, int *wait_fd) {
+    *wait_fd = -1;
+    if (!dev || !dev->device_data) return true;
+
+    mailbox_data_t *mdata = (mailbox_data_t*)dev->device_data;
+    return !mdata->inbox || !mailbox_empty(mdata->inbox);
+}
+
+void mailbox_tick(device_t *dev, struct ternuino_s *cpu) {
+    (void)cpu;
+    if (!dev || !dev->device_data || !dev->irq_enabled) return;
+
+    mailbox_data_t *mdata = (mailbox_data_t*)dev->device_data;
+    if (mdata->inbox && !mailbox_empty(mdata->inbox)) {
+        dev->status |= DEVICE_IRQ_PENDING;
+    }
+}
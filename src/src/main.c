@@ -1,14 +1,25 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <time.h>
 #include <dirent.h>
 #include "ternuino.h"
 #include "assembler.h"
 #include "tritword.h"
 #include "devices.h"
+#include "tbo.h"
+#include "linker.h"
+#include "optimizer.h"
+#include "server.h"
+#include "multicore.h"
+#include "scheduler.h"
+#include "runtime.h"
 
 #ifdef _WIN32
 #include <windows.h>
+#include <io.h>
 #define PATH_SEPARATOR '\\'
 #else
 #include <unistd.h>
@@ -33,13 +44,208 @@ void print_data_memory(ternuino_t *cpu, int32_t max_elements) {
     printf("\n");
 }
 
-bool run_program_file(const char *filename) {
-    printf("=== Running program: %s ===\n", filename);
+// Host path bound to a file device handle
+typedef struct {
+    int32_t handle;
+    const char *path;
+    file_mode_t mode;
+} file_binding_t;
+
+// Host-side options for a single run
+typedef struct {
+    const char *stream_in;      // Stream device input spec, NULL for none
+    const char *stream_out;     // Stream device output spec, NULL for none
+    stream_format_t stream_format;
+    bool stream_blocking;
+    bool mmio;                  // Map device registers into the data address space
+    const char *shmem;          // Shared-memory object or file, NULL for none
+    uint32_t shmem_cells;
+    bool timer_host_clock;      // Timer counts host microseconds instead of cycles
+    file_binding_t files[FILE_MAX_HANDLES];
+    int file_count;
+    size_t file_buffer_size;    // stdio buffer for written files, 0 for the default
+    bool file_async;            // Read-ahead/write-behind on helper threads
+    bool file_nonblock;         // Report DEVICE_BUSY instead of waiting for them
+    bool optimize;              // Run the assembly-time optimizer (-O)
+    bool quiet;                 // Print only guest output and errors
+    FILE *json_out;             // One JSON result per program, NULL for none
+    uint64_t max_cycles;        // Stop a program after this many cycles, 0 for no limit
+    engine_t engine;
+    int cores;                  // Cores sharing data memory; devices belong to core 0
+    uint32_t mailbox_capacity;  // Mailbox ring between the cores, 0 for none
+    uint64_t quantum;           // Run the cores in lockstep quanta of this many cycles, 0 to run free
+    int threads;                // Multiplex the cores on this many host threads, 0 for one each
+} run_options_t;
+
+// Outcome of one program, for the exit code and the JSON results
+typedef struct {
+    const char *error;          // Why the program did not run, NULL if it ran
+    stop_reason_t reason;
+    uint64_t cycles;
+    double load_seconds;        // Reading and assembling or unpacking
+    double run_seconds;
+    int32_t registers[3];
+    int32_t pc;
+    int32_t data[MAX_DATA_MEMORY_SIZE];
+    int32_t data_size;
+} run_result_t;
+
+// Exit codes for batch runs
+#define EXIT_USAGE 1
+#define EXIT_LOAD_FAILED 2      // A program was missing or did not assemble
+#define EXIT_CYCLE_LIMIT 3      // A program was stopped by --max-cycles
+#define EXIT_BLOCKED 4          // A program ended with cores still waiting for input
+
+static double now_seconds(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+// Where errors and simulator messages go: stdout alongside the run's own
+// output, or stderr when stdout carries --json - or only guest output
+static FILE *diagnostics;
+
+// Progress and state messages, suppressed by --quiet
+static void print_info(const run_options_t *opts, const char *format, ...) {
+    if (opts->quiet) return;
+    
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+// The CLI reports simulator messages alongside its own output
+static void print_log(ternuino_log_level_t level, const char *message, void *user) {
+    (void)level;
+    (void)user;
+    fprintf(diagnostics, "%s\n", message);
+}
+
+// Whether stdout is kept for --json - results or guest output (--quiet).
+// Checked before the options are parsed, so their own errors stay off it.
+static bool stdout_is_machine_readable(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quiet") == 0 || strcmp(argv[i], "-q") == 0) return true;
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc && strcmp(argv[i + 1], "-") == 0) return true;
+    }
+    return false;
+}
+
+// Parse a --file argument: HANDLE=PATH with an optional :r or :w suffix
+static bool parse_file_binding(char *arg, file_binding_t *binding) {
+    char *eq = strchr(arg, '=');
+    if (!eq) return false;
+    
+    char *endptr;
+    long handle = strtol(arg, &endptr, 10);
+    if (endptr != eq || handle < 0 || handle >= FILE_MAX_HANDLES) return false;
+    
+    binding->handle = (int32_t)handle;
+    binding->path = eq + 1;
+    binding->mode = FILE_MODE_ANY;
+    
+    size_t len = strlen(binding->path);
+    if (len > 2 && binding->path[len - 2] == ':') {
+        char suffix = binding->path[len - 1];
+        if (suffix == 'r' || suffix == 'w') {
+            binding->mode = (suffix == 'r') ? FILE_MODE_READ : FILE_MODE_WRITE;
+            arg[eq - arg + len - 1] = '\0'; // Strip the suffix from the path
+        }
+    }
+    
+    return binding->path[0] != '\0';
+}
+
+// Create the stream device from the command line specs. Returns NULL if no
+// stream was requested or a spec could not be opened.
+static device_t* create_stream_device(const run_options_t *opts) {
+    if (!opts->stream_in && !opts->stream_out) return NULL;
+
+    bool owns_in = false, owns_out = false;
+    int in_fd = -1, out_fd = -1;
+
+    if (opts->stream_in) {
+        in_fd = stream_open_spec(opts->stream_in, false, &owns_in);
+        if (in_fd < 0) {
+            fprintf(diagnostics, "Error: Cannot open stream input '%s'.\n", opts->stream_in);
+            return NULL;
+        }
+    }
+
+    if (opts->stream_out) {
+        out_fd = stream_open_spec(opts->stream_out, true, &owns_out);
+        if (out_fd < 0) {
+            fprintf(diagnostics, "Error: Cannot open stream output '%s'.\n", opts->stream_out);
+            if (owns_in) close(in_fd);
+            return NULL;
+        }
+    }
+
+    device_t *dev = stream_device_create(2, 2, in_fd, out_fd, opts->stream_format, opts->stream_blocking);
+    if (!dev) {
+        if (owns_in) close(in_fd);
+        if (owns_out) close(out_fd);
+        return NULL;
+    }
+
+    stream_data_t *sdata = (stream_data_t*)dev->device_data;
+    sdata->owns_in_fd = owns_in;
+    sdata->owns_out_fd = owns_out;
+    return dev;
+}
+
+// A program ready to run, assembled from source or unpacked from an image
+typedef struct {
+    instruction_t code[MAX_MEMORY_SIZE];
+    int32_t size;
+    int32_t data[MAX_DATA_MEMORY_SIZE];
+    int32_t data_size;
+    int32_t irq_handlers[MAX_IRQ_VECTORS]; // From .irq, -1 keeps the default
+} loaded_program_t;
+
+// Handler addresses the devices use unless the program sets its own
+static const int32_t default_irq_handlers[MAX_IRQ_VECTORS] = { 25, 26, 24, 23, 22, -1, -1, -1 };
+
+static bool run_loaded_program(loaded_program_t *prog, const run_options_t *opts, run_result_t *result);
+
+// Optimize a freshly assembled program. Default handlers that fall inside
+// the program become explicit .irq entries first, so they are kept and
+// follow their code when instructions move.
+static void optimize_program(assembler_t *asm_state, instruction_t *program, int32_t *program_size,
+                             bool quiet) {
+    for (int i = 0; i < MAX_IRQ_VECTORS; i++) {
+        if (asm_state->irq_handlers[i] < 0 && default_irq_handlers[i] >= 0 &&
+            default_irq_handlers[i] < *program_size) {
+            asm_state->irq_handlers[i] = default_irq_handlers[i];
+        }
+    }
+    
+    optimize_report_t report;
+    assembler_optimize(asm_state, program, program_size, &report);
+    if (!quiet) {
+        print_optimize_report(&report);
+    }
+}
+
+bool run_program_file(const char *filename, const run_options_t *opts, run_result_t *result) {
+    memset(result, 0, sizeof(*result));
+    double start = now_seconds();
+    print_info(opts, "=== Running program: %s ===\n", filename);
     
     // Check if file exists
     FILE *test_file = fopen(filename, "r");
     if (!test_file) {
-        printf("Error: File '%s' not found.\n", filename);
+        fprintf(diagnostics, "Error: File '%s' not found.\n", filename);
+        result->error = "file not found";
         return false;
     }
     fclose(test_file);
@@ -49,18 +255,158 @@ bool run_program_file(const char *filename) {
     assembler_init(&assembler);
     
     // Parse the assembly file
+    loaded_program_t prog;
+    
+    if (!assembler_parse_file(&assembler, filename, prog.code, &prog.size)) {
+        fprintf(diagnostics, "Error: Failed to parse assembly file.\n");
+        assembler_free(&assembler);
+        result->error = "assembly failed";
+        return false;
+    }
+    if (opts->optimize) {
+        optimize_program(&assembler, prog.code, &prog.size, opts->quiet);
+    }
+    assembler_free(&assembler); // Labels are resolved; the data image stays
+    
+    prog.data_size = assembler.data_size;
+    memcpy(prog.data, assembler.data_image, sizeof(prog.data));
+    memcpy(prog.irq_handlers, assembler.irq_handlers, sizeof(prog.irq_handlers));
+    result->load_seconds = now_seconds() - start;
+    
+    print_info(opts, "Loaded %d instructions, data cells: %d\n", prog.size, prog.data_size);
+    return run_loaded_program(&prog, opts, result);
+}
+
+// Run a program image written by --assemble. The image is mapped and
+// unpacked; nothing is parsed.
+bool run_image_file(const char *filename, const run_options_t *opts, run_result_t *result) {
+    memset(result, 0, sizeof(*result));
+    double start = now_seconds();
+    print_info(opts, "=== Running image: %s ===\n", filename);
+    
+    tbo_image_t image;
+    if (!tbo_open(&image, filename)) {
+        fprintf(diagnostics, "Error: '%s' is not a valid program image.\n", filename);
+        result->error = "invalid image";
+        return false;
+    }
+    if (image.header->flags & TBO_IMAGE_OBJECT) {
+        fprintf(diagnostics, "Error: '%s' is an object file; link it first.\n", filename);
+        tbo_close(&image);
+        result->error = "object file";
+        return false;
+    }
+    
+    loaded_program_t prog;
+    prog.size = tbo_unpack_program(&image, prog.code);
+    prog.data_size = (int32_t)image.header->data_count;
+    memset(prog.data, 0, sizeof(prog.data));
+    memcpy(prog.data, image.data, (size_t)prog.data_size * sizeof(int32_t));
+    memcpy(prog.irq_handlers, image.header->irq_handlers, sizeof(prog.irq_handlers));
+    tbo_close(&image);
+    result->load_seconds = now_seconds() - start;
+    
+    print_info(opts, "Loaded %d instructions, data cells: %d\n", prog.size, prog.data_size);
+    return run_loaded_program(&prog, opts, result);
+}
+
+// Assemble a source into a program image. An image already built from the
+// same source (and optimization setting) is left alone.
+bool assemble_image_file(const char *filename, const char *output, bool optimize) {
+    uint64_t source_hash;
+    if (!tbo_hash_file(filename, &source_hash)) {
+        fprintf(diagnostics, "Error: File '%s' not found.\n", filename);
+        return false;
+    }
+    if (optimize) {
+        // An optimized image is a different build of the same source
+        source_hash = tbo_hash(&source_hash, sizeof(source_hash));
+    }
+    
+    if (tbo_is_current(output, source_hash, false)) {
+        printf("%s is up to date.\n", output);
+        return true;
+    }
+    
+    assembler_t assembler;
+    assembler_init(&assembler);
+    
     instruction_t program[MAX_MEMORY_SIZE];
     int32_t program_size;
+    bool success = assembler_parse_file(&assembler, filename, program, &program_size);
+    if (success && optimize) {
+        optimize_program(&assembler, program, &program_size, false);
+    }
+    if (!success) {
+        fprintf(diagnostics, "Error: Failed to parse assembly file.\n");
+    } else if (!(success = tbo_write(output, &assembler, program, program_size, source_hash))) {
+        fprintf(diagnostics, "Error: Cannot write image '%s'.\n", output);
+    } else {
+        printf("Assembled %s -> %s (%d instructions, %d data cells, %d symbols)\n",
+               filename, output, program_size, assembler.data_size, assembler.label_count);
+    }
     
-    if (!assembler_parse_file(&assembler, filename, program, &program_size)) {
-        printf("Error: Failed to parse assembly file.\n");
-        return false;
+    assembler_free(&assembler);
+    return success;
+}
+
+// Give each core a mailbox device that reads its own mailbox and writes
+// the next core's, so the cores form a ring (one core talks to itself)
+static void attach_mailboxes(ternuino_t *const *cores, int count, uint32_t capacity) {
+    mailbox_t *boxes[MULTICORE_MAX_CORES];
+    for (int i = 0; i < count; i++) {
+        boxes[i] = mailbox_create(capacity, false);
+    }
+    
+    for (int i = 0; i < count; i++) {
+        mailbox_t *inbox = boxes[i];
+        mailbox_t *outbox = boxes[(i + 1) % count];
+        device_t *mailbox_dev = (inbox && outbox) ? mailbox_device_create(5, 5, inbox, outbox) : NULL;
+        if (!mailbox_dev || ternuino_register_device(cores[i], mailbox_dev) < 0) {
+            fprintf(diagnostics, "Error: Cannot attach a mailbox to core %d.\n", i);
+            device_destroy(mailbox_dev);
+        }
+    }
+    
+    // The devices hold their own references
+    for (int i = 0; i < count; i++) {
+        mailbox_release(boxes[i]);
+    }
+}
+
+// Take turns running the cores on opts->threads host threads, parking
+// the ones waiting for input
+static void run_scheduled(ternuino_t *const *cores, int count, const run_options_t *opts,
+                          stop_reason_t *reasons) {
+    scheduler_t *sched = scheduler_create(opts->threads, 0, opts->engine);
+    for (int i = 0; sched && i < count; i++) {
+        if (scheduler_add(sched, cores[i], opts->max_cycles) < 0) {
+            scheduler_destroy(sched);
+            sched = NULL;
+        }
     }
     
-    printf("Loaded %d instructions, data cells: %d\n", program_size, assembler.data_size);
+    if (!sched) {
+        fprintf(diagnostics, "Error: Cannot schedule the cores, running them on a thread each.\n");
+        for (int i = 0; i < count; i++) {
+            cores[i]->park_blocked = false;
+        }
+        multicore_run(cores, count, opts->max_cycles, opts->engine, reasons);
+        return;
+    }
     
+    scheduler_run(sched);
+    for (int i = 0; i < count; i++) {
+        reasons[i] = scheduler_reason(sched, i);
+    }
+    scheduler_destroy(sched);
+}
+
+static bool run_loaded_program(loaded_program_t *prog, const run_options_t *opts, run_result_t *result) {
     // Display the parsed program
-    print_program(program, program_size);
+    if (!opts->quiet) {
+        print_program(prog->code, prog->size);
+    }
     
     // Create and run the CPU
     ternuino_t cpu;
@@ -72,42 +418,162 @@ bool run_program_file(const char *filename) {
     
     if (terminal) {
         ternuino_register_device(&cpu, terminal);
-        ternuino_set_irq_handler(&cpu, 0, 25); // Set IRQ handler at address 25 for terminal
-        printf("Terminal device registered (ID: 0, IRQ vector: 0)\n");
+        ternuino_set_irq_handler(&cpu, 0, default_irq_handlers[0]); // Set IRQ handler at address 25 for terminal
+        print_info(opts, "Terminal device registered (ID: 0, IRQ vector: 0)\n");
     }
     
     if (file_dev) {
+        file_device_set_buffer(file_dev, opts->file_buffer_size);
+        file_device_set_async(file_dev, opts->file_async, opts->file_nonblock);
+        for (int i = 0; i < opts->file_count; i++) {
+            file_device_bind(file_dev, opts->files[i].handle, opts->files[i].path, opts->files[i].mode);
+        }
         ternuino_register_device(&cpu, file_dev);
-        ternuino_set_irq_handler(&cpu, 1, 26); // Set IRQ handler at address 26 for file
-        printf("File device registered (ID: 1, IRQ vector: 1)\n");
+        ternuino_set_irq_handler(&cpu, 1, default_irq_handlers[1]); // Set IRQ handler at address 26 for file
+        print_info(opts, "File device registered (ID: 1, IRQ vector: 1)\n");
+    }
+    
+    device_t *timer = timer_device_create(4, 4, opts->timer_host_clock);
+    if (timer) {
+        ternuino_register_device(&cpu, timer);
+        ternuino_set_irq_handler(&cpu, 4, default_irq_handlers[4]); // Set IRQ handler at address 22 for timer
+        print_info(opts, "Timer device registered (ID: 4, IRQ vector: 4, %s)\n",
+               opts->timer_host_clock ? "host clock" : "virtual time");
+    }
+    
+    device_t *stream_dev = create_stream_device(opts);
+    if (stream_dev) {
+        ternuino_register_device(&cpu, stream_dev);
+        ternuino_set_irq_handler(&cpu, 2, default_irq_handlers[2]); // Set IRQ handler at address 24 for stream
+        print_info(opts, "Stream device registered (ID: 2, IRQ vector: 2)\n");
+    }
+    
+    device_t *shmem_dev = NULL;
+    if (opts->shmem) {
+        shmem_dev = shmem_device_create(3, 3, opts->shmem, opts->shmem_cells);
+        if (!shmem_dev) {
+            fprintf(diagnostics, "Error: Cannot map shared memory '%s'.\n", opts->shmem);
+        }
+    }
+    if (shmem_dev) {
+        uint32_t cells = 0;
+        int32_t *shared = shmem_cells(shmem_dev, &cells);
+        ternuino_register_device(&cpu, shmem_dev);
+        ternuino_set_irq_handler(&cpu, 3, default_irq_handlers[3]); // Set IRQ handler at address 23 for shared memory
+        ternuino_map_shared(&cpu, shared, cells);
+        print_info(opts, "Shared memory device registered (ID: 3, IRQ vector: 3, %u cells at %d)\n", cells, SHARED_BASE);
+    }
+    
+    if (opts->mmio) {
+        ternuino_enable_mmio(&cpu, true);
+        print_info(opts, "MMIO window enabled at %d (%d cells per device)\n", MMIO_BASE, MMIO_PAGE_SIZE);
+    }
+    
+    // Handlers the program declares with .irq replace the defaults
+    for (int i = 0; i < MAX_IRQ_VECTORS; i++) {
+        if (prog->irq_handlers[i] >= 0) {
+            ternuino_set_irq_handler(&cpu, i, prog->irq_handlers[i]);
+        }
     }
     
-    ternuino_load_program(&cpu, program, program_size, assembler.data_image, assembler.data_size);
+    ternuino_load_program(&cpu, prog->code, prog->size, prog->data, prog->data_size);
     
-    printf("Initial registers: ");
-    print_cpu_state(&cpu);
-    if (assembler.data_size > 0) {
-        print_data_memory(&cpu, 9);
+    if (!opts->quiet) {
+        printf("Initial registers: ");
+        print_cpu_state(&cpu);
+        if (prog->data_size > 0) {
+            print_data_memory(&cpu, 9);
+        }
+    }
+    
+    // Extra cores run core 0's program image against its data memory
+    ternuino_t *cores[MULTICORE_MAX_CORES] = { &cpu };
+    int core_count = 1;
+    ternuino_t *extra = NULL;
+    if (opts->cores > 1) {
+        extra = malloc(sizeof(ternuino_t) * (size_t)(opts->cores - 1));
+        if (!extra) {
+            fprintf(diagnostics, "Error: Out of memory for %d cores, running on one.\n", opts->cores);
+        }
+    }
+    for (int i = 0; extra && i < opts->cores - 1; i++) {
+        ternuino_t *core = &extra[i];
+        ternuino_init(core, MAX_DATA_MEMORY_SIZE);
+        ternuino_load_image(core, cpu.image, false);
+        for (int v = 0; v < MAX_IRQ_VECTORS; v++) {
+            if (prog->irq_handlers[v] >= 0) {
+                ternuino_set_irq_handler(core, v, prog->irq_handlers[v]);
+            }
+        }
+        ternuino_map_shared(core, cpu.shared_mem, cpu.shared_size);
+        cores[core_count++] = core;
+    }
+    if (core_count > 1) {
+        multicore_attach(cores, core_count);
+        print_info(opts, "Running on %d cores sharing data memory\n", core_count);
+    }
+    if (opts->mailbox_capacity > 0) {
+        attach_mailboxes(cores, core_count, opts->mailbox_capacity);
+        print_info(opts, "Mailbox device registered on %d core%s (ID: 5, IRQ vector: 5)\n",
+                   core_count, core_count == 1 ? "" : "s");
     }
     
     // Run the program
-    ternuino_run(&cpu);
+    double start = now_seconds();
+    stop_reason_t reasons[MULTICORE_MAX_CORES];
+    if (opts->quantum > 0) {
+        multicore_run_quantum(cores, core_count, opts->quantum, opts->max_cycles, opts->engine, reasons);
+    } else if (opts->threads > 0) {
+        run_scheduled(cores, core_count, opts, reasons);
+    } else {
+        multicore_run(cores, core_count, opts->max_cycles, opts->engine, reasons);
+    }
+    result->run_seconds = now_seconds() - start;
+    result->reason = reasons[0];
+    for (int i = 1; i < core_count; i++) {
+        if (reasons[i] == STOP_CYCLE_LIMIT) {
+            result->reason = STOP_CYCLE_LIMIT; // Any core stopped early counts
+        } else if (reasons[i] == STOP_BLOCKED && result->reason != STOP_CYCLE_LIMIT) {
+            result->reason = STOP_BLOCKED;
+        }
+    }
+    result->cycles = cpu.cycles;
+    memcpy(result->registers, cpu.registers, sizeof(result->registers));
+    result->pc = cpu.pc;
+    result->data_size = cpu.dmem_size;
+    memcpy(result->data, cpu.data_mem, sizeof(int32_t) * cpu.dmem_size);
     
-    printf("Final registers:   ");
-    print_cpu_state(&cpu);
-    if (assembler.data_size > 0) {
-        print_data_memory(&cpu, 9);
+    if (!opts->quiet) {
+        if (result->reason == STOP_CYCLE_LIMIT) {
+            printf("Stopped after %llu cycles (--max-cycles)\n", (unsigned long long)cpu.cycles);
+        } else if (result->reason == STOP_BLOCKED) {
+            printf("Stopped with cores still waiting for input\n");
+        }
+        printf("Final registers:   ");
+        print_cpu_state(&cpu);
+        for (int i = 1; i < core_count; i++) {
+            printf("Core %d after %llu cycles: ", i, (unsigned long long)cores[i]->cycles);
+            print_cpu_state(cores[i]);
+        }
+        if (prog->data_size > 0) {
+            print_data_memory(&cpu, 9);
+        }
     }
     
-    // Clean up devices
-    for (int i = 0; i < cpu.device_count; i++) {
-        if (cpu.devices[i]) {
-            device_cleanup(cpu.devices[i]);
-            free(cpu.devices[i]);
+    // Clean up devices and program images
+    for (int c = 0; c < core_count; c++) {
+        ternuino_t *core = cores[c];
+        for (int i = 0; i < core->device_count; i++) {
+            if (core->devices[i]) {
+                device_destroy(core->devices[i]);
+                core->devices[i] = NULL; // Closing later devices may still scan the table
+            }
         }
+        ternuino_unload(core);
     }
+    free(extra);
     
-    printf("\n");
+    print_info(opts, "\n");
     
     return true;
 }
@@ -136,7 +602,7 @@ int list_available_programs(char programs[][256], int max_programs) {
     return count;
 }
 
-void interactive_mode(void) {
+void interactive_mode(const run_options_t *opts) {
     printf("=== Ternuino CPU Interpreter ===\n");
     printf("Ternary Computer Simulator with Assembly Language Support\n\n");
     
@@ -175,22 +641,319 @@ void interactive_mode(void) {
         
         if (choice >= 1 && choice <= program_count) {
             snprintf(program_path, sizeof(program_path), "programs%c%s", PATH_SEPARATOR, programs[choice - 1]);
-            run_program_file(program_path);
+            run_result_t result;
+            run_program_file(program_path, opts, &result);
         } else {
             printf("Invalid selection. Please try again.\n\n");
         }
     }
 }
 
+static const char *stop_reason_name(stop_reason_t reason) {
+    switch (reason) {
+        case STOP_HALTED:         return "halted";
+        case STOP_END_OF_PROGRAM: return "end_of_program";
+        case STOP_CYCLE_LIMIT:    return "cycle_limit";
+        case STOP_BLOCKED:        return "blocked";
+    }
+    return "unknown";
+}
+
+static void write_json_string(FILE *out, const char *text) {
+    fputc('"', out);
+    for (const unsigned char *c = (const unsigned char *)text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(out, "\\u%04x", *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// One line per program so results can be streamed and grepped
+static void write_json_result(FILE *out, const char *filename, const run_result_t *result) {
+    fprintf(out, "{\"program\": ");
+    write_json_string(out, filename);
+    if (result->error) {
+        fprintf(out, ", \"status\": \"error\", \"error\": ");
+        write_json_string(out, result->error);
+        fprintf(out, "}\n");
+        fflush(out);
+        return;
+    }
+    fprintf(out, ", \"status\": \"%s\", \"cycles\": %llu, \"load_ms\": %.3f, \"run_ms\": %.3f",
+            stop_reason_name(result->reason), (unsigned long long)result->cycles,
+            result->load_seconds * 1000.0, result->run_seconds * 1000.0);
+    fprintf(out, ", \"registers\": {\"A\": %d, \"B\": %d, \"C\": %d}, \"pc\": %d, \"data\": [",
+            result->registers[0], result->registers[1], result->registers[2], result->pc);
+    for (int32_t i = 0; i < result->data_size; i++) {
+        fprintf(out, i ? ", %d" : "%d", result->data[i]);
+    }
+    fprintf(out, "]}\n");
+    fflush(out);
+}
+
+static bool has_extension(const char *path, const char *extension) {
+    size_t len = strlen(path);
+    size_t ext_len = strlen(extension);
+    return len > ext_len && strcmp(path + len - ext_len, extension) == 0;
+}
+
+void print_usage(const char *prog) {
+    printf("Usage: %s [options] [program.asm|program.tbo ...]\n", prog);
+    printf("Options:\n");
+    printf("  --assemble OUT         Assemble program.asm into the image OUT and exit. With\n");
+    printf("                         several sources, assemble each into an object (.tobj)\n");
+    printf("                         and link them\n");
+    printf("  --link OUT             Link the object files given as arguments into OUT\n");
+    printf("  --jobs N               Threads for assembling several sources (default: CPUs)\n");
+    printf("  --image FILE           Run a program image instead of a source file\n");
+    printf("  -O                     Optimize single-file programs when assembling them\n");
+    printf("  --quiet, -q            Print only program output and errors\n");
+    printf("  --json FILE            Write one JSON result per program to FILE (- for stdout)\n");
+    printf("  --max-cycles N         Stop each program after N cycles (default: no limit)\n");
+    printf("  --engine step|batch    Tick devices every instruction (default) or every %d\n", TERNUINO_BATCH_CYCLES);
+    printf("  --cores N              Run N cores, one host thread each, sharing data memory\n");
+    printf("  --mailbox N            Link the cores in a ring of N-value mailboxes (device 5)\n");
+    printf("  --quantum N            Run the cores in lockstep N-cycle quanta, passing mailbox\n");
+    printf("                         values between quanta so results are reproducible\n");
+    printf("  --threads N            Multiplex the cores on N host threads, parking cores that\n");
+    printf("                         wait for mailbox or nonblocking stream input\n");
+    printf("  --serve SOCKET         Run jobs submitted over a Unix domain socket\n");
+    printf("  --workers N            Server worker threads (default: CPUs)\n");
+    printf("  --queue-depth N        Jobs the server queues before it stops reading (default %d)\n",
+           SERVER_DEFAULT_QUEUE_DEPTH);
+    printf("  --timeout MS           Per-job time limit for the server (default %d)\n",
+           SERVER_DEFAULT_TIMEOUT_MS);
+    printf("  --stream-in SPEC       Bind stream device input (-, fd:N or path)\n");
+    printf("  --stream-out SPEC      Bind stream device output (-, fd:N or path)\n");
+    printf("  --stream-format FMT    Stream value encoding: text (default) or binary\n");
+    printf("  --stream-nonblock      Report DEVICE_BUSY instead of waiting for the stream\n");
+    printf("  --mmio                 Map device registers at data address %d\n", MMIO_BASE);
+    printf("  --shmem SPEC           Share memory at data address %d (shm:NAME or path)\n", SHARED_BASE);
+    printf("  --shmem-cells N        Cells to create if SPEC is new (default %d)\n", SHMEM_DEFAULT_CELLS);
+    printf("  --timer-host           Timer counts host microseconds instead of cycles\n");
+    printf("  --file H=PATH[:r|:w]   Bind file device handle H (channel 1 + 256 * H) to PATH\n");
+    printf("  --file-buffer BYTES    stdio buffer size for files the guest writes\n");
+    printf("  --file-async           Overlap file I/O with simulation (read-ahead, write-behind)\n");
+    printf("  --file-nonblock        With --file-async, report DEVICE_BUSY instead of waiting\n");
+    printf("Several programs run one after another. Exit status: 0 on success, %d for\n", EXIT_LOAD_FAILED);
+    printf("a program that failed to load, %d if one hit --max-cycles, %d if one ended\n", EXIT_CYCLE_LIMIT,
+           EXIT_BLOCKED);
+    printf("with cores still waiting for input.\n");
+}
+
 int main(int argc, char *argv[]) {
+    run_options_t opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.stream_format = STREAM_FORMAT_TEXT;
+    opts.stream_blocking = true;
+    opts.shmem_cells = SHMEM_DEFAULT_CELLS;
+    const char *program = NULL;
+    const char *image = NULL;
+    const char *json_path = NULL;
+    const char *serve_path = NULL;
+    server_options_t server_opts;
+    memset(&server_opts, 0, sizeof(server_opts));
+    const char *assemble_output = NULL;
+    const char *link_output = NULL;
+    int jobs = 0;
+    const char **inputs = malloc(sizeof(char*) * (size_t)argc);
+    int input_count = 0;
+    if (!inputs) return 1;
+    
+    diagnostics = stdout_is_machine_readable(argc, argv) ? stderr : stdout;
+    ternuino_set_log(print_log, NULL);
+    
     // Check command line arguments
-    if (argc > 1) {
-        // Run specific program file
-        run_program_file(argv[1]);
-    } else {
-        // Interactive mode
-        interactive_mode();
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--image") == 0 && i + 1 < argc) {
+            image = argv[++i];
+        } else if (strcmp(argv[i], "--assemble") == 0 && i + 1 < argc) {
+            assemble_output = argv[++i];
+        } else if (strcmp(argv[i], "--link") == 0 && i + 1 < argc) {
+            link_output = argv[++i];
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-O") == 0) {
+            opts.optimize = true;
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serve_path = argv[++i];
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            server_opts.workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--queue-depth") == 0 && i + 1 < argc) {
+            server_opts.queue_depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            server_opts.timeout_ms = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--quiet") == 0 || strcmp(argv[i], "-q") == 0) {
+            opts.quiet = true;
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "--max-cycles") == 0 && i + 1 < argc) {
+            opts.max_cycles = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            const char *engine = argv[++i];
+            if (strcmp(engine, "step") == 0) {
+                opts.engine = ENGINE_STEP;
+            } else if (strcmp(engine, "batch") == 0) {
+                opts.engine = ENGINE_BATCH;
+            } else {
+                fprintf(diagnostics, "Error: Unknown engine '%s'.\n", engine);
+                free(inputs);
+                return EXIT_USAGE;
+            }
+        } else if (strcmp(argv[i], "--cores") == 0 && i + 1 < argc) {
+            opts.cores = atoi(argv[++i]);
+            if (opts.cores < 1 || opts.cores > MULTICORE_MAX_CORES) {
+                fprintf(diagnostics, "Error: --cores must be 1 to %d.\n", MULTICORE_MAX_CORES);
+                free(inputs);
+                return EXIT_USAGE;
+            }
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            opts.threads = atoi(argv[++i]);
+            if (opts.threads < 1) {
+                fprintf(diagnostics, "Error: --threads must be at least 1.\n");
+                free(inputs);
+                return EXIT_USAGE;
+            }
+        } else if (strcmp(argv[i], "--quantum") == 0 && i + 1 < argc) {
+            opts.quantum = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--mailbox") == 0 && i + 1 < argc) {
+            opts.mailbox_capacity = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--stream-in") == 0 && i + 1 < argc) {
+            opts.stream_in = argv[++i];
+        } else if (strcmp(argv[i], "--stream-out") == 0 && i + 1 < argc) {
+            opts.stream_out = argv[++i];
+        } else if (strcmp(argv[i], "--stream-format") == 0 && i + 1 < argc) {
+            const char *fmt = argv[++i];
+            if (strcmp(fmt, "text") == 0) {
+                opts.stream_format = STREAM_FORMAT_TEXT;
+            } else if (strcmp(fmt, "binary") == 0) {
+                opts.stream_format = STREAM_FORMAT_BINARY;
+            } else {
+                fprintf(diagnostics, "Error: Unknown stream format '%s'.\n", fmt);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--stream-nonblock") == 0) {
+            opts.stream_blocking = false;
+        } else if (strcmp(argv[i], "--mmio") == 0) {
+            opts.mmio = true;
+        } else if (strcmp(argv[i], "--shmem") == 0 && i + 1 < argc) {
+            opts.shmem = argv[++i];
+        } else if (strcmp(argv[i], "--shmem-cells") == 0 && i + 1 < argc) {
+            char *endptr;
+            long cells = strtol(argv[++i], &endptr, 10);
+            if (*endptr != '\0' || cells < 1 || cells > SHARED_MAX_CELLS) {
+                fprintf(diagnostics, "Error: --shmem-cells must be 1 to %d.\n", SHARED_MAX_CELLS);
+                free(inputs);
+                return EXIT_USAGE;
+            }
+            opts.shmem_cells = (uint32_t)cells;
+        } else if (strcmp(argv[i], "--timer-host") == 0) {
+            opts.timer_host_clock = true;
+        } else if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) {
+            if (opts.file_count == FILE_MAX_HANDLES ||
+                !parse_file_binding(argv[++i], &opts.files[opts.file_count])) {
+                fprintf(diagnostics, "Error: Invalid file binding '%s'.\n", argv[i]);
+                return 1;
+            }
+            opts.file_count++;
+        } else if (strcmp(argv[i], "--file-buffer") == 0 && i + 1 < argc) {
+            opts.file_buffer_size = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--file-async") == 0) {
+            opts.file_async = true;
+        } else if (strcmp(argv[i], "--file-nonblock") == 0) {
+            opts.file_async = true;
+            opts.file_nonblock = true;
+        } else if (strcmp(argv[i], "--help") == 0 || argv[i][0] == '-') {
+            print_usage(argv[0]);
+            free(inputs);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        } else {
+            program = argv[i];
+            inputs[input_count++] = argv[i];
+        }
+    }
+    
+    if (assemble_output || link_output) {
+        bool success;
+        if (input_count == 0) {
+            fprintf(diagnostics, "Error: %s needs input files.\n", assemble_output ? "--assemble" : "--link");
+            success = false;
+        } else if (link_output) {
+            success = linker_link(inputs, input_count, link_output);
+        } else if (input_count == 1) {
+            success = assemble_image_file(program, assemble_output, opts.optimize);
+        } else {
+            if (opts.optimize) {
+                printf("Optimizer skipped: programs built from several sources are not optimized\n");
+            }
+            success = linker_build(inputs, input_count, assemble_output, jobs);
+        }
+        free(inputs);
+        return success ? 0 : 1;
+    }
+    
+    if (serve_path) {
+        free(inputs);
+        server_opts.max_cycles = opts.max_cycles;
+        server_opts.engine = opts.engine;
+        return server_run(serve_path, &server_opts) ? 0 : 1;
+    }
+    
+    if (!image && input_count == 0) {
+        free(inputs);
+        if (opts.quiet || json_path) {
+            fprintf(diagnostics, "Error: --quiet and --json need programs to run.\n");
+            return EXIT_USAGE;
+        }
+        interactive_mode(&opts);
+        return 0;
+    }
+    
+    if (json_path) {
+        opts.json_out = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+        if (!opts.json_out) {
+            fprintf(diagnostics, "Error: Cannot write results to '%s'.\n", json_path);
+            free(inputs);
+            return EXIT_USAGE;
+        }
+    }
+    
+    // Run the --image first, then every program in the order given
+    bool load_failed = false;
+    bool limited = false;
+    bool blocked = false;
+    for (int i = image ? -1 : 0; i < input_count; i++) {
+        const char *path = i < 0 ? image : inputs[i];
+        run_result_t result;
+        if (i < 0 || has_extension(path, TBO_FILE_EXTENSION)) {
+            run_image_file(path, &opts, &result);
+        } else {
+            run_program_file(path, &opts, &result);
+        }
+        if (opts.json_out) {
+            write_json_result(opts.json_out, path, &result);
+        }
+        if (result.error) {
+            load_failed = true;
+        } else if (result.reason == STOP_CYCLE_LIMIT) {
+            limited = true;
+        } else if (result.reason == STOP_BLOCKED) {
+            blocked = true;
+        }
+    }
+    
+    if (opts.json_out && opts.json_out != stdout) {
+        fclose(opts.json_out);
     }
+    free(inputs);
     
+    if (load_failed) return EXIT_LOAD_FAILED;
+    if (limited) return EXIT_CYCLE_LIMIT;
+    if (blocked) return EXIT_BLOCKED;
     return 0;
 }
@@ -0,0 +1,101 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "mapfile.h"
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool mapfile_open(mapped_file_t *mf, const char *filename) {
+    memset(mf, 0, sizeof(*mf));
+
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return false;
+    }
+
+    // Empty files cannot be mapped, but are still valid
+    if (size.QuadPart == 0) {
+        CloseHandle(file);
+        return true;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) return false;
+
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    mf->data = (const uint8_t*)view;
+    mf->size = (size_t)size.QuadPart;
+    mf->mapping = mapping;
+    return true;
+}
+
+void mapfile_close(mapped_file_t *mf) {
+    if (mf->data) {
+        UnmapViewOfFile((void*)mf->data);
+    }
+    if (mf->mapping) {
+        CloseHandle(mf->mapping);
+    }
+    memset(mf, 0, sizeof(*mf));
+}
+
+#else
+
+bool mapfile_open(mapped_file_t *mf, const char *filename) {
+    memset(mf, 0, sizeof(*mf));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+
+    // Empty files cannot be mapped, but are still valid
+    if (st.st_size == 0) {
+        close(fd);
+        return true;
+    }
+
+    void *view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps its own reference to the file
+    if (view == MAP_FAILED) return false;
+
+    // Values are consumed front to back; let the kernel read ahead aggressively
+    posix_madvise(view, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    mf->data = (const uint8_t*)view;
+    mf->size = (size_t)st.st_size;
+    return true;
+}
+
+void mapfile_close(mapped_file_t *mf) {
+    if (mf->data) {
+        munmap((void*)mf->data, mf->size);
+    }
+    memset(mf, 0, sizeof(*mf));
+}
+
+#endif
@@ -0,0 +1,248 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "multicore.h"
+#include "devices.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// One core's part of a run
+typedef struct {
+    ternuino_t *cpu;
+    uint64_t end;           // Cycle count to stop at, UINT64_MAX for no limit
+    engine_t engine;
+    stop_reason_t reason;
+    bool done;
+    bool threaded;          // Runs on a thread of its own
+    struct quantum_run_s *lockstep; // The quantum run it belongs to, if any
+} core_run_t;
+
+// Shared state of a quantum run
+typedef struct quantum_run_s {
+    core_run_t *runs;
+    int32_t count;
+    uint64_t quantum;
+    bool finished;          // Set at a barrier once every core is done
+#ifndef _WIN32
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int32_t parties;        // Threads meeting at the barrier, the caller included
+    int32_t waiting;
+    uint32_t generation;    // Bumped each time the barrier opens
+#endif
+} quantum_run_t;
+
+void multicore_attach(ternuino_t *const *cores, int32_t count) {
+    for (int32_t i = 0; i < count; i++) {
+        cores[i]->core_id = i;
+        if (i > 0) {
+            cores[i]->dmem_size = cores[0]->dmem_size;
+            ternuino_share_data(cores[i], cores[0]->data_mem);
+        }
+    }
+}
+
+// Run a core for up to slice cycles without passing its end
+static void run_slice(core_run_t *run, uint64_t slice) {
+    uint64_t left = run->end - run->cpu->cycles;
+    run->reason = ternuino_run_for(run->cpu, slice < left ? slice : left, run->engine);
+    run->done = run->reason != STOP_CYCLE_LIMIT || run->cpu->cycles >= run->end;
+}
+
+// The cores without a thread take turns, so a core spinning on another
+// one's store still sees it
+static void run_interleaved(core_run_t *runs, int32_t count, uint64_t slice) {
+    bool active = true;
+    while (active) {
+        active = false;
+        for (int32_t i = 0; i < count; i++) {
+            if (runs[i].threaded || runs[i].done) continue;
+            run_slice(&runs[i], slice);
+            active = active || !runs[i].done;
+        }
+    }
+}
+
+#ifndef _WIN32
+static void* core_thread(void *arg) {
+    run_slice((core_run_t*)arg, UINT64_MAX);
+    return NULL;
+}
+#endif
+
+// Set up the runs of a multicore_run or multicore_run_quantum
+static void init_runs(core_run_t *runs, ternuino_t *const *cores, int32_t count, uint64_t max_cycles,
+                      engine_t engine) {
+    for (int32_t i = 0; i < count; i++) {
+        runs[i].cpu = cores[i];
+        runs[i].end = UINT64_MAX;
+        if (max_cycles > 0 && max_cycles < UINT64_MAX - cores[i]->cycles) {
+            runs[i].end = cores[i]->cycles + max_cycles;
+        }
+        runs[i].engine = engine;
+        runs[i].done = false;
+        runs[i].threaded = false;
+        runs[i].lockstep = NULL;
+    }
+}
+
+void multicore_run(ternuino_t *const *cores, int32_t count, uint64_t max_cycles, engine_t engine,
+                   stop_reason_t *reasons) {
+    if (count > MULTICORE_MAX_CORES) count = MULTICORE_MAX_CORES;
+
+    core_run_t runs[MULTICORE_MAX_CORES];
+    init_runs(runs, cores, count, max_cycles, engine);
+
+    int32_t unthreaded = count;
+#ifndef _WIN32
+    pthread_t threads[MULTICORE_MAX_CORES];
+    for (int32_t i = 1; i < count; i++) {
+        runs[i].threaded = pthread_create(&threads[i], NULL, core_thread, &runs[i]) == 0;
+        if (runs[i].threaded) unthreaded--;
+    }
+#endif
+
+    // A core alone on the calling thread runs without slicing
+    run_interleaved(runs, count, unthreaded == 1 ? UINT64_MAX : MULTICORE_SLICE_CYCLES);
+
+#ifndef _WIN32
+    for (int32_t i = 1; i < count; i++) {
+        if (runs[i].threaded) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+#endif
+
+    for (int32_t i = 0; i < count; i++) {
+        reasons[i] = runs[i].reason;
+    }
+}
+
+// Between quanta, with every core stopped: pass on the events the devices
+// held, in core and then registration order, and see whether the run is over
+static void quantum_exchange(quantum_run_t *lockstep) {
+    bool finished = true;
+    for (int32_t i = 0; i < lockstep->count; i++) {
+        ternuino_t *cpu = lockstep->runs[i].cpu;
+        for (int32_t d = 0; d < cpu->device_count; d++) {
+            device_t *device = cpu->devices[d];
+            if (device && device->sync) {
+                device->sync(device);
+            }
+        }
+        finished = finished && lockstep->runs[i].done;
+    }
+    lockstep->finished = finished;
+}
+
+static void set_deferred(ternuino_t *const *cores, int32_t count, bool deferred) {
+    for (int32_t i = 0; i < count; i++) {
+        for (int32_t d = 0; d < cores[i]->device_count; d++) {
+            device_t *device = cores[i]->devices[d];
+            if (device && device->sync) {
+                device->deferred = deferred;
+            }
+        }
+    }
+}
+
+#ifndef _WIN32
+// The last thread to arrive does the exchange, then lets the others go
+static void quantum_barrier(quantum_run_t *lockstep) {
+    pthread_mutex_lock(&lockstep->lock);
+    uint32_t generation = lockstep->generation;
+    if (++lockstep->waiting == lockstep->parties) {
+        quantum_exchange(lockstep);
+        lockstep->waiting = 0;
+        lockstep->generation++;
+        pthread_cond_broadcast(&lockstep->cond);
+    } else {
+        while (generation == lockstep->generation) {
+            pthread_cond_wait(&lockstep->cond, &lockstep->lock);
+        }
+    }
+    pthread_mutex_unlock(&lockstep->lock);
+}
+
+static void* quantum_thread(void *arg) {
+    core_run_t *run = (core_run_t*)arg;
+    quantum_run_t *lockstep = run->lockstep;
+
+    while (!lockstep->finished) {
+        if (!run->done) {
+            run_slice(run, lockstep->quantum);
+        }
+        quantum_barrier(lockstep);
+    }
+    return NULL;
+}
+#endif
+
+void multicore_run_quantum(ternuino_t *const *cores, int32_t count, uint64_t quantum,
+                           uint64_t max_cycles, engine_t engine, stop_reason_t *reasons) {
+    if (count > MULTICORE_MAX_CORES) count = MULTICORE_MAX_CORES;
+    if (quantum == 0) quantum = 1;
+
+    core_run_t runs[MULTICORE_MAX_CORES];
+    init_runs(runs, cores, count, max_cycles, engine);
+
+    quantum_run_t lockstep;
+    lockstep.runs = runs;
+    lockstep.count = count;
+    lockstep.quantum = quantum;
+    lockstep.finished = false;
+    for (int32_t i = 0; i < count; i++) {
+        runs[i].lockstep = &lockstep;
+    }
+    set_deferred(cores, count, true);
+
+#ifndef _WIN32
+    pthread_mutex_init(&lockstep.lock, NULL);
+    pthread_cond_init(&lockstep.cond, NULL);
+    lockstep.waiting = 0;
+    lockstep.generation = 0;
+
+    // Nobody reaches the barrier before the number of threads is known
+    pthread_t threads[MULTICORE_MAX_CORES];
+    int32_t started = 0;
+    pthread_mutex_lock(&lockstep.lock);
+    for (int32_t i = 1; i < count; i++) {
+        runs[i].threaded = pthread_create(&threads[i], NULL, quantum_thread, &runs[i]) == 0;
+        if (runs[i].threaded) started++;
+    }
+    lockstep.parties = started + 1;
+    pthread_mutex_unlock(&lockstep.lock);
+#endif
+
+    // The calling thread runs core 0 and any core left without a thread.
+    // Within a quantum their order does not matter, since the events they
+    // raise for each other wait for the barrier.
+    while (!lockstep.finished) {
+        for (int32_t i = 0; i < count; i++) {
+            if (!runs[i].threaded && !runs[i].done) {
+                run_slice(&runs[i], quantum);
+            }
+        }
+#ifdef _WIN32
+        quantum_exchange(&lockstep);
+#else
+        quantum_barrier(&lockstep);
+#endif
+    }
+
+#ifndef _WIN32
+    for (int32_t i = 1; i < count; i++) {
+        if (runs[i].threaded) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    pthread_cond_destroy(&lockstep.cond);
+    pthread_mutex_destroy(&lockstep.lock);
+#endif
+
+    set_deferred(cores, count, false);
+    for (int32_t i = 0; i < count; i++) {
+        reasons[i] = runs[i].reason;
+    }
+}
@@ -0,0 +1,827 @@
+#include "optimizer.h"
+#include "tritlogic.h"
+#include "tritarith.h"
+#include "runtime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#define REG_COUNT 3
+#define REGS_ALL 0x7
+
+// Rounds of the pipeline before giving up on reaching a fixed point
+#define OPTIMIZE_MAX_PASSES 16
+
+// How control leaves an instruction
+typedef enum {
+    FLOW_NEXT,      // Falls through
+    FLOW_JUMP,      // Unconditional jump to a static target
+    FLOW_BRANCH,    // Static target or fall through
+    FLOW_STOP,      // HLT
+    FLOW_COMPUTED   // Jump through a register
+} flow_t;
+
+// Register effects of one instruction
+typedef struct {
+    uint8_t reads;      // Registers read
+    uint8_t writes;     // Registers always written
+    uint8_t clobbers;   // Registers that may change (includes writes)
+    bool pure;          // Removable if nothing reads what it writes
+} effect_t;
+
+// Known register values on entry to a block
+typedef struct {
+    bool visited;
+    bool known[REG_COUNT];
+    int32_t value[REG_COUNT];
+} reg_state_t;
+
+typedef struct {
+    int32_t start;
+    int32_t end;        // One past the last instruction
+    int32_t succ[2];    // Successor blocks, -1 for none
+    bool exits;         // Control may leave the program
+    bool reachable;
+    reg_state_t in;
+    uint8_t live_out;
+} block_t;
+
+// Working state of one optimizer pass
+typedef struct {
+    instruction_t *program;
+    int32_t size;
+    bool *removed;
+    int32_t *block_of;  // Block index of each instruction
+    block_t *blocks;
+    int32_t block_count;
+    const int32_t *irq_handlers;
+} pass_t;
+
+static bool is_reg(const operand_t *op) {
+    return op->mode == ADDR_REGISTER;
+}
+
+static uint8_t reg_bit(const operand_t *op) {
+    return (uint8_t)(1u << op->value.reg);
+}
+
+// Register read through an operand value
+static uint8_t operand_reads(const operand_t *op) {
+    return (op->mode == ADDR_REGISTER || op->mode == ADDR_INDIRECT) ? reg_bit(op) : 0;
+}
+
+static bool is_static_target(const operand_t *op) {
+    return op->mode == ADDR_IMMEDIATE || op->mode == ADDR_DIRECT;
+}
+
+// Jump target as the CPU computes it
+static int32_t jump_target(const instruction_t *instr) {
+    const operand_t *op = instr->opcode == OP_JMP ? &instr->operand1 : &instr->operand2;
+    return op->mode == ADDR_IMMEDIATE ? op->value.immediate : op->value.address % MAX_DATA_MEMORY_SIZE;
+}
+
+static void set_jump_target(instruction_t *instr, int32_t target) {
+    operand_t *op = instr->opcode == OP_JMP ? &instr->operand1 : &instr->operand2;
+    if (op->mode == ADDR_IMMEDIATE) {
+        op->value.immediate = target;
+    } else {
+        op->value.address = target;
+    }
+}
+
+static flow_t instruction_flow(const instruction_t *instr) {
+    switch (instr->opcode) {
+        case OP_JMP:
+            return is_static_target(&instr->operand1) ? FLOW_JUMP : FLOW_COMPUTED;
+        case OP_TJZ:
+        case OP_TJN:
+        case OP_TJP:
+            return is_static_target(&instr->operand2) ? FLOW_BRANCH : FLOW_COMPUTED;
+        case OP_HLT:
+            return FLOW_STOP;
+        default:
+            return FLOW_NEXT;
+    }
+}
+
+static effect_t instruction_effect(const instruction_t *instr) {
+    effect_t e = { 0, 0, 0, false };
+    const operand_t *op1 = &instr->operand1;
+    const operand_t *op2 = &instr->operand2;
+
+    switch (instr->opcode) {
+        case OP_NOP:
+            e.pure = true;
+            return e;
+
+        case OP_HLT:
+        case OP_IRET:
+        case OP_EI:
+        case OP_DI:
+            return e;
+
+        case OP_MOV:
+        case OP_LEA:
+            if (!is_reg(op1)) break;
+            e.pure = true;
+            if (instr->opcode == OP_LEA && op2->mode == ADDR_INDIRECT) {
+                return e;   // The CPU ignores LEA with an indirect operand
+            }
+            e.reads = operand_reads(op2);
+            e.writes = reg_bit(op1);
+            e.clobbers = e.writes;
+            return e;
+
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_TAND:
+        case OP_TOR:
+        case OP_TCMPR:
+            if (!is_reg(op1) || !is_reg(op2)) break;
+            e.pure = true;
+            e.reads = reg_bit(op1) | reg_bit(op2);
+            e.writes = reg_bit(op1);
+            e.clobbers = e.writes;
+            return e;
+
+        case OP_TNOT:
+        case OP_NEG:
+        case OP_TSIGN:
+        case OP_TABS:
+        case OP_TSHL3:
+        case OP_TSHR3:
+            if (!is_reg(op1)) break;
+            e.pure = true;
+            e.reads = reg_bit(op1);
+            e.writes = reg_bit(op1);
+            e.clobbers = e.writes;
+            return e;
+
+        case OP_JMP:
+        case OP_IRQ:
+            e.reads = operand_reads(op1);
+            return e;
+
+        case OP_TJZ:
+        case OP_TJN:
+        case OP_TJP:
+            if (!is_reg(op1)) break;
+            e.reads = reg_bit(op1) | operand_reads(op2);
+            return e;
+
+        case OP_LD:
+            if (!is_reg(op1)) break;
+            e.reads = operand_reads(op2);
+            e.writes = reg_bit(op1);
+            e.clobbers = e.writes;
+            return e;
+
+        case OP_ST:
+            if (!is_reg(op1)) break;
+            e.reads = reg_bit(op1) | operand_reads(op2);
+            return e;
+
+        case OP_TOPEN:
+        case OP_TWRITE:
+        case OP_TSEEK:
+        case OP_TCLOSE:
+            e.reads = operand_reads(op1) | (instr->has_operand2 ? operand_reads(op2) : 0);
+            e.writes = 1u << REG_A;
+            e.clobbers = e.writes;
+            return e;
+
+        case OP_TREAD:
+            // The target register is only written when the read succeeds
+            e.reads = operand_reads(op1);
+            e.writes = 1u << REG_A;
+            e.clobbers = e.writes | (is_reg(op2) ? reg_bit(op2) : 0);
+            return e;
+
+        case OP_TBREAD:
+        case OP_TBWRITE:
+            e.reads = operand_reads(op1) | operand_reads(op2) | (1u << REG_C);
+            e.writes = 1u << REG_A;
+            e.clobbers = e.writes;
+            return e;
+
+        case OP_CAS:
+        case OP_TCAS:
+            // A is left alone for MMIO addresses
+            if (!is_reg(op1)) break;
+            e.reads = reg_bit(op1) | operand_reads(op2) | (1u << REG_A);
+            e.clobbers = 1u << REG_A;
+            return e;
+
+        case OP_XADD:
+            if (!is_reg(op1)) break;
+            e.reads = reg_bit(op1) | operand_reads(op2);
+            e.clobbers = reg_bit(op1);
+            return e;
+
+        case OP_CID:
+            // The core ID is only known at run time, so never fold it
+            if (!is_reg(op1)) break;
+            e.pure = true;
+            e.writes = reg_bit(op1);
+            e.clobbers = e.writes;
+            return e;
+    }
+
+    // Register operand in another mode: the CPU reads the union as a
+    // register number, so assume the worst
+    e.reads = REGS_ALL;
+    e.writes = 0;
+    e.clobbers = REGS_ALL;
+    e.pure = false;
+    return e;
+}
+
+// Value of an operand as the CPU resolves it, if known
+static bool operand_value(const reg_state_t *s, const operand_t *op, int32_t *value) {
+    switch (op->mode) {
+        case ADDR_IMMEDIATE:
+            *value = op->value.immediate;
+            return true;
+        case ADDR_REGISTER:
+            *value = s->value[op->value.reg];
+            return s->known[op->value.reg];
+        case ADDR_DIRECT:
+            *value = op->value.address % MAX_DATA_MEMORY_SIZE;
+            return true;
+        case ADDR_INDIRECT:
+            *value = s->value[op->value.reg] % MAX_DATA_MEMORY_SIZE;
+            return s->known[op->value.reg];
+    }
+    return false;
+}
+
+// Result of a pure instruction that writes a register, if known
+static bool evaluate(const instruction_t *instr, const reg_state_t *s, int32_t *result) {
+    int32_t a = 0, b = 0;
+    bool known_a, known_b;
+
+    switch (instr->opcode) {
+        case OP_MOV:
+            return operand_value(s, &instr->operand2, result);
+
+        case OP_LEA:
+            if (!operand_value(s, &instr->operand2, &a)) return false;
+            *result = a % MAX_DATA_MEMORY_SIZE;
+            return true;
+
+        case OP_MUL:
+            // Zero times anything is zero
+            known_a = operand_value(s, &instr->operand1, &a);
+            known_b = operand_value(s, &instr->operand2, &b);
+            if ((known_a && a == 0) || (known_b && b == 0)) {
+                *result = 0;
+                return true;
+            }
+            if (!known_a || !known_b) return false;
+            *result = (int32_t)((uint32_t)a * (uint32_t)b);
+            return true;
+
+        case OP_ADD:
+        case OP_SUB:
+        case OP_DIV:
+        case OP_TAND:
+        case OP_TOR:
+        case OP_TCMPR:
+            if (!operand_value(s, &instr->operand1, &a) || !operand_value(s, &instr->operand2, &b)) {
+                return false;
+            }
+            switch (instr->opcode) {
+                case OP_ADD:   *result = (int32_t)((uint32_t)a + (uint32_t)b); break;
+                case OP_SUB:   *result = (int32_t)((uint32_t)a - (uint32_t)b); break;
+                case OP_TAND:  *result = trit_and(a, b); break;
+                case OP_TOR:   *result = trit_or(a, b); break;
+                case OP_TCMPR: *result = tcmpr(a, b); break;
+                default:
+                    // Leave the one overflowing division to the CPU
+                    if (b == -1 && a == INT32_MIN) return false;
+                    *result = b == 0 ? 0 : a / b;
+                    break;
+            }
+            return true;
+
+        case OP_TNOT:
+        case OP_NEG:
+        case OP_TSIGN:
+        case OP_TABS:
+        case OP_TSHL3:
+        case OP_TSHR3:
+            if (!operand_value(s, &instr->operand1, &a)) return false;
+            switch (instr->opcode) {
+                case OP_TNOT:  *result = trit_not(a); break;
+                case OP_NEG:   *result = (int32_t)(0u - (uint32_t)a); break;
+                case OP_TSIGN: *result = tsign(a); break;
+                case OP_TABS:  *result = tabs(a); break;
+                case OP_TSHL3: *result = tshl3(a); break;
+                default:       *result = tshr3(a); break;
+            }
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+// Update known registers after an instruction
+static void transfer(const instruction_t *instr, reg_state_t *s) {
+    effect_t e = instruction_effect(instr);
+    int32_t result;
+    bool known = e.pure && e.writes && evaluate(instr, s, &result);
+
+    for (int r = 0; r < REG_COUNT; r++) {
+        if (e.clobbers & (1u << r)) s->known[r] = false;
+    }
+    if (known) {
+        ternuino_register_t reg = instr->operand1.value.reg;
+        s->known[reg] = true;
+        s->value[reg] = result;
+    }
+}
+
+// Merge an incoming state into a block's entry state. Returns true if the
+// entry state changed.
+static bool merge_state(reg_state_t *into, const reg_state_t *from) {
+    if (!into->visited) {
+        *into = *from;
+        into->visited = true;
+        return true;
+    }
+
+    bool changed = false;
+    for (int r = 0; r < REG_COUNT; r++) {
+        if (into->known[r] && (!from->known[r] || from->value[r] != into->value[r])) {
+            into->known[r] = false;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+static bool is_entry(const pass_t *p, int32_t address) {
+    if (address == 0) return true;
+    for (int v = 0; v < MAX_IRQ_VECTORS; v++) {
+        if (p->irq_handlers[v] == address) return true;
+    }
+    return false;
+}
+
+// Split the program into basic blocks and link them
+static bool build_cfg(pass_t *p) {
+    bool *leader = ternuino_calloc((size_t)p->size + 1, sizeof(bool));
+    if (!leader) return false;
+
+    leader[0] = true;
+    for (int32_t i = 0; i < p->size; i++) {
+        flow_t flow = instruction_flow(&p->program[i]);
+        if (is_entry(p, i)) leader[i] = true;
+        if (flow == FLOW_JUMP || flow == FLOW_BRANCH) {
+            int32_t target = jump_target(&p->program[i]);
+            if (target >= 0 && target < p->size) leader[target] = true;
+        }
+        if (flow != FLOW_NEXT) leader[i + 1] = true;
+    }
+
+    p->block_count = 0;
+    for (int32_t i = 0; i < p->size; i++) {
+        if (leader[i]) p->block_count++;
+    }
+
+    p->blocks = ternuino_calloc((size_t)p->block_count, sizeof(block_t));
+    if (!p->blocks) {
+        ternuino_free(leader);
+        return false;
+    }
+
+    int32_t b = -1;
+    for (int32_t i = 0; i < p->size; i++) {
+        if (leader[i]) {
+            b++;
+            p->blocks[b].start = i;
+        }
+        p->blocks[b].end = i + 1;
+        p->block_of[i] = b;
+    }
+    ternuino_free(leader);
+
+    for (b = 0; b < p->block_count; b++) {
+        block_t *block = &p->blocks[b];
+        const instruction_t *last = &p->program[block->end - 1];
+        flow_t flow = instruction_flow(last);
+        int n = 0;
+
+        block->succ[0] = block->succ[1] = -1;
+        if (flow == FLOW_JUMP || flow == FLOW_BRANCH) {
+            int32_t target = jump_target(last);
+            if (target >= 0 && target < p->size) {
+                block->succ[n++] = p->block_of[target];
+            } else {
+                block->exits = true;
+            }
+        }
+        if (flow == FLOW_NEXT || flow == FLOW_BRANCH) {
+            if (block->end < p->size) {
+                block->succ[n++] = p->block_of[block->end];
+            } else {
+                block->exits = true;
+            }
+        }
+        if (flow == FLOW_STOP) block->exits = true;
+    }
+
+    return true;
+}
+
+static void mark_reachable(pass_t *p, int32_t *stack) {
+    int32_t top = 0;
+
+    for (int32_t i = 0; i < p->size; i++) {
+        if (is_entry(p, i) && !p->blocks[p->block_of[i]].reachable) {
+            p->blocks[p->block_of[i]].reachable = true;
+            stack[top++] = p->block_of[i];
+        }
+    }
+
+    while (top > 0) {
+        block_t *block = &p->blocks[stack[--top]];
+        for (int s = 0; s < 2; s++) {
+            int32_t next = block->succ[s];
+            if (next >= 0 && !p->blocks[next].reachable) {
+                p->blocks[next].reachable = true;
+                stack[top++] = next;
+            }
+        }
+    }
+}
+
+// Forward dataflow: known register values on entry to each block
+static void propagate_constants(pass_t *p, int32_t *worklist) {
+    bool *queued = ternuino_calloc((size_t)p->block_count, sizeof(bool));
+    if (!queued) return;
+
+    int32_t count = 0;
+    for (int32_t b = 0; b < p->block_count; b++) {
+        block_t *block = &p->blocks[b];
+        if (!block->reachable || !is_entry(p, block->start)) continue;
+
+        // Registers start at zero; a handler can be entered with anything
+        reg_state_t entry;
+        memset(&entry, 0, sizeof(entry));
+        bool handler = false;
+        for (int v = 0; v < MAX_IRQ_VECTORS; v++) {
+            if (p->irq_handlers[v] == block->start) handler = true;
+        }
+        for (int r = 0; r < REG_COUNT; r++) {
+            entry.known[r] = !handler;
+        }
+        merge_state(&block->in, &entry);
+        worklist[count++] = b;
+        queued[b] = true;
+    }
+
+    while (count > 0) {
+        int32_t b = worklist[--count];
+        block_t *block = &p->blocks[b];
+        queued[b] = false;
+
+        reg_state_t s = block->in;
+        for (int32_t i = block->start; i < block->end; i++) {
+            transfer(&p->program[i], &s);
+        }
+
+        for (int n = 0; n < 2; n++) {
+            int32_t next = block->succ[n];
+            if (next >= 0 && merge_state(&p->blocks[next].in, &s) && !queued[next]) {
+                worklist[count++] = next;
+                queued[next] = true;
+            }
+        }
+    }
+
+    ternuino_free(queued);
+}
+
+static void make_const_load(instruction_t *instr, ternuino_register_t reg, int32_t value) {
+    memset(instr, 0, sizeof(*instr));
+    instr->opcode = OP_MOV;
+    instr->operand1.mode = ADDR_REGISTER;
+    instr->operand1.value.reg = reg;
+    instr->operand2.mode = ADDR_IMMEDIATE;
+    instr->operand2.value.immediate = value;
+    instr->has_operand1 = true;
+    instr->has_operand2 = true;
+}
+
+static bool is_const_load(const instruction_t *instr, int32_t value) {
+    return instr->opcode == OP_MOV && instr->operand2.mode == ADDR_IMMEDIATE &&
+           instr->operand2.value.immediate == value;
+}
+
+// Rewrite instructions whose inputs are known, walking each block from
+// its entry state
+static bool fold_constants(pass_t *p, optimize_report_t *report) {
+    bool changed = false;
+
+    for (int32_t b = 0; b < p->block_count; b++) {
+        block_t *block = &p->blocks[b];
+        if (!block->reachable || !block->in.visited) continue;
+
+        reg_state_t s = block->in;
+        for (int32_t i = block->start; i < block->end; i++) {
+            instruction_t *instr = &p->program[i];
+            effect_t e = instruction_effect(instr);
+            reg_state_t before = s;
+            transfer(instr, &s);
+
+            if (e.pure && !e.writes) {
+                p->removed[i] = true;
+                report->redundant++;
+                changed = true;
+                continue;
+            }
+
+            if (e.pure) {
+                ternuino_register_t dest = instr->operand1.value.reg;
+                int32_t result;
+                if (evaluate(instr, &before, &result)) {
+                    if (before.known[dest] && before.value[dest] == result) {
+                        p->removed[i] = true;
+                        report->redundant++;
+                        changed = true;
+                    } else if (!is_const_load(instr, result)) {
+                        make_const_load(instr, dest, result);
+                        report->folded++;
+                        changed = true;
+                    }
+                    continue;
+                }
+
+                // Identities with one known operand
+                int32_t a = 0, b2 = 0;
+                bool known_a = instr->has_operand1 && operand_value(&before, &instr->operand1, &a);
+                bool known_b = instr->has_operand2 && operand_value(&before, &instr->operand2, &b2);
+                if (((instr->opcode == OP_ADD || instr->opcode == OP_SUB) && known_b && b2 == 0) ||
+                    ((instr->opcode == OP_MUL || instr->opcode == OP_DIV) && known_b && b2 == 1)) {
+                    p->removed[i] = true;
+                    report->redundant++;
+                    changed = true;
+                } else if (instr->opcode == OP_ADD && known_a && a == 0) {
+                    instr->opcode = OP_MOV;
+                    report->folded++;
+                    changed = true;
+                }
+                continue;
+            }
+
+            // Conditional branches on a known register
+            if (instruction_flow(instr) == FLOW_BRANCH && before.known[instr->operand1.value.reg]) {
+                int32_t v = before.value[instr->operand1.value.reg];
+                bool taken = (instr->opcode == OP_TJZ && v == 0) ||
+                             (instr->opcode == OP_TJN && v < 0) ||
+                             (instr->opcode == OP_TJP && v > 0);
+                if (taken) {
+                    instr->opcode = OP_JMP;
+                    instr->operand1 = instr->operand2;
+                    instr->has_operand2 = false;
+                    memset(&instr->operand2, 0, sizeof(instr->operand2));
+                } else {
+                    p->removed[i] = true;
+                }
+                report->branches_resolved++;
+                changed = true;
+            }
+        }
+    }
+
+    return changed;
+}
+
+// Backward liveness; a pure write nobody reads is removed
+static bool remove_dead_stores(pass_t *p, optimize_report_t *report) {
+    bool changed = true;
+
+    // Registers are observable wherever control leaves the program
+    while (changed) {
+        changed = false;
+        for (int32_t b = p->block_count - 1; b >= 0; b--) {
+            block_t *block = &p->blocks[b];
+            uint8_t live = block->exits ? REGS_ALL : 0;
+            for (int n = 0; n < 2; n++) {
+                if (block->succ[n] < 0) continue;
+                const block_t *next = &p->blocks[block->succ[n]];
+                uint8_t live_in = next->live_out;
+                for (int32_t i = next->end - 1; i >= next->start; i--) {
+                    if (p->removed[i]) continue;
+                    effect_t e = instruction_effect(&p->program[i]);
+                    live_in = (uint8_t)((live_in & ~e.writes) | e.reads);
+                }
+                live |= live_in;
+            }
+            if (live != block->live_out) {
+                block->live_out = live;
+                changed = true;
+            }
+        }
+    }
+
+    bool removed_any = false;
+    for (int32_t b = 0; b < p->block_count; b++) {
+        block_t *block = &p->blocks[b];
+        if (!block->reachable) continue;
+
+        uint8_t live = block->live_out;
+        for (int32_t i = block->end - 1; i >= block->start; i--) {
+            if (p->removed[i]) continue;
+            effect_t e = instruction_effect(&p->program[i]);
+            if (e.pure && e.writes && !(e.writes & live)) {
+                p->removed[i] = true;
+                report->dead_stores++;
+                removed_any = true;
+                continue;
+            }
+            live = (uint8_t)((live & ~e.writes) | e.reads);
+        }
+    }
+
+    return removed_any;
+}
+
+// First instruction at or after address that survives this pass
+static int32_t next_kept(const pass_t *p, int32_t address) {
+    while (address >= 0 && address < p->size && p->removed[address]) address++;
+    return address;
+}
+
+static bool thread_jumps(pass_t *p, optimize_report_t *report) {
+    bool changed = false;
+
+    for (int32_t i = 0; i < p->size; i++) {
+        instruction_t *instr = &p->program[i];
+        flow_t flow = instruction_flow(instr);
+        if (p->removed[i] || (flow != FLOW_JUMP && flow != FLOW_BRANCH)) continue;
+
+        // Follow a chain of unconditional jumps, stopping at cycles
+        int32_t target = jump_target(instr);
+        int32_t final = target;
+        for (int32_t hops = 0; hops < p->size; hops++) {
+            int32_t at = next_kept(p, final);
+            if (at < 0 || at >= p->size || instruction_flow(&p->program[at]) != FLOW_JUMP || at == i) break;
+            final = jump_target(&p->program[at]);
+        }
+        if (final != target) {
+            set_jump_target(instr, final);
+            report->jumps_threaded++;
+            changed = true;
+        }
+
+        if (next_kept(p, final) == next_kept(p, i + 1) && final >= 0 && final <= p->size) {
+            p->removed[i] = true;
+            report->jumps_removed++;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+// Close up removed instructions and remap every code address
+static void compact(pass_t *p, assembler_t *asm_state) {
+    int32_t *new_index = ternuino_alloc(((size_t)p->size + 1) * sizeof(int32_t));
+    if (!new_index) return;
+
+    int32_t kept = 0;
+    for (int32_t i = 0; i < p->size; i++) {
+        new_index[i] = kept;
+        if (!p->removed[i]) kept++;
+    }
+    new_index[p->size] = kept;
+
+    for (int32_t i = 0; i < p->size; i++) {
+        if (p->removed[i]) continue;
+
+        instruction_t *instr = &p->program[i];
+        flow_t flow = instruction_flow(instr);
+        if (flow == FLOW_JUMP || flow == FLOW_BRANCH) {
+            int32_t target = jump_target(instr);
+            if (target >= 0 && target <= p->size) set_jump_target(instr, new_index[target]);
+        }
+        p->program[new_index[i]] = *instr;
+    }
+
+    for (int v = 0; v < MAX_IRQ_VECTORS; v++) {
+        int32_t handler = asm_state->irq_handlers[v];
+        if (handler >= 0 && handler <= p->size) asm_state->irq_handlers[v] = new_index[handler];
+    }
+
+    for (int32_t l = 0; l < asm_state->label_capacity; l++) {
+        label_t *label = &asm_state->labels[l];
+        if (label->used && !label->is_data_label && !label->is_extern &&
+            label->address >= 0 && label->address <= p->size) {
+            label->address = new_index[label->address];
+        }
+    }
+
+    p->size = kept;
+    ternuino_free(new_index);
+}
+
+void assembler_optimize(assembler_t *asm_state, instruction_t *program, int32_t *program_size,
+                        optimize_report_t *report) {
+    memset(report, 0, sizeof(*report));
+    report->original_size = *program_size;
+    report->final_size = *program_size;
+
+    if (asm_state->relocatable) {
+        report->skipped = "relocatable objects";
+        return;
+    }
+
+    bool track_registers = true;
+    for (int32_t i = 0; i < *program_size; i++) {
+        if (instruction_flow(&program[i]) == FLOW_COMPUTED) {
+            report->skipped = "computed jumps";
+            return;
+        }
+        if (program[i].opcode == OP_EI) track_registers = false;
+    }
+
+    pass_t p;
+    memset(&p, 0, sizeof(p));
+    p.program = program;
+    p.size = *program_size;
+    p.irq_handlers = asm_state->irq_handlers;
+    p.removed = ternuino_calloc((size_t)p.size + 1, sizeof(bool));
+    p.block_of = ternuino_calloc((size_t)p.size + 1, sizeof(int32_t));
+    int32_t *scratch = ternuino_calloc((size_t)p.size + 1, sizeof(int32_t));
+    if (!p.removed || !p.block_of || !scratch) {
+        report->skipped = "out of memory";
+        ternuino_free(p.removed);
+        ternuino_free(p.block_of);
+        ternuino_free(scratch);
+        return;
+    }
+
+    bool changed = p.size > 0;
+    while (changed && report->passes < OPTIMIZE_MAX_PASSES) {
+        changed = false;
+        report->passes++;
+        memset(p.removed, 0, ((size_t)p.size + 1) * sizeof(bool));
+        if (!build_cfg(&p)) break;
+
+        mark_reachable(&p, scratch);
+        for (int32_t b = 0; b < p.block_count; b++) {
+            if (p.blocks[b].reachable) continue;
+            for (int32_t i = p.blocks[b].start; i < p.blocks[b].end; i++) {
+                p.removed[i] = true;
+                report->unreachable++;
+                changed = true;
+            }
+        }
+
+        if (track_registers) {
+            propagate_constants(&p, scratch);
+            changed |= fold_constants(&p, report);
+            changed |= remove_dead_stores(&p, report);
+        } else {
+            // No-ops are safe to drop even when interrupts may arrive
+            for (int32_t i = 0; i < p.size; i++) {
+                effect_t e = instruction_effect(&p.program[i]);
+                if (!p.removed[i] && e.pure && !e.writes) {
+                    p.removed[i] = true;
+                    report->redundant++;
+                    changed = true;
+                }
+            }
+        }
+        changed |= thread_jumps(&p, report);
+
+        compact(&p, asm_state);
+        ternuino_free(p.blocks);
+        p.blocks = NULL;
+    }
+
+    *program_size = p.size;
+    report->final_size = p.size;
+    ternuino_free(p.removed);
+    ternuino_free(p.block_of);
+    ternuino_free(scratch);
+}
+
+void print_optimize_report(const optimize_report_t *report) {
+    if (report->skipped) {
+        printf("Optimizer skipped: %s\n", report->skipped);
+        return;
+    }
+
+    printf("Optimized %d -> %d instructions in %d passes: %d unreachable, %d folded, %d redundant, "
+           "%d dead stores, %d branches resolved, %d jumps threaded, %d jumps removed\n",
+           report->original_size, report->final_size, report->passes, report->unreachable,
+           report->folded, report->redundant, report->dead_stores, report->branches_resolved,
+           report->jumps_threaded, report->jumps_removed);
+}
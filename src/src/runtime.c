@@ -0,0 +1,82 @@
+#include "runtime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+
+// Embedders own stdout, so the default keeps diagnostics off it
+static void print_log(ternuino_log_level_t level, const char *message, void *user) {
+    (void)level;
+    (void)user;
+    fprintf(stderr, "%s\n", message);
+}
+
+static void *default_alloc(size_t size, void *user) {
+    (void)user;
+    return malloc(size);
+}
+
+static void *default_resize(void *ptr, size_t size, void *user) {
+    (void)user;
+    return realloc(ptr, size);
+}
+
+static void default_release(void *ptr, void *user) {
+    (void)user;
+    free(ptr);
+}
+
+static ternuino_log_fn log_hook = print_log;
+static void *log_user = NULL;
+static ternuino_allocator_t allocator = { default_alloc, default_resize, default_release, NULL };
+
+void ternuino_set_log(ternuino_log_fn log, void *user) {
+    log_hook = log ? log : print_log;
+    log_user = log ? user : NULL;
+}
+
+void ternuino_set_allocator(const ternuino_allocator_t *hooks) {
+    if (hooks && hooks->alloc && hooks->resize && hooks->release) {
+        allocator = *hooks;
+    } else {
+        allocator.alloc = default_alloc;
+        allocator.resize = default_resize;
+        allocator.release = default_release;
+        allocator.user = NULL;
+    }
+}
+
+void ternuino_log(ternuino_log_level_t level, const char *format, ...) {
+    char message[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    log_hook(level, message, log_user);
+}
+
+void* ternuino_alloc(size_t size) {
+    return allocator.alloc(size, allocator.user);
+}
+
+void* ternuino_calloc(size_t count, size_t size) {
+    if (size && count > SIZE_MAX / size) return NULL;
+
+    void *ptr = allocator.alloc(count * size, allocator.user);
+    if (ptr) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+void* ternuino_realloc(void *ptr, size_t size) {
+    if (!ptr) return allocator.alloc(size, allocator.user);
+    return allocator.resize(ptr, size, allocator.user);
+}
+
+void ternuino_free(void *ptr) {
+    if (ptr) {
+        allocator.release(ptr, allocator.user);
+    }
+}
@@ -0,0 +1,360 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "scheduler.h"
+#include "devices.h"
+#include "runtime.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <poll.h>
+#endif
+
+// One CPU and where it is: queued, running, parked or stopped
+typedef struct {
+    ternuino_t *cpu;
+    uint64_t end;           // Cycle count to stop at, UINT64_MAX for no limit
+    stop_reason_t reason;
+    int32_t parked_at;      // Position in the parked list, -1 if not parked
+} sched_entry_t;
+
+struct scheduler_s {
+    sched_entry_t *entries;
+    int32_t count;
+    int32_t capacity;
+    int32_t *queue;         // Ring of runnable entries, capacity long
+    int32_t queue_first;
+    int32_t queue_count;
+    int32_t *parked;        // Entries waiting for a device
+    int32_t parked_count;
+    int32_t live;           // Entries that have not stopped
+    int32_t running;        // Entries a thread is running a slice of
+    int32_t turns;          // Slices run since the parked entries were checked
+    bool checking;          // A thread is checking the parked entries
+    int32_t idle_ms;        // Time every live entry has spent parked without a descriptor
+    bool stalled;           // scheduler_run gave up on the parked entries
+    int32_t threads;
+    uint64_t slice;
+    engine_t engine;
+#ifndef _WIN32
+    struct pollfd *fds;     // Descriptors the parked entries wait for, capacity long
+    int32_t *fd_entries;    // Entry each descriptor belongs to
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+#endif
+};
+
+// Without threads (Windows) the caller is the only one taking the lock
+static void sched_lock(scheduler_t *sched) {
+#ifndef _WIN32
+    pthread_mutex_lock(&sched->lock);
+#else
+    (void)sched;
+#endif
+}
+
+static void sched_unlock(scheduler_t *sched) {
+#ifndef _WIN32
+    pthread_mutex_unlock(&sched->lock);
+#else
+    (void)sched;
+#endif
+}
+
+static void sched_wake(scheduler_t *sched) {
+#ifndef _WIN32
+    pthread_cond_broadcast(&sched->cond);
+#else
+    (void)sched;
+#endif
+}
+
+scheduler_t* scheduler_create(int32_t threads, uint64_t slice, engine_t engine) {
+    scheduler_t *sched = ternuino_calloc(1, sizeof(scheduler_t));
+    if (!sched) return NULL;
+
+#ifdef _WIN32
+    (void)threads;
+    sched->threads = 1;
+#else
+    sched->threads = threads > 0 ? threads : 1;
+    pthread_mutex_init(&sched->lock, NULL);
+    pthread_cond_init(&sched->cond, NULL);
+#endif
+    sched->slice = slice > 0 ? slice : SCHEDULER_SLICE_CYCLES;
+    sched->engine = engine;
+    return sched;
+}
+
+void scheduler_destroy(scheduler_t *sched) {
+    if (!sched) return;
+
+#ifndef _WIN32
+    pthread_cond_destroy(&sched->cond);
+    pthread_mutex_destroy(&sched->lock);
+    ternuino_free(sched->fds);
+    ternuino_free(sched->fd_entries);
+#endif
+    ternuino_free(sched->entries);
+    ternuino_free(sched->queue);
+    ternuino_free(sched->parked);
+    ternuino_free(sched);
+}
+
+// Double every per-entry array. Arrays that grew before a later one
+// failed just stay larger than capacity.
+static bool grow(scheduler_t *sched) {
+    int32_t capacity = sched->capacity ? sched->capacity * 2 : 64;
+
+    sched_entry_t *entries = ternuino_realloc(sched->entries, sizeof(sched_entry_t) * (size_t)capacity);
+    if (!entries) return false;
+    sched->entries = entries;
+
+    int32_t *queue = ternuino_realloc(sched->queue, sizeof(int32_t) * (size_t)capacity);
+    if (!queue) return false;
+    sched->queue = queue;
+
+    // Unwrap the run queue into the new space
+    for (int32_t i = sched->capacity; i < sched->queue_first + sched->queue_count; i++) {
+        queue[i] = queue[i - sched->capacity];
+    }
+
+    int32_t *parked = ternuino_realloc(sched->parked, sizeof(int32_t) * (size_t)capacity);
+    if (!parked) return false;
+    sched->parked = parked;
+
+#ifndef _WIN32
+    struct pollfd *fds = ternuino_realloc(sched->fds, sizeof(struct pollfd) * (size_t)capacity);
+    if (!fds) return false;
+    sched->fds = fds;
+
+    int32_t *fd_entries = ternuino_realloc(sched->fd_entries, sizeof(int32_t) * (size_t)capacity);
+    if (!fd_entries) return false;
+    sched->fd_entries = fd_entries;
+#endif
+
+    sched->capacity = capacity;
+    return true;
+}
+
+static void enqueue(scheduler_t *sched, int32_t index) {
+    sched->queue[(sched->queue_first + sched->queue_count) % sched->capacity] = index;
+    sched->queue_count++;
+}
+
+static int32_t dequeue(scheduler_t *sched) {
+    int32_t index = sched->queue[sched->queue_first];
+    sched->queue_first = (sched->queue_first + 1) % sched->capacity;
+    sched->queue_count--;
+    return index;
+}
+
+static void park(scheduler_t *sched, int32_t index) {
+    sched->entries[index].parked_at = sched->parked_count;
+    sched->parked[sched->parked_count++] = index;
+}
+
+// Move a parked entry to the run queue; the last parked entry takes its place
+static void unpark(scheduler_t *sched, int32_t index) {
+    int32_t at = sched->entries[index].parked_at;
+    int32_t last = sched->parked[--sched->parked_count];
+    sched->parked[at] = last;
+    sched->entries[last].parked_at = at;
+    sched->entries[index].parked_at = -1;
+    enqueue(sched, index);
+}
+
+int32_t scheduler_add(scheduler_t *sched, ternuino_t *cpu, uint64_t max_cycles) {
+    if (!sched || !cpu) return -1;
+    if (sched->count == sched->capacity && !grow(sched)) {
+        ternuino_log(TERNUINO_LOG_ERROR, "Error: Out of memory for %d CPUs", sched->count + 1);
+        return -1;
+    }
+
+    int32_t index = sched->count++;
+    sched_entry_t *entry = &sched->entries[index];
+    entry->cpu = cpu;
+    entry->end = UINT64_MAX;
+    if (max_cycles > 0 && max_cycles < UINT64_MAX - cpu->cycles) {
+        entry->end = cpu->cycles + max_cycles;
+    }
+    entry->reason = STOP_CYCLE_LIMIT;
+    entry->parked_at = -1;
+
+    cpu->park_blocked = true;
+    sched->live++;
+    enqueue(sched, index);
+    return index;
+}
+
+// Queue the parked entries whose devices have input. If none has, wait up
+// to timeout milliseconds (unlocked) for one of their descriptors. Called
+// by the one thread that set checking. Returns the number queued;
+// *waitable says whether any entry is waiting for a descriptor.
+static int32_t check_parked(scheduler_t *sched, int timeout, bool *waitable) {
+    int32_t woken = 0;
+    int32_t nfds = 0;
+
+    for (int32_t i = 0; i < sched->parked_count; ) {
+        int32_t index = sched->parked[i];
+        device_t *device = sched->entries[index].cpu->blocked_on;
+        int fd = -1;
+        if (!device || device->input_ready(device, &fd)) {
+            unpark(sched, index);
+            woken++;
+            continue;
+        }
+#ifndef _WIN32
+        if (fd >= 0) {
+            sched->fds[nfds].fd = fd;
+            sched->fds[nfds].events = POLLIN;
+            sched->fds[nfds].revents = 0;
+            sched->fd_entries[nfds++] = index;
+        }
+#else
+        if (fd >= 0) {
+            unpark(sched, index); // Without poll() the read just tries again
+            woken++;
+            continue;
+        }
+#endif
+        i++;
+    }
+    *waitable = nfds > 0;
+
+#ifndef _WIN32
+    if (woken > 0) timeout = 0;
+    if (nfds > 0 || timeout > 0) {
+        // Only the checking thread unparks, so the entries stay put
+        sched_unlock(sched);
+        int ready = poll(sched->fds, (nfds_t)nfds, timeout);
+        sched_lock(sched);
+        for (int32_t i = 0; ready > 0 && i < nfds; i++) {
+            if (sched->fds[i].revents) {
+                unpark(sched, sched->fd_entries[i]);
+                woken++;
+            }
+        }
+    }
+#else
+    (void)timeout;
+#endif
+    return woken;
+}
+
+static void scheduler_work(scheduler_t *sched) {
+    sched_lock(sched);
+    for (;;) {
+        if (sched->queue_count > 0) {
+            // Once per pass over the active entries, see whether parked
+            // ones can go again
+            if (sched->parked_count > 0 && !sched->checking &&
+                ++sched->turns >= sched->live - sched->parked_count) {
+                bool waitable;
+                sched->turns = 0;
+                sched->checking = true;
+                check_parked(sched, 0, &waitable);
+                sched->checking = false;
+                if (sched->queue_count == 0) continue; // Others took it during poll()
+            }
+
+            int32_t index = dequeue(sched);
+            sched_entry_t *entry = &sched->entries[index];
+            sched->running++;
+            sched->idle_ms = 0;
+            sched_unlock(sched);
+
+            uint64_t left = entry->end - entry->cpu->cycles;
+            stop_reason_t reason = ternuino_run_for(entry->cpu, sched->slice < left ? sched->slice : left,
+                                                    sched->engine);
+
+            sched_lock(sched);
+            sched->running--;
+            entry->reason = reason;
+            if (reason == STOP_BLOCKED) {
+                park(sched, index);
+            } else if (reason == STOP_CYCLE_LIMIT && entry->cpu->cycles < entry->end) {
+                enqueue(sched, index);
+            } else {
+                sched->live--;
+            }
+            sched_wake(sched);
+            continue;
+        }
+
+        if (sched->live == 0 || sched->stalled) break;
+
+        // Nothing to run: one thread waits for the parked entries, the
+        // others for it or for the running ones
+        if (sched->parked_count > 0 && !sched->checking) {
+            bool waitable;
+            sched->checking = true;
+            int32_t woken = check_parked(sched, SCHEDULER_POLL_MS, &waitable);
+            sched->checking = false;
+
+            // Descriptors wake their entries when input arrives, however
+            // long that takes; only the others can stall
+            if (woken > 0 || waitable || sched->running > 0 || sched->queue_count > 0) {
+                sched->idle_ms = 0;
+            } else if ((sched->idle_ms += SCHEDULER_POLL_MS) >= SCHEDULER_IDLE_MS) {
+                sched->stalled = true;
+            }
+            sched_wake(sched);
+            continue;
+        }
+
+#ifndef _WIN32
+        pthread_cond_wait(&sched->cond, &sched->lock);
+#endif
+    }
+    sched_wake(sched);
+    sched_unlock(sched);
+}
+
+#ifndef _WIN32
+static void* scheduler_thread(void *arg) {
+    scheduler_work((scheduler_t*)arg);
+    return NULL;
+}
+#endif
+
+void scheduler_run(scheduler_t *sched) {
+    if (!sched) return;
+
+    sched->stalled = false;
+    sched->idle_ms = 0;
+    sched->turns = 0;
+
+#ifndef _WIN32
+    // The calling thread is one of the workers
+    int32_t extra = sched->threads - 1;
+    pthread_t *threads = extra > 0 ? ternuino_alloc(sizeof(pthread_t) * (size_t)extra) : NULL;
+    int32_t started = 0;
+    while (threads && started < extra &&
+           pthread_create(&threads[started], NULL, scheduler_thread, sched) == 0) {
+        started++;
+    }
+#endif
+
+    scheduler_work(sched);
+
+#ifndef _WIN32
+    for (int32_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    ternuino_free(threads);
+#endif
+}
+
+int32_t scheduler_count(const scheduler_t *sched) {
+    return sched ? sched->count : 0;
+}
+
+ternuino_t* scheduler_cpu(const scheduler_t *sched, int32_t index) {
+    if (!sched || index < 0 || index >= sched->count) return NULL;
+    return sched->entries[index].cpu;
+}
+
+stop_reason_t scheduler_reason(const scheduler_t *sched, int32_t index) {
+    if (!sched || index < 0 || index >= sched->count) return STOP_CYCLE_LIMIT;
+    return sched->entries[index].reason;
+}
@@ -0,0 +1,730 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "server.h"
+#include "libternuino.h"
+#include "tbo.h"
+#include "runtime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef _WIN32
+
+bool server_run(const char *socket_path, const server_options_t *opts) {
+    (void)socket_path;
+    (void)opts;
+    ternuino_log(TERNUINO_LOG_ERROR, "Error: --serve needs Unix domain sockets and is not available on Windows.");
+    return false;
+}
+
+#else
+
+#include <pthread.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+
+#define SERVER_MAX_ID 64
+#define SERVER_MAX_HEADER 8192      // Longest request line, data= included
+#define SERVER_MAX_ERROR 256
+
+// A client connection. The reader thread and every job it queued hold a
+// reference; the last one closes the socket.
+typedef struct {
+    int fd;
+    pthread_mutex_t write_lock;     // Workers answer on the same socket
+    int refs;
+} connection_t;
+
+typedef enum {
+    JOB_SOURCE,
+    JOB_IMAGE
+} job_kind_t;
+
+typedef struct {
+    connection_t *conn;
+    char id[SERVER_MAX_ID];
+    job_kind_t kind;
+    uint8_t *payload;
+    size_t size;
+    uint64_t max_cycles;
+    uint32_t timeout_ms;
+    engine_t engine;
+    int32_t data_address;           // data= overlay
+    int32_t data_count;
+    int32_t data[MAX_DATA_MEMORY_SIZE];
+    double queued_at;
+} job_t;
+
+// Entries are found by hash but matched on the full payload, since a
+// client could craft a payload whose FNV hash collides with another's
+typedef struct {
+    uint64_t hash;                  // tbo_hash of kind and payload
+    job_kind_t kind;
+    uint8_t *payload;               // Taken from the job that stored it
+    size_t size;
+    uint64_t last_used;             // Cache clock, for eviction
+    bool used;
+    ternuino_image_t *image;        // Shared with the machines running it
+} cache_entry_t;
+
+typedef struct {
+    server_options_t opts;
+
+    // Bounded job queue
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    job_t **queue;
+    int capacity;
+    int head;
+    int count;
+    bool stopping;
+
+    // Assembled programs
+    pthread_mutex_t cache_lock;
+    cache_entry_t cache[SERVER_CACHE_SLOTS];
+    uint64_t cache_clock;
+} server_t;
+
+typedef struct {
+    server_t *server;
+    ternuino_vm_t *vm;              // Warm machine, reused for every job
+    ternuino_program_t program;     // Scratch for assembling on a cache miss
+} worker_t;
+
+typedef struct {
+    server_t *server;
+    connection_t *conn;
+} reader_args_t;
+
+// Buffered reads from a connection
+typedef struct {
+    int fd;
+    uint8_t buffer[4096];
+    size_t pos;
+    size_t len;
+} conn_reader_t;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+// Diagnostics of the job a worker is running, captured for its reply
+static pthread_key_t error_key;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void handle_stop(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+// Assembler errors of a job go into its reply; anything else to stderr
+static void server_log(ternuino_log_level_t level, const char *message, void *user) {
+    (void)user;
+    char *capture = pthread_getspecific(error_key);
+    if (capture) {
+        if (level == TERNUINO_LOG_ERROR && !capture[0]) {
+            snprintf(capture, SERVER_MAX_ERROR, "%s", message);
+        }
+        return;
+    }
+    fprintf(stderr, "%s\n", message);
+}
+
+static void connection_release(connection_t *conn) {
+    pthread_mutex_lock(&conn->write_lock);
+    bool last = --conn->refs == 0;
+    pthread_mutex_unlock(&conn->write_lock);
+
+    if (last) {
+        close(conn->fd);
+        pthread_mutex_destroy(&conn->write_lock);
+        ternuino_free(conn);
+    }
+}
+
+// Send a whole reply. A client that went away only loses its replies.
+static void connection_send(connection_t *conn, const char *text, size_t len) {
+    pthread_mutex_lock(&conn->write_lock);
+    while (len > 0) {
+        ssize_t sent = send(conn->fd, text, len, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) break;
+        text += sent;
+        len -= (size_t)sent;
+    }
+    pthread_mutex_unlock(&conn->write_lock);
+}
+
+// Queue a job, waiting while the queue is full. This is the backpressure:
+// a reader that waits here stops reading its socket.
+static bool queue_push(server_t *server, job_t *job) {
+    pthread_mutex_lock(&server->lock);
+    while (server->count == server->capacity && !server->stopping) {
+        pthread_cond_wait(&server->not_full, &server->lock);
+    }
+    bool queued = !server->stopping;
+    if (queued) {
+        server->queue[(server->head + server->count) % server->capacity] = job;
+        server->count++;
+        pthread_cond_signal(&server->not_empty);
+    }
+    pthread_mutex_unlock(&server->lock);
+    return queued;
+}
+
+// Next job, or NULL once the server stops
+static job_t* queue_pop(server_t *server) {
+    pthread_mutex_lock(&server->lock);
+    while (server->count == 0 && !server->stopping) {
+        pthread_cond_wait(&server->not_empty, &server->lock);
+    }
+    job_t *job = NULL;
+    if (server->count > 0 && !server->stopping) {
+        job = server->queue[server->head];
+        server->head = (server->head + 1) % server->capacity;
+        server->count--;
+        pthread_cond_signal(&server->not_full);
+    }
+    pthread_mutex_unlock(&server->lock);
+    return job;
+}
+
+static void job_free(job_t *job) {
+    connection_release(job->conn);
+    ternuino_free(job->payload);
+    ternuino_free(job);
+}
+
+static uint64_t job_hash(const job_t *job) {
+    uint8_t kind = (uint8_t)job->kind;
+    uint64_t hash = tbo_hash(job->payload, job->size);
+    return hash ^ tbo_hash(&kind, sizeof(kind));
+}
+
+static bool cache_matches(const cache_entry_t *entry, uint64_t hash, const job_t *job) {
+    return entry->used && entry->hash == hash && entry->kind == job->kind && entry->size == job->size &&
+           (job->size == 0 || memcmp(entry->payload, job->payload, job->size) == 0);
+}
+
+// Load a cached program image into the worker's machine. Returns false on a miss.
+static bool cache_load(server_t *server, uint64_t hash, const job_t *job, ternuino_vm_t *vm) {
+    bool hit = false;
+    pthread_mutex_lock(&server->cache_lock);
+    for (int i = 0; i < SERVER_CACHE_SLOTS; i++) {
+        cache_entry_t *entry = &server->cache[i];
+        if (cache_matches(entry, hash, job)) {
+            entry->last_used = ++server->cache_clock;
+            ternuino_vm_load_shared(vm, entry->image);
+            hit = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&server->cache_lock);
+    return hit;
+}
+
+// Keep a program image, evicting the least recently used one if the cache
+// is full. Machines still running an evicted image keep it alive. The
+// entry takes the job's payload.
+static void cache_store(server_t *server, uint64_t hash, job_t *job, ternuino_image_t *image) {
+    pthread_mutex_lock(&server->cache_lock);
+    cache_entry_t *slot = &server->cache[0];
+    for (int i = 0; i < SERVER_CACHE_SLOTS; i++) {
+        cache_entry_t *entry = &server->cache[i];
+        if (cache_matches(entry, hash, job)) {
+            slot = entry; // Another worker stored it first
+            break;
+        }
+        if (!entry->used || (slot->used && entry->last_used < slot->last_used)) {
+            slot = entry;
+        }
+    }
+    ternuino_free(slot->payload);
+    slot->hash = hash;
+    slot->kind = job->kind;
+    slot->payload = job->payload;
+    slot->size = job->size;
+    job->payload = NULL;
+    slot->last_used = ++server->cache_clock;
+    slot->used = true;
+    ternuino_image_retain(image);
+    ternuino_image_release(slot->image);
+    slot->image = image;
+    pthread_mutex_unlock(&server->cache_lock);
+}
+
+// Append to a reply buffer, dropping what does not fit
+static void reply_append(char *reply, size_t capacity, size_t *len, const char *format, ...) {
+    if (*len >= capacity) return;
+
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(reply + *len, capacity - *len, format, args);
+    va_end(args);
+    if (written > 0) {
+        *len += (size_t)written < capacity - *len ? (size_t)written : capacity - *len - 1;
+    }
+}
+
+static void reply_append_string(char *reply, size_t capacity, size_t *len, const char *text) {
+    reply_append(reply, capacity, len, "\"");
+    for (const unsigned char *c = (const unsigned char *)text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            reply_append(reply, capacity, len, "\\%c", *c);
+        } else if (*c < 0x20) {
+            reply_append(reply, capacity, len, "\\u%04x", *c);
+        } else {
+            reply_append(reply, capacity, len, "%c", *c);
+        }
+    }
+    reply_append(reply, capacity, len, "\"");
+}
+
+static void send_error(connection_t *conn, const char *id, const char *error) {
+    char reply[SERVER_MAX_ERROR + SERVER_MAX_ID * 2 + 64];
+    size_t len = 0;
+    reply_append(reply, sizeof(reply), &len, "{\"id\": ");
+    reply_append_string(reply, sizeof(reply), &len, id);
+    reply_append(reply, sizeof(reply), &len, ", \"status\": \"error\", \"error\": ");
+    reply_append_string(reply, sizeof(reply), &len, error);
+    reply_append(reply, sizeof(reply), &len, "}\n");
+    connection_send(conn, reply, len);
+}
+
+static const char* stop_reason_name(stop_reason_t reason) {
+    switch (reason) {
+        case STOP_HALTED:         return "halted";
+        case STOP_END_OF_PROGRAM: return "end_of_program";
+        case STOP_CYCLE_LIMIT:    return "cycle_limit";
+        case STOP_BLOCKED:        return "blocked";
+    }
+    return "unknown";
+}
+
+static void run_job(worker_t *worker, job_t *job) {
+    server_t *server = worker->server;
+    ternuino_vm_t *vm = worker->vm;
+    double started = now_seconds();
+
+    // Load the program, assembling it unless an identical payload was seen
+    uint64_t hash = job_hash(job);
+    bool cached = cache_load(server, hash, job, vm);
+    if (!cached) {
+        char error[SERVER_MAX_ERROR] = "";
+        pthread_setspecific(error_key, error);
+        bool loaded = job->kind == JOB_SOURCE
+            ? ternuino_program_assemble(&worker->program, (const char *)job->payload, job->size, job->id)
+            : ternuino_program_load_image_memory(&worker->program, job->payload, job->size);
+        pthread_setspecific(error_key, NULL);
+        if (!loaded) {
+            send_error(job->conn, job->id, error[0] ? error : "program did not load");
+            return;
+        }
+        ternuino_image_t *image = ternuino_program_share(&worker->program);
+        if (!image) {
+            send_error(job->conn, job->id, "out of memory");
+            return;
+        }
+        cache_store(server, hash, job, image);
+        ternuino_vm_load_shared(vm, image);
+        ternuino_image_release(image);
+    }
+    if (job->data_count > 0 && !ternuino_vm_write_data(vm, job->data_address, job->data, job->data_count)) {
+        send_error(job->conn, job->id, "data= is outside data memory");
+        return;
+    }
+
+    // Run in slices so the time limit is checked without a timer thread
+    uint64_t start_cycles = ternuino_vm_cycles(vm);
+    double deadline = job->timeout_ms ? started + job->timeout_ms / 1000.0 : 0;
+    bool timed_out = false;
+    stop_reason_t reason;
+    for (;;) {
+        uint64_t slice = SERVER_SLICE_CYCLES;
+        if (job->max_cycles) {
+            uint64_t left = job->max_cycles - (ternuino_vm_cycles(vm) - start_cycles);
+            if (left < slice) slice = left;
+        }
+        reason = slice ? ternuino_vm_run(vm, slice, job->engine) : STOP_CYCLE_LIMIT;
+        if (reason != STOP_CYCLE_LIMIT) break;
+        if (job->max_cycles && ternuino_vm_cycles(vm) - start_cycles >= job->max_cycles) break;
+        if (deadline && now_seconds() >= deadline) {
+            timed_out = true;
+            break;
+        }
+    }
+    double finished = now_seconds();
+
+    // One JSON line, in the shape of ternuino --json
+    const ternuino_t *cpu = ternuino_vm_cpu(vm);
+    char reply[512 + MAX_DATA_MEMORY_SIZE * 13];
+    size_t len = 0;
+    reply_append(reply, sizeof(reply), &len, "{\"id\": ");
+    reply_append_string(reply, sizeof(reply), &len, job->id);
+    reply_append(reply, sizeof(reply), &len,
+                 ", \"status\": \"%s\", \"cached\": %s, \"cycles\": %llu, \"queue_ms\": %.3f, \"run_ms\": %.3f",
+                 timed_out ? "time_limit" : stop_reason_name(reason), cached ? "true" : "false",
+                 (unsigned long long)(cpu->cycles - start_cycles),
+                 (started - job->queued_at) * 1000.0, (finished - started) * 1000.0);
+    reply_append(reply, sizeof(reply), &len,
+                 ", \"registers\": {\"A\": %d, \"B\": %d, \"C\": %d}, \"pc\": %d, \"data\": [",
+                 cpu->registers[REG_A], cpu->registers[REG_B], cpu->registers[REG_C], cpu->pc);
+    for (int32_t i = 0; i < cpu->dmem_size; i++) {
+        reply_append(reply, sizeof(reply), &len, i ? ", %d" : "%d", cpu->data_mem[i]);
+    }
+    reply_append(reply, sizeof(reply), &len, "]}\n");
+    connection_send(job->conn, reply, len);
+}
+
+static void* worker_main(void *arg) {
+    worker_t *worker = (worker_t*)arg;
+    job_t *job;
+    while ((job = queue_pop(worker->server)) != NULL) {
+        run_job(worker, job);
+        job_free(job);
+    }
+    return NULL;
+}
+
+// Read one line without its newline. Returns false at end of input or if
+// the line is longer than size - 1.
+static bool read_line(conn_reader_t *reader, char *line, size_t size) {
+    size_t len = 0;
+    for (;;) {
+        if (reader->pos == reader->len) {
+            ssize_t got = read(reader->fd, reader->buffer, sizeof(reader->buffer));
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) return false;
+            reader->pos = 0;
+            reader->len = (size_t)got;
+        }
+        char c = (char)reader->buffer[reader->pos++];
+        if (c == '\n') break;
+        if (len + 1 >= size) return false;
+        line[len++] = c;
+    }
+    if (len > 0 && line[len - 1] == '\r') len--;
+    line[len] = '\0';
+    return true;
+}
+
+static bool read_exact(conn_reader_t *reader, uint8_t *out, size_t size) {
+    while (size > 0) {
+        if (reader->pos == reader->len) {
+            ssize_t got = read(reader->fd, reader->buffer, sizeof(reader->buffer));
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) return false;
+            reader->pos = 0;
+            reader->len = (size_t)got;
+        }
+        size_t chunk = reader->len - reader->pos;
+        if (chunk > size) chunk = size;
+        memcpy(out, reader->buffer + reader->pos, chunk);
+        reader->pos += chunk;
+        out += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+static bool parse_u64(const char *text, uint64_t *value) {
+    char *end;
+    errno = 0;
+    unsigned long long parsed = strtoull(text, &end, 10);
+    if (end == text || *end || errno || text[0] == '-') return false;
+    *value = (uint64_t)parsed;
+    return true;
+}
+
+// data=ADDR:V,V,...
+static bool parse_data(const char *text, job_t *job) {
+    char *end;
+    long address = strtol(text, &end, 10);
+    if (end == text || *end != ':' || address < 0 || address >= MAX_DATA_MEMORY_SIZE) return false;
+    job->data_address = (int32_t)address;
+    job->data_count = 0;
+
+    const char *p = end + 1;
+    while (*p) {
+        if (job->data_count == MAX_DATA_MEMORY_SIZE) return false;
+        long value = strtol(p, &end, 10);
+        if (end == p || (*end && *end != ',')) return false;
+        job->data[job->data_count++] = (int32_t)value;
+        p = *end ? end + 1 : end;
+    }
+    return job->data_count > 0;
+}
+
+// A job may tighten a server limit but not lift it. 0 (or no option)
+// takes the server's limit; a server limit of 0 means none.
+static uint64_t job_limit(uint64_t requested, uint64_t server_limit) {
+    if (requested == 0) return server_limit;
+    if (server_limit == 0) return requested;
+    return requested < server_limit ? requested : server_limit;
+}
+
+// Parse "RUN <id> source|image <length> [key=value ...]". On failure
+// error says why.
+static bool parse_request(char *line, const server_options_t *opts, job_t *job, const char **error) {
+    char *save;
+    char *verb = strtok_r(line, " ", &save);
+    char *id = strtok_r(NULL, " ", &save);
+    char *kind = strtok_r(NULL, " ", &save);
+    char *length = strtok_r(NULL, " ", &save);
+    uint64_t size;
+
+    *error = "expected RUN <id> source|image <length>";
+    if (!verb || strcmp(verb, "RUN") != 0 || !id || !kind || !length) return false;
+    snprintf(job->id, sizeof(job->id), "%s", id);
+    if (strcmp(kind, "source") == 0) {
+        job->kind = JOB_SOURCE;
+    } else if (strcmp(kind, "image") == 0) {
+        job->kind = JOB_IMAGE;
+    } else {
+        return false;
+    }
+    if (!parse_u64(length, &size) || size == 0 || size > SERVER_MAX_PAYLOAD) {
+        *error = "payload length is missing or too large";
+        return false;
+    }
+    job->size = (size_t)size;
+    job->max_cycles = opts->max_cycles;
+    job->timeout_ms = opts->timeout_ms;
+    job->engine = opts->engine;
+
+    char *option;
+    while ((option = strtok_r(NULL, " ", &save)) != NULL) {
+        uint64_t value;
+        bool valid;
+        if (strncmp(option, "cycles=", 7) == 0) {
+            valid = parse_u64(option + 7, &value);
+            job->max_cycles = job_limit(value, opts->max_cycles);
+        } else if (strncmp(option, "timeout=", 8) == 0) {
+            valid = parse_u64(option + 8, &value) && value <= UINT32_MAX;
+            job->timeout_ms = (uint32_t)job_limit(value, opts->timeout_ms);
+        } else if (strcmp(option, "engine=step") == 0 || strcmp(option, "engine=batch") == 0) {
+            job->engine = option[7] == 'b' ? ENGINE_BATCH : ENGINE_STEP;
+            valid = true;
+        } else if (strncmp(option, "data=", 5) == 0) {
+            valid = parse_data(option + 5, job);
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            *error = "invalid option";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Read requests from one client and queue them. A malformed request ends
+// the connection, since the payload framing is lost with it.
+static void* reader_main(void *arg) {
+    reader_args_t args = *(reader_args_t*)arg;
+    ternuino_free(arg);
+
+    conn_reader_t *reader = ternuino_alloc(sizeof(conn_reader_t));
+    char *line = ternuino_alloc(SERVER_MAX_HEADER);
+    if (reader && line) {
+        reader->fd = args.conn->fd;
+        reader->pos = 0;
+        reader->len = 0;
+
+        while (read_line(reader, line, SERVER_MAX_HEADER)) {
+            if (!line[0]) continue;
+
+            job_t *job = ternuino_calloc(1, sizeof(job_t));
+            const char *error = "out of memory";
+            if (!job || !parse_request(line, &args.server->opts, job, &error) ||
+                !(job->payload = ternuino_alloc(job->size))) {
+                send_error(args.conn, job && job->id[0] ? job->id : "", error);
+                if (job) ternuino_free(job->payload);
+                ternuino_free(job);
+                break;
+            }
+            if (!read_exact(reader, job->payload, job->size)) {
+                ternuino_free(job->payload);
+                ternuino_free(job);
+                break;
+            }
+
+            job->conn = args.conn;
+            job->queued_at = now_seconds();
+            pthread_mutex_lock(&args.conn->write_lock);
+            args.conn->refs++;
+            pthread_mutex_unlock(&args.conn->write_lock);
+            if (!queue_push(args.server, job)) {
+                job_free(job);
+                break;
+            }
+        }
+    }
+
+    ternuino_free(line);
+    ternuino_free(reader);
+    connection_release(args.conn);
+    return NULL;
+}
+
+// Bind the socket, replacing a stale socket file but not a live server
+static int open_listener(const char *socket_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        ternuino_log(TERNUINO_LOG_ERROR, "Error: Socket path '%s' is too long.", socket_path);
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        ternuino_log(TERNUINO_LOG_ERROR, "Error: Cannot create a socket.");
+        return -1;
+    }
+
+    int bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    struct stat st;
+    if (bound != 0 && errno == EADDRINUSE && stat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool live = probe >= 0 && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+        if (probe >= 0) close(probe);
+        if (live) {
+            ternuino_log(TERNUINO_LOG_ERROR, "Error: A server is already listening on '%s'.", socket_path);
+            close(fd);
+            return -1;
+        }
+        unlink(socket_path);
+        bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    }
+    if (bound != 0 || listen(fd, SOMAXCONN) != 0) {
+        ternuino_log(TERNUINO_LOG_ERROR, "Error: Cannot listen on '%s'.", socket_path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool server_run(const char *socket_path, const server_options_t *opts) {
+    server_t *server = ternuino_calloc(1, sizeof(server_t));
+    if (!server) return false;
+    server->opts = *opts;
+    if (server->opts.timeout_ms == 0) {
+        server->opts.timeout_ms = SERVER_DEFAULT_TIMEOUT_MS; // No job may hold a worker forever
+    }
+    server->capacity = opts->queue_depth > 0 ? opts->queue_depth : SERVER_DEFAULT_QUEUE_DEPTH;
+    server->queue = ternuino_calloc((size_t)server->capacity, sizeof(job_t*));
+    int workers = opts->workers > 0 ? opts->workers : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1) workers = 1;
+    worker_t *pool = ternuino_calloc((size_t)workers, sizeof(worker_t));
+    pthread_t *threads = ternuino_calloc((size_t)workers, sizeof(pthread_t));
+
+    int listener = -1;
+    if (server->queue && pool && threads) {
+        listener = open_listener(socket_path);
+    }
+    if (listener < 0) {
+        ternuino_free(threads);
+        ternuino_free(pool);
+        ternuino_free(server->queue);
+        ternuino_free(server);
+        return false;
+    }
+
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->not_empty, NULL);
+    pthread_cond_init(&server->not_full, NULL);
+    pthread_mutex_init(&server->cache_lock, NULL);
+    pthread_key_create(&error_key, NULL);
+    ternuino_set_log(server_log, NULL);
+
+    int started = 0;
+    for (int i = 0; i < workers; i++) {
+        pool[i].server = server;
+        pool[i].vm = ternuino_vm_create();
+        if (!pool[i].vm || pthread_create(&threads[started], NULL, worker_main, &pool[i]) != 0) break;
+        started++;
+    }
+
+    // Without SA_RESTART, a signal interrupts accept so the loop can stop
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    printf("Serving on %s with %d worker%s (queue depth %d)\n", socket_path, started,
+           started == 1 ? "" : "s", server->capacity);
+    fflush(stdout);
+
+    while (started > 0 && !stop_requested) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) continue;
+
+        connection_t *conn = ternuino_alloc(sizeof(connection_t));
+        reader_args_t *args = ternuino_alloc(sizeof(reader_args_t));
+        pthread_t reader;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        bool spawned = false;
+        if (conn && args) {
+            conn->fd = fd;
+            conn->refs = 1;
+            pthread_mutex_init(&conn->write_lock, NULL);
+            args->server = server;
+            args->conn = conn;
+            spawned = pthread_create(&reader, &attr, reader_main, args) == 0;
+            if (!spawned) pthread_mutex_destroy(&conn->write_lock);
+        }
+        pthread_attr_destroy(&attr);
+        if (!spawned) {
+            close(fd);
+            ternuino_free(conn);
+            ternuino_free(args);
+        }
+    }
+
+    // Stop the workers; queued jobs are dropped. Readers still blocked on
+    // their sockets end with the process, so the server state they use is
+    // not freed.
+    pthread_mutex_lock(&server->lock);
+    server->stopping = true;
+    pthread_cond_broadcast(&server->not_empty);
+    pthread_cond_broadcast(&server->not_full);
+    pthread_mutex_unlock(&server->lock);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    close(listener);
+    unlink(socket_path);
+    ternuino_set_log(NULL, NULL);
+    for (int i = 0; i < workers; i++) {
+        ternuino_vm_destroy(pool[i].vm);
+    }
+    for (int i = 0; i < SERVER_CACHE_SLOTS; i++) {
+        ternuino_image_release(server->cache[i].image);
+        ternuino_free(server->cache[i].payload);
+        server->cache[i].image = NULL;
+        server->cache[i].payload = NULL;
+    }
+    ternuino_free(threads);
+    ternuino_free(pool);
+    printf("Server stopped\n");
+    return started > 0;
+}
+
+#endif
@@ -0,0 +1,250 @@
+#define _DEFAULT_SOURCE
+#define _POSIX_C_SOURCE 200809L
+
+#include "devices.h"
+#include "ternuino.h"
+#include "runtime.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#endif
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <limits.h>
+#endif
+
+// Doorbell signalling. On Linux a sleeping side blocks in the kernel on the
+// doorbell word itself; elsewhere it re-checks the counter periodically.
+static void doorbell_ring(uint32_t *doorbell) {
+    __atomic_fetch_add(doorbell, 1, __ATOMIC_RELEASE);
+#ifdef __linux__
+    syscall(SYS_futex, doorbell, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+#ifndef _WIN32
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+// Wait up to timeout_ms for the doorbell to move past seen. Returns its
+// value, which is still seen if the wait timed out.
+static uint32_t doorbell_wait(uint32_t *doorbell, uint32_t seen, int32_t timeout_ms) {
+    uint32_t current = __atomic_load_n(doorbell, __ATOMIC_ACQUIRE);
+#ifndef _WIN32
+    int64_t deadline = now_ns() + (int64_t)timeout_ms * 1000000;
+    while (current == seen) {
+        int64_t left = deadline - now_ns();
+        if (left <= 0) break;
+#ifdef __linux__
+        struct timespec pause = { (time_t)(left / 1000000000), (long)(left % 1000000000) };
+        syscall(SYS_futex, doorbell, FUTEX_WAIT, seen, &pause, NULL, 0);
+#else
+        struct timespec pause = { 0, left < 100000 ? (long)left : 100000 };
+        nanosleep(&pause, NULL);
+#endif
+        current = __atomic_load_n(doorbell, __ATOMIC_ACQUIRE);
+    }
+#else
+    (void)seen;
+    (void)timeout_ms;
+#endif
+    return current;
+}
+
+#ifdef _WIN32
+
+// Shared-memory device implementation (POSIX only)
+device_t* shmem_device_create(uint8_t device_id, uint8_t irq_vector, const char *spec, uint32_t cells) {
+    (void)device_id;
+    (void)irq_vector;
+    (void)spec;
+    (void)cells;
+    return NULL;
+}
+
+void shmem_destroy(device_t *dev) {
+    (void)dev;
+}
+
+#else
+
+// Map "shm:NAME" as a POSIX shared-memory object, anything else as a file.
+// An object that already carries a valid header keeps its size. Any other
+// header, including one that claims more cells than the object holds, is
+// rewritten for the size mapped here.
+static bool shmem_map(shmem_data_t *sdata, const char *spec, uint32_t cells) {
+    int fd;
+    if (strncmp(spec, "shm:", 4) == 0) {
+        char name[256];
+        snprintf(name, sizeof(name), "/%s", spec + 4 + (spec[4] == '/'));
+        fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+    } else {
+        fd = open(spec, O_RDWR | O_CREAT, 0600);
+    }
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+
+    // Adopt the size of an object the host has already set up
+    bool adopted = false;
+    if ((size_t)st.st_size >= sizeof(shmem_header_t)) {
+        shmem_header_t existing;
+        if (pread(fd, &existing, sizeof(existing), 0) == (ssize_t)sizeof(existing) &&
+            existing.magic == SHMEM_MAGIC && existing.cells > 0 && existing.cells <= SHARED_MAX_CELLS &&
+            (size_t)st.st_size >= sizeof(shmem_header_t) + (size_t)existing.cells * sizeof(int32_t)) {
+            cells = existing.cells;
+            adopted = true;
+        }
+    }
+
+    size_t map_size = sizeof(shmem_header_t) + (size_t)cells * sizeof(int32_t);
+    if ((size_t)st.st_size < map_size && ftruncate(fd, (off_t)map_size) != 0) {
+        close(fd);
+        return false;
+    }
+
+    void *view = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // The mapping keeps its own reference to the object
+    if (view == MAP_FAILED) return false;
+
+    shmem_header_t *header = (shmem_header_t*)view;
+    if (!adopted) {
+        __atomic_store_n(&header->magic, 0, __ATOMIC_RELAXED);
+        header->cells = cells;
+        header->host_doorbell = 0;
+        header->guest_doorbell = 0;
+        __atomic_store_n(&header->magic, SHMEM_MAGIC, __ATOMIC_RELEASE);
+    }
+
+    sdata->header = header;
+    sdata->map_size = map_size;
+    sdata->cells = cells;
+    sdata->host_seen = __atomic_load_n(&header->host_doorbell, __ATOMIC_ACQUIRE);
+    return true;
+}
+
+// Shared-memory device implementation
+device_t* shmem_device_create(uint8_t device_id, uint8_t irq_vector, const char *spec, uint32_t cells) {
+    if (!spec || cells == 0 || cells > SHARED_MAX_CELLS) return NULL;
+
+    device_t *dev = device_create(DEVICE_SHMEM, device_id, irq_vector, sizeof(shmem_data_t));
+    if (!dev) return NULL;
+
+    shmem_data_t *sdata = dev->device_data;
+    if (!shmem_map(sdata, spec, cells)) {
+        ternuino_free(dev);
+        return NULL;
+    }
+
+    dev->read = shmem_read;
+    dev->write = shmem_write;
+    dev->open = shmem_open;
+    dev->close = shmem_close;
+    dev->tick = shmem_tick;
+    dev->destroy = shmem_destroy;
+
+    return dev;
+}
+
+void shmem_destroy(device_t *dev) {
+    if (!dev || !dev->device_data) return;
+
+    shmem_data_t *sdata = (shmem_data_t*)dev->device_data;
+
+    if (sdata->header) {
+        munmap(sdata->header, sdata->map_size);
+        sdata->header = NULL;
+    }
+}
+
+#endif
+
+// Shared cells, to be mapped into the guest address space
+int32_t* shmem_cells(device_t *dev, uint32_t *count) {
+    if (!dev || !dev->device_data) return NULL;
+
+    shmem_data_t *sdata = (shmem_data_t*)dev->device_data;
+    if (!sdata->header) return NULL;
+
+    *count = sdata->cells;
+    return (int32_t*)(sdata->header + 1);
+}
+
+// Reading waits up to SHMEM_WAIT_MS for the host doorbell and returns its
+// new count. If the host has not rung, it reports DEVICE_BUSY so the
+// simulation thread is never held by the host.
+int32_t shmem_read(device_t *dev, int32_t *value) {
+    if (!dev || !dev->device_data || !value) return -1;
+
+    shmem_data_t *sdata = (shmem_data_t*)dev->device_data;
+    if (!sdata->header) return -1;
+
+    uint32_t current = doorbell_wait(&sdata->header->host_doorbell, sdata->host_seen, SHMEM_WAIT_MS);
+    if (current == sdata->host_seen) {
+        dev->status |= DEVICE_BUSY;
+        return -1;
+    }
+    sdata->host_seen = current;
+    dev->status &= ~(DEVICE_IRQ_PENDING | DEVICE_BUSY);
+
+    *value = (int32_t)sdata->host_seen;
+    return 0;
+}
+
+// Writing rings the guest doorbell; the value itself is not used
+int32_t shmem_write(device_t *dev, int32_t value) {
+    (void)value;
+    if (!dev || !dev->device_data) return -1;
+
+    shmem_data_t *sdata = (shmem_data_t*)dev->device_data;
+    if (!sdata->header) return -1;
+
+    doorbell_ring(&sdata->header->guest_doorbell);
+    return 0;
+}
+
+int32_t shmem_open(device_t *dev, int32_t mode) {
+    (void)mode;
+    if (!dev || !dev->device_data) return -1;
+
+    dev->irq_enabled = true;
+    dev->status = DEVICE_READY;
+    return 0;
+}
+
+int32_t shmem_close(device_t *dev) {
+    if (!dev) return -1;
+
+    dev->irq_enabled = false;
+    return 0;
+}
+
+void shmem_tick(device_t *dev, struct ternuino_s *cpu) {
+    (void)cpu;
+    if (!dev || !dev->device_data || !dev->irq_enabled) return;
+
+    shmem_data_t *sdata = (shmem_data_t*)dev->device_data;
+
+    // A single shared load per tick; the interrupt stays pending until the
+    // guest reads the data register
+    if (sdata->header &&
+        __atomic_load_n(&sdata->header->host_doorbell, __ATOMIC_ACQUIRE) != sdata->host_seen) {
+        dev->status |= DEVICE_IRQ_PENDING;
+    }
+}
@@ -0,0 +1,382 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "devices.h"
+#include "ternuino.h"
+#include "runtime.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <poll.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+// Longest text encoding of an int32_t: sign, 10 digits and a newline
+#define STREAM_MAX_TEXT_VALUE 12
+
+// Stream device implementation
+device_t* stream_device_create(uint8_t device_id, uint8_t irq_vector, int in_fd, int out_fd,
+                               stream_format_t format, bool blocking) {
+    device_t *dev = device_create(DEVICE_STREAM, device_id, irq_vector, sizeof(stream_data_t));
+    if (!dev) return NULL;
+
+    // Initialize stream data
+    stream_data_t *sdata = dev->device_data;
+    sdata->in_fd = in_fd;
+    sdata->out_fd = out_fd;
+    sdata->owns_in_fd = false;
+    sdata->owns_out_fd = false;
+    sdata->format = format;
+    sdata->blocking = blocking;
+    sdata->in_pos = 0;
+    sdata->in_len = 0;
+    sdata->in_eof = false;
+    sdata->out_len = 0;
+
+    dev->read = stream_read;
+    dev->write = stream_write;
+    dev->read_block = stream_read_block;
+    dev->write_block = stream_write_block;
+    dev->open = stream_open;
+    dev->close = stream_close;
+    dev->tick = stream_tick;
+    dev->input_ready = stream_input_ready;
+    dev->destroy = stream_destroy;
+
+    return dev;
+}
+
+// Resolve a command line stream spec: "-" for stdin/stdout, "fd:N" for an
+// inherited descriptor, anything else is a path. Returns -1 on failure.
+int stream_open_spec(const char *spec, bool for_write, bool *owned) {
+    *owned = false;
+    if (!spec) return -1;
+
+    if (strcmp(spec, "-") == 0) {
+        return for_write ? 1 : 0;
+    }
+
+    if (strncmp(spec, "fd:", 3) == 0) {
+        char *endptr;
+        long fd = strtol(spec + 3, &endptr, 10);
+        return (*endptr == '\0' && fd >= 0) ? (int)fd : -1;
+    }
+
+    int fd = for_write ? open(spec, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644)
+                       : open(spec, O_RDONLY | O_BINARY);
+    *owned = (fd >= 0);
+    return fd;
+}
+
+// Check whether fd can be read or written without blocking
+static bool stream_fd_ready(int fd, bool for_write) {
+#ifdef _WIN32
+    (void)fd;
+    (void)for_write;
+    return true;
+#else
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = for_write ? POLLOUT : POLLIN;
+    pfd.revents = 0;
+
+    // A hung-up pipe also reports ready; the following read then sees EOF
+    return poll(&pfd, 1, 0) > 0;
+#endif
+}
+
+// Refill the input buffer with one large read, keeping unconsumed bytes.
+// Returns false if no new data arrived (end of input, error or would block).
+static bool stream_fill(device_t *dev, stream_data_t *sdata) {
+    if (sdata->in_fd < 0 || sdata->in_eof) return false;
+
+    if (sdata->in_pos > 0) {
+        memmove(sdata->in_buffer, sdata->in_buffer + sdata->in_pos, sdata->in_len - sdata->in_pos);
+        sdata->in_len -= sdata->in_pos;
+        sdata->in_pos = 0;
+    }
+
+    if (sdata->in_len == STREAM_BUFFER_SIZE) {
+        dev->status |= DEVICE_ERROR; // A single token filled the whole buffer
+        return false;
+    }
+
+    if (!sdata->blocking && !stream_fd_ready(sdata->in_fd, false)) {
+        dev->status |= DEVICE_BUSY;
+        return false;
+    }
+
+    long n;
+    do {
+        n = (long)read(sdata->in_fd, sdata->in_buffer + sdata->in_len,
+                       (unsigned)(STREAM_BUFFER_SIZE - sdata->in_len));
+    } while (n < 0 && errno == EINTR);
+
+    if (n == 0) {
+        sdata->in_eof = true;
+        dev->status |= DEVICE_EOF;
+        return false;
+    }
+
+    if (n < 0) {
+        dev->status |= (errno == EAGAIN) ? DEVICE_BUSY : DEVICE_ERROR;
+        return false;
+    }
+
+    sdata->in_len += (size_t)n;
+    dev->status &= ~DEVICE_BUSY;
+    return true;
+}
+
+// Decode one value from buffered input. Returns false if more input is
+// needed to complete it.
+static bool stream_decode(stream_data_t *sdata, int32_t *value) {
+    const uint8_t *buf = sdata->in_buffer;
+
+    if (sdata->format == STREAM_FORMAT_BINARY) {
+        if (sdata->in_len - sdata->in_pos < 4) return false;
+
+        const uint8_t *p = buf + sdata->in_pos;
+        *value = (int32_t)((uint32_t)p[0] | (uint32_t)p[1] << 8 |
+                           (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        sdata->in_pos += 4;
+        return true;
+    }
+
+    for (;;) {
+        // Anything that cannot start a number separates values
+        size_t pos = sdata->in_pos;
+        while (pos < sdata->in_len && buf[pos] != '-' && buf[pos] != '+' &&
+               (buf[pos] < '0' || buf[pos] > '9')) {
+            pos++;
+        }
+        sdata->in_pos = pos;
+        if (pos == sdata->in_len) return false;
+
+        bool negative = (buf[pos] == '-');
+        if (buf[pos] == '-' || buf[pos] == '+') pos++;
+
+        size_t digits = pos;
+        uint32_t magnitude = 0;
+        while (pos < sdata->in_len && buf[pos] >= '0' && buf[pos] <= '9') {
+            magnitude = magnitude * 10 + (uint32_t)(buf[pos] - '0');
+            pos++;
+        }
+
+        // The number may continue in the next read
+        if (pos == sdata->in_len && !sdata->in_eof) return false;
+
+        sdata->in_pos = pos;
+        if (pos == digits) continue; // Lone sign, skip it
+
+        *value = (int32_t)(negative ? 0u - magnitude : magnitude);
+        return true;
+    }
+}
+
+// Write buffered output. With wait set, blocks until everything is written
+// even on a non-blocking stream.
+static bool stream_flush(device_t *dev, stream_data_t *sdata, bool wait) {
+    if (sdata->out_fd < 0) return false;
+
+    // Keep ordering with anything the host printed through stdio
+    if (sdata->out_fd == 1) fflush(stdout);
+
+    size_t done = 0;
+    while (done < sdata->out_len) {
+        if (!wait && !sdata->blocking && !stream_fd_ready(sdata->out_fd, true)) {
+            break;
+        }
+
+        long n = (long)write(sdata->out_fd, sdata->out_buffer + done, (unsigned)(sdata->out_len - done));
+        if (n < 0) {
+            if (errno == EINTR || (wait && errno == EAGAIN)) continue;
+            if (errno == EAGAIN) break;
+            dev->status |= DEVICE_ERROR;
+            return false;
+        }
+        done += (size_t)n;
+    }
+
+    memmove(sdata->out_buffer, sdata->out_buffer + done, sdata->out_len - done);
+    sdata->out_len -= done;
+
+    if (sdata->out_len > 0) {
+        dev->status |= DEVICE_BUSY;
+    } else {
+        dev->status &= ~DEVICE_BUSY;
+    }
+
+    return true;
+}
+
+// Append one value to the output buffer, flushing when it is full
+static bool stream_put(device_t *dev, stream_data_t *sdata, int32_t value) {
+    if (sdata->out_len + STREAM_MAX_TEXT_VALUE > STREAM_BUFFER_SIZE) {
+        stream_flush(dev, sdata, false);
+        if (sdata->out_len + STREAM_MAX_TEXT_VALUE > STREAM_BUFFER_SIZE) {
+            return false; // Consumer is not keeping up, DEVICE_BUSY is set
+        }
+    }
+
+    uint8_t *p = sdata->out_buffer + sdata->out_len;
+
+    if (sdata->format == STREAM_FORMAT_BINARY) {
+        uint32_t u = (uint32_t)value;
+        p[0] = (uint8_t)u;
+        p[1] = (uint8_t)(u >> 8);
+        p[2] = (uint8_t)(u >> 16);
+        p[3] = (uint8_t)(u >> 24);
+        sdata->out_len += 4;
+        return true;
+    }
+
+    // Decimal digits are produced backwards into a scratch buffer
+    char digits[STREAM_MAX_TEXT_VALUE];
+    int len = 0;
+    uint32_t magnitude = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+    do {
+        digits[len++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+
+    if (value < 0) *p++ = '-';
+    while (len > 0) *p++ = (uint8_t)digits[--len];
+    *p++ = '\n';
+
+    sdata->out_len = (size_t)(p - sdata->out_buffer);
+    return true;
+}
+
+int32_t stream_read(device_t *dev, int32_t *value) {
+    return stream_read_block(dev, value, 1) == 1 ? 0 : -1;
+}
+
+int32_t stream_write(device_t *dev, int32_t value) {
+    return stream_write_block(dev, &value, 1) == 1 ? 0 : -1;
+}
+
+// Decode as many values as are available, refilling the buffer with large
+// reads. In non-blocking mode stops early instead of waiting for input.
+int32_t stream_read_block(device_t *dev, int32_t *values, int32_t count) {
+    if (!dev || !dev->device_data || !values || count < 0) return -1;
+
+    stream_data_t *sdata = (stream_data_t*)dev->device_data;
+    if (sdata->in_fd < 0) return -1;
+
+    int32_t n = 0;
+    while (n < count) {
+        if (stream_decode(sdata, &values[n])) {
+            n++;
+            continue;
+        }
+
+        if (!stream_fill(dev, sdata)) {
+            // End of input may complete a number that ran up to the buffer end
+            if (sdata->in_eof && stream_decode(sdata, &values[n])) {
+                n++;
+            }
+            break;
+        }
+    }
+
+    if (n > 0) {
+        dev->status &= ~DEVICE_IRQ_PENDING;
+    }
+
+    return (n > 0 || count == 0) ? n : -1;
+}
+
+int32_t stream_write_block(device_t *dev, const int32_t *values, int32_t count) {
+    if (!dev || !dev->device_data || !values || count < 0) return -1;
+
+    stream_data_t *sdata = (stream_data_t*)dev->device_data;
+    if (sdata->out_fd < 0) return -1;
+
+    int32_t n = 0;
+    while (n < count && stream_put(dev, sdata, values[n])) {
+        n++;
+    }
+
+    // Blocking streams write through as soon as a buffer is full; an
+    // interactive consumer still sees output no later than TCLOSE
+    return (n > 0 || count == 0) ? n : -1;
+}
+
+int32_t stream_open(device_t *dev, int32_t mode) {
+    if (!dev || !dev->device_data) return -1;
+
+    stream_data_t *sdata = (stream_data_t*)dev->device_data;
+
+    // Mode 0: read, mode 1: write, mode 2: read/write
+    if ((mode == 0 || mode == 2) && sdata->in_fd < 0) return -1;
+    if ((mode == 1 || mode == 2) && sdata->out_fd < 0) return -1;
+
+    dev->irq_enabled = true;
+    dev->status = DEVICE_READY | (sdata->in_eof ? DEVICE_EOF : 0);
+
+    return 0;
+}
+
+int32_t stream_close(device_t *dev) {
+    if (!dev || !dev->device_data) return -1;
+
+    stream_data_t *sdata = (stream_data_t*)dev->device_data;
+
+    if (sdata->out_len > 0 && !stream_flush(dev, sdata, true)) {
+        return -1;
+    }
+
+    dev->irq_enabled = false;
+    return 0;
+}
+
+void stream_tick(device_t *dev, struct ternuino_s *cpu) {
+    (void)cpu;
+    if (!dev || !dev->device_data || !dev->irq_enabled) return;
+
+    stream_data_t *sdata = (stream_data_t*)dev->device_data;
+
+    // Only poll once a transfer has reported DEVICE_BUSY; the interrupt
+    // tells the guest to retry
+    if (sdata->blocking || !(dev->status & DEVICE_BUSY)) return;
+
+    if (sdata->out_len > 0) {
+        stream_flush(dev, sdata, false);
+        if (sdata->out_len == 0) {
+            dev->status |= DEVICE_IRQ_PENDING;
+        }
+    } else if (sdata->in_fd >= 0 && stream_fill(dev, sdata)) {
+        dev->status |= DEVICE_IRQ_PENDING;
+    }
+}
+
+// Input that did not decode needs more bytes from in_fd
+bool stream_input_ready(device_t *dev, int *wait_fd) {
+    *wait_fd = -1;
+    if (!dev || !dev->device_data) return true;
+
+    stream_data_t *sdata = (stream_data_t*)dev->device_data;
+    if (sdata->in_fd < 0 || sdata->in_eof) return true;
+    *wait_fd = sdata->in_fd;
+    return false;
+}
+
+void stream_destroy(device_t *dev) {
+    if (!dev || !dev->device_data) return;
+
+    stream_data_t *sdata = (stream_data_t*)dev->device_data;
+
+    if (sdata->owns_in_fd && sdata->in_fd >= 0) close(sdata->in_fd);
+    if (sdata->owns_out_fd && sdata->out_fd >= 0) close(sdata->out_fd);
+    sdata->in_fd = -1;
+    sdata->out_fd = -1;
+}
@@ -0,0 +1,249 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "t3async.h"
+#include <string.h>
+
+#ifdef _WIN32
+
+// No helper threads on Windows; the file device stays synchronous
+bool t3_async_start_read(t3_async_t *async, t3_reader_t *reader, uint32_t *events) {
+    (void)async;
+    (void)reader;
+    (void)events;
+    return false;
+}
+
+bool t3_async_start_write(t3_async_t *async, t3_writer_t *writer, uint32_t *events) {
+    (void)async;
+    (void)writer;
+    (void)events;
+    return false;
+}
+
+int32_t t3_async_read(t3_async_t *async, int32_t *values, size_t count, bool wait) {
+    (void)async;
+    (void)values;
+    (void)count;
+    (void)wait;
+    return -1;
+}
+
+int32_t t3_async_write(t3_async_t *async, const int32_t *values, size_t count, bool wait) {
+    (void)async;
+    (void)values;
+    (void)count;
+    (void)wait;
+    return -1;
+}
+
+bool t3_async_seek(t3_async_t *async, uint32_t index) {
+    (void)async;
+    (void)index;
+    return false;
+}
+
+bool t3_async_stop(t3_async_t *async) {
+    (void)async;
+    return false;
+}
+
+#else
+
+// Helper thread: serve one back buffer at a time, doing the file I/O
+// outside the lock
+static void* t3_async_worker(void *arg) {
+    t3_async_t *async = (t3_async_t*)arg;
+
+    pthread_mutex_lock(&async->lock);
+    for (;;) {
+        while (!async->back_pending && !async->stop) {
+            pthread_cond_wait(&async->cond, &async->lock);
+        }
+        if (!async->back_pending) break;
+
+        int back = 1 - async->front;
+        pthread_mutex_unlock(&async->lock);
+
+        bool ok = true;
+        size_t n = 0;
+        if (async->write_mode) {
+            ok = t3_writer_put_values(async->writer, async->buffers[back], async->fill[back]);
+        } else {
+            n = t3_reader_read(async->reader, async->buffers[back], T3_ASYNC_BLOCK);
+        }
+
+        pthread_mutex_lock(&async->lock);
+        async->fill[back] = n;
+        async->error = async->error || !ok;
+        async->back_pending = false;
+        __atomic_fetch_add(async->events, 1, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&async->cond);
+    }
+    pthread_mutex_unlock(&async->lock);
+
+    return NULL;
+}
+
+static bool t3_async_start(t3_async_t *async, bool write_mode, uint32_t *events) {
+    async->write_mode = write_mode;
+    async->events = events;
+    async->fill[0] = 0;
+    async->fill[1] = 0;
+    async->front = 0;
+    async->pos = 0;
+    async->stop = false;
+    async->error = false;
+
+    // Readers start fetching the first block right away
+    async->back_pending = !write_mode;
+
+    if (pthread_mutex_init(&async->lock, NULL) != 0) return false;
+    if (pthread_cond_init(&async->cond, NULL) != 0) {
+        pthread_mutex_destroy(&async->lock);
+        return false;
+    }
+    if (pthread_create(&async->thread, NULL, t3_async_worker, async) != 0) {
+        pthread_cond_destroy(&async->cond);
+        pthread_mutex_destroy(&async->lock);
+        return false;
+    }
+
+    return true;
+}
+
+bool t3_async_start_read(t3_async_t *async, t3_reader_t *reader, uint32_t *events) {
+    async->reader = reader;
+    async->writer = NULL;
+    return t3_async_start(async, false, events);
+}
+
+bool t3_async_start_write(t3_async_t *async, t3_writer_t *writer, uint32_t *events) {
+    async->reader = NULL;
+    async->writer = writer;
+    return t3_async_start(async, true, events);
+}
+
+// Wait for the helper to release the back buffer. Returns false if it is
+// still busy and wait is false. Called with the lock held.
+static bool t3_async_acquire_back(t3_async_t *async, bool wait) {
+    while (async->back_pending && wait) {
+        pthread_cond_wait(&async->cond, &async->lock);
+    }
+    return !async->back_pending;
+}
+
+int32_t t3_async_read(t3_async_t *async, int32_t *values, size_t count, bool wait) {
+    size_t done = 0;
+    bool at_end = false;
+
+    while (done < count) {
+        size_t avail = async->fill[async->front] - async->pos;
+        if (avail > 0) {
+            size_t n = (count - done < avail) ? count - done : avail;
+            memcpy(values + done, async->buffers[async->front] + async->pos, n * sizeof(int32_t));
+            async->pos += n;
+            done += n;
+            continue;
+        }
+
+        // Front buffer used up: take the read-ahead block and queue the next
+        pthread_mutex_lock(&async->lock);
+        if (!t3_async_acquire_back(async, wait)) {
+            pthread_mutex_unlock(&async->lock);
+            break;
+        }
+
+        int back = 1 - async->front;
+        if (async->fill[back] == 0) {
+            pthread_mutex_unlock(&async->lock);
+            at_end = true;
+            break;
+        }
+
+        async->fill[async->front] = 0;
+        async->front = back;
+        async->pos = 0;
+        async->back_pending = true;
+        pthread_cond_signal(&async->cond);
+        pthread_mutex_unlock(&async->lock);
+    }
+
+    if (done > 0 || count == 0) return (int32_t)done;
+    return at_end ? -1 : 0;
+}
+
+int32_t t3_async_write(t3_async_t *async, const int32_t *values, size_t count, bool wait) {
+    size_t done = 0;
+
+    while (done < count) {
+        size_t space = T3_ASYNC_BLOCK - async->fill[async->front];
+        if (space > 0) {
+            size_t n = (count - done < space) ? count - done : space;
+            memcpy(async->buffers[async->front] + async->fill[async->front], values + done,
+                   n * sizeof(int32_t));
+            async->fill[async->front] += n;
+            done += n;
+            continue;
+        }
+
+        // Front buffer full: hand it to the helper once the previous one is written
+        pthread_mutex_lock(&async->lock);
+        if (!t3_async_acquire_back(async, wait)) {
+            pthread_mutex_unlock(&async->lock);
+            break;
+        }
+        if (async->error) {
+            pthread_mutex_unlock(&async->lock);
+            return -1;
+        }
+
+        async->front = 1 - async->front;
+        async->back_pending = true;
+        pthread_cond_signal(&async->cond);
+        pthread_mutex_unlock(&async->lock);
+    }
+
+    return (int32_t)done;
+}
+
+bool t3_async_seek(t3_async_t *async, uint32_t index) {
+    pthread_mutex_lock(&async->lock);
+    t3_async_acquire_back(async, true);
+
+    // The helper is idle, so the reader can be moved safely
+    bool ok = t3_reader_seek(async->reader, index);
+
+    async->fill[0] = 0;
+    async->fill[1] = 0;
+    async->pos = 0;
+    async->back_pending = true;
+    pthread_cond_signal(&async->cond);
+    pthread_mutex_unlock(&async->lock);
+
+    return ok;
+}
+
+bool t3_async_stop(t3_async_t *async) {
+    pthread_mutex_lock(&async->lock);
+    t3_async_acquire_back(async, true);
+
+    // Hand over the partly filled front buffer as the last block
+    if (async->write_mode && async->fill[async->front] > 0) {
+        async->front = 1 - async->front;
+        async->back_pending = true;
+        pthread_cond_signal(&async->cond);
+        t3_async_acquire_back(async, true);
+    }
+
+    async->stop = true;
+    pthread_cond_signal(&async->cond);
+    pthread_mutex_unlock(&async->lock);
+
+    pthread_join(async->thread, NULL);
+    pthread_cond_destroy(&async->cond);
+    pthread_mutex_destroy(&async->lock);
+
+    return !async->error;
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include "ternio.h"
+#include "tritconv.h"
 
 int main(int argc, char *argv[]) {
     if (argc != 2) {
@@ -7,36 +8,36 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
-    FILE *file = fopen(argv[1], "rb");
-    if (!file) {
-        printf("Error: Cannot open file %s\n", argv[1]);
-        return 1;
-    }
-    
-    t3_header_t header;
-    if (!t3_read_header(file, &header)) {
-        printf("Error: Invalid ternary file format\n");
-        fclose(file);
+    t3_reader_t reader;
+    if (!t3_reader_open(&reader, argv[1])) {
+        printf("Error: Cannot open file %s or invalid ternary file format\n", argv[1]);
         return 1;
     }
     
     printf("Ternary File: %s\n", argv[1]);
-    printf("Format: %s v%d\n", header.header, header.version);
-    printf("Data size: %u values\n", header.data_size);
+    printf("Format: %s v%d\n", reader.header.header, reader.header.version);
+    printf("Data size: %u values\n", reader.header.data_size);
+    if (reader.index_entries > 0) {
+        printf("Index: %u entries, one every %u values\n", reader.index_entries, reader.index_stride);
+    }
     printf("\nContents:\n");
     
-    int32_t value;
+    // Decode and convert values a block at a time
+    int32_t values[T3_BATCH_SIZE];
+    char bt_strings[T3_BATCH_SIZE][BT_STRING_SIZE];
     int count = 0;
-    while (t3_read_value(file, &value)) {
-        char bt_string[64];
-        int_to_balanced_ternary(value, bt_string, sizeof(bt_string));
-        printf("  %d: %d (balanced ternary: %s)\n", count++, value, bt_string);
+    size_t n;
+    while ((n = t3_reader_read(&reader, values, T3_BATCH_SIZE)) > 0) {
+        bt_format_batch(values, bt_strings, n);
+        for (size_t i = 0; i < n; i++) {
+            printf("  %d: %d (balanced ternary: %s)\n", count++, values[i], bt_strings[i]);
+        }
     }
     
     if (count == 0) {
         printf("  (no values found)\n");
     }
     
-    fclose(file);
+    t3_reader_close(&reader);
     return 0;
-}
\ No newline at end of file
+}
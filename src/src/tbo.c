@@ -0,0 +1,310 @@
+#include "tbo.h"
+#include "runtime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+uint64_t tbo_hash(const void *data, size_t size) {
+    const uint8_t *bytes = (const uint8_t*)data;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+bool tbo_hash_file(const char *filename, uint64_t *hash) {
+    mapped_file_t source;
+    if (!mapfile_open(&source, filename)) return false;
+
+    *hash = tbo_hash(source.data, source.size);
+    mapfile_close(&source);
+    return true;
+}
+
+static void pack_operand(const operand_t *operand, uint8_t *mode, int32_t *value) {
+    *mode = (uint8_t)operand->mode;
+    switch (operand->mode) {
+        case ADDR_IMMEDIATE: *value = operand->value.immediate; break;
+        case ADDR_REGISTER:
+        case ADDR_INDIRECT:  *value = (int32_t)operand->value.reg; break;
+        case ADDR_DIRECT:    *value = operand->value.address; break;
+    }
+}
+
+static void unpack_operand(uint8_t mode, int32_t value, operand_t *operand) {
+    operand->mode = (addr_mode_t)mode;
+    switch (operand->mode) {
+        case ADDR_IMMEDIATE: operand->value.immediate = value; break;
+        case ADDR_REGISTER:
+        case ADDR_INDIRECT:  operand->value.reg = (ternuino_register_t)value; break;
+        case ADDR_DIRECT:    operand->value.address = value; break;
+    }
+}
+
+bool tbo_write(const char *filename, const assembler_t *asm_state,
+               const instruction_t *program, int32_t program_size, uint64_t source_hash) {
+    // Lay out the tables back to back after the header
+    uint32_t symbol_count = 0;
+    uint32_t string_size = 0;
+    for (int32_t i = 0; i < asm_state->label_capacity; i++) {
+        if (asm_state->labels[i].used) {
+            symbol_count++;
+            string_size += (uint32_t)strlen(asm_state->labels[i].name);
+        }
+    }
+
+    tbo_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TBO_MAGIC, sizeof(TBO_MAGIC));
+    header.version = TBO_FORMAT_VERSION;
+    header.header_size = sizeof(tbo_header_t);
+    header.source_hash = source_hash;
+    header.instruction_count = (uint32_t)program_size;
+    header.instruction_offset = sizeof(tbo_header_t);
+    header.data_count = (uint32_t)asm_state->data_size;
+    header.data_offset = header.instruction_offset + header.instruction_count * sizeof(tbo_instruction_t);
+    header.symbol_count = symbol_count;
+    header.symbol_offset = header.data_offset + header.data_count * sizeof(int32_t);
+    header.string_offset = header.symbol_offset + symbol_count * sizeof(tbo_symbol_t);
+    header.string_size = string_size;
+    if (asm_state->relocatable) {
+        header.flags = TBO_IMAGE_OBJECT;
+        header.relocation_count = (uint32_t)asm_state->relocation_count;
+    }
+    // Relocations need 4-byte alignment after the names
+    header.relocation_offset = (header.string_offset + string_size + 3) & ~3u;
+    header.image_size = header.relocation_offset + header.relocation_count * sizeof(tbo_relocation_t);
+    memcpy(header.irq_handlers, asm_state->irq_handlers, sizeof(header.irq_handlers));
+
+    uint8_t *image = ternuino_calloc(1, header.image_size);
+    int32_t *symbol_index = ternuino_calloc((size_t)asm_state->label_capacity + 1, sizeof(int32_t));
+    if (!image || !symbol_index) {
+        ternuino_free(image);
+        ternuino_free(symbol_index);
+        return false;
+    }
+
+    tbo_instruction_t *instructions = (tbo_instruction_t*)(image + header.instruction_offset);
+    for (int32_t i = 0; i < program_size; i++) {
+        const instruction_t *instr = &program[i];
+        tbo_instruction_t *packed = &instructions[i];
+        packed->opcode = (uint8_t)instr->opcode;
+        packed->flags = (instr->has_operand1 ? TBO_HAS_OPERAND1 : 0) |
+                        (instr->has_operand2 ? TBO_HAS_OPERAND2 : 0);
+        if (instr->has_operand1) pack_operand(&instr->operand1, &packed->mode1, &packed->value1);
+        if (instr->has_operand2) pack_operand(&instr->operand2, &packed->mode2, &packed->value2);
+    }
+
+    memcpy(image + header.data_offset, asm_state->data_image, header.data_count * sizeof(int32_t));
+
+    tbo_symbol_t *symbols = (tbo_symbol_t*)(image + header.symbol_offset);
+    char *strings = (char*)(image + header.string_offset);
+    uint32_t string_pos = 0;
+    for (int32_t i = 0; i < asm_state->label_capacity; i++) {
+        const label_t *label = &asm_state->labels[i];
+        if (!label->used) continue;
+
+        uint32_t length = (uint32_t)strlen(label->name);
+        symbols->name_offset = string_pos;
+        symbols->name_length = length;
+        symbols->address = label->address;
+        symbols->flags = (label->is_data_label ? TBO_SYMBOL_DATA : 0) |
+                         (label->is_global ? TBO_SYMBOL_GLOBAL : 0) |
+                         (label->is_extern ? TBO_SYMBOL_EXTERN : 0);
+        memcpy(strings + string_pos, label->name, length);
+        string_pos += length;
+        symbol_index[i] = (int32_t)(symbols - (tbo_symbol_t*)(image + header.symbol_offset));
+        symbols++;
+    }
+
+    tbo_relocation_t *relocations = (tbo_relocation_t*)(image + header.relocation_offset);
+    for (uint32_t i = 0; i < header.relocation_count; i++) {
+        const relocation_t *reloc = &asm_state->relocations[i];
+        relocations[i].target = (uint32_t)reloc->instruction_address;
+        relocations[i].operand = (uint8_t)reloc->operand_number;
+        relocations[i].kind = (uint8_t)reloc->kind;
+        if (reloc->kind == RELOC_EXTERN) {
+            const label_t *label = assembler_find_label(asm_state, reloc->symbol, false);
+            relocations[i].symbol = (uint32_t)symbol_index[label - asm_state->labels];
+        }
+    }
+    ternuino_free(symbol_index);
+
+    header.image_hash = tbo_hash(image + sizeof(tbo_header_t), header.image_size - sizeof(tbo_header_t));
+    memcpy(image, &header, sizeof(header));
+
+    // Write a temporary file and rename it, so concurrent builds and runs
+    // never see a partial image
+    char temp_name[512];
+    snprintf(temp_name, sizeof(temp_name), "%s.tmp", filename);
+
+    FILE *file = fopen(temp_name, "wb");
+    bool success = file && fwrite(image, 1, header.image_size, file) == header.image_size;
+    if (file && fclose(file) != 0) success = false;
+    ternuino_free(image);
+
+    if (success) {
+#ifdef _WIN32
+        remove(filename);
+#endif
+        success = rename(temp_name, filename) == 0;
+    }
+    if (!success) remove(temp_name);
+
+    return success;
+}
+
+// A table of count entries of the given size must lie inside the image
+static bool tbo_table_fits(const tbo_header_t *header, uint32_t offset, uint32_t count, size_t entry_size) {
+    return offset >= sizeof(tbo_header_t) && offset % 4 == 0 &&
+           (uint64_t)offset + (uint64_t)count * entry_size <= header->image_size;
+}
+
+static bool tbo_validate(const tbo_image_t *image) {
+    const tbo_header_t *header = image->header;
+
+    if (memcmp(header->magic, TBO_MAGIC, sizeof(TBO_MAGIC)) != 0 ||
+        header->version != TBO_FORMAT_VERSION ||
+        header->header_size != sizeof(tbo_header_t) ||
+        header->image_size != image->map.size) {
+        return false;
+    }
+
+    if (header->instruction_count > MAX_MEMORY_SIZE ||
+        header->data_count > MAX_DATA_MEMORY_SIZE ||
+        !tbo_table_fits(header, header->instruction_offset, header->instruction_count, sizeof(tbo_instruction_t)) ||
+        !tbo_table_fits(header, header->data_offset, header->data_count, sizeof(int32_t)) ||
+        !tbo_table_fits(header, header->symbol_offset, header->symbol_count, sizeof(tbo_symbol_t)) ||
+        !tbo_table_fits(header, header->string_offset, header->string_size, 1) ||
+        !tbo_table_fits(header, header->relocation_offset, header->relocation_count, sizeof(tbo_relocation_t))) {
+        return false;
+    }
+
+    if (tbo_hash(image->map.data + sizeof(tbo_header_t), header->image_size - sizeof(tbo_header_t)) !=
+        header->image_hash) {
+        return false;
+    }
+
+    // Opcodes must exist and operands must decode to valid modes and registers
+    for (uint32_t i = 0; i < header->instruction_count; i++) {
+        const tbo_instruction_t *packed = &image->instructions[i];
+        if (packed->opcode >= OPCODE_COUNT) return false;
+        for (int n = 0; n < 2; n++) {
+            if (!(packed->flags & (n == 0 ? TBO_HAS_OPERAND1 : TBO_HAS_OPERAND2))) continue;
+
+            uint8_t mode = n == 0 ? packed->mode1 : packed->mode2;
+            int32_t value = n == 0 ? packed->value1 : packed->value2;
+            if (mode > ADDR_INDIRECT) return false;
+            if ((mode == ADDR_REGISTER || mode == ADDR_INDIRECT) && (value < REG_A || value > REG_C)) {
+                return false;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < header->symbol_count; i++) {
+        const tbo_symbol_t *symbol = &image->symbols[i];
+        if ((uint64_t)symbol->name_offset + symbol->name_length > header->string_size) return false;
+    }
+
+    for (uint32_t i = 0; i < header->relocation_count; i++) {
+        const tbo_relocation_t *reloc = &image->relocations[i];
+        if (reloc->operand > 2 || reloc->kind > RELOC_EXTERN ||
+            reloc->target >= (reloc->operand == 0 ? MAX_IRQ_VECTORS : header->instruction_count) ||
+            (reloc->kind == RELOC_EXTERN && reloc->symbol >= header->symbol_count)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Point the tables into the mapped or borrowed bytes and check them
+static bool tbo_attach(tbo_image_t *image) {
+    if (image->map.size < sizeof(tbo_header_t)) {
+        tbo_close(image);
+        return false;
+    }
+
+    const uint8_t *base = image->map.data;
+    image->header = (const tbo_header_t*)base;
+    image->instructions = (const tbo_instruction_t*)(base + image->header->instruction_offset);
+    image->data = (const int32_t*)(base + image->header->data_offset);
+    image->symbols = (const tbo_symbol_t*)(base + image->header->symbol_offset);
+    image->strings = (const char*)(base + image->header->string_offset);
+    image->relocations = (const tbo_relocation_t*)(base + image->header->relocation_offset);
+
+    if (!tbo_validate(image)) {
+        tbo_close(image);
+        return false;
+    }
+
+    return true;
+}
+
+bool tbo_open(tbo_image_t *image, const char *filename) {
+    memset(image, 0, sizeof(*image));
+
+    if (!mapfile_open(&image->map, filename)) return false;
+    return tbo_attach(image);
+}
+
+bool tbo_open_memory(tbo_image_t *image, const void *data, size_t size) {
+    memset(image, 0, sizeof(*image));
+    if (!data || ((uintptr_t)data & 3) != 0) return false;
+
+    image->map.data = data;
+    image->map.size = size;
+    image->borrowed = true;
+    return tbo_attach(image);
+}
+
+void tbo_close(tbo_image_t *image) {
+    if (!image->borrowed) {
+        mapfile_close(&image->map);
+    }
+    memset(image, 0, sizeof(*image));
+}
+
+bool tbo_is_current(const char *filename, uint64_t source_hash, bool object) {
+    tbo_image_t image;
+    if (!tbo_open(&image, filename)) return false;
+
+    bool current = image.header->source_hash == source_hash &&
+                   ((image.header->flags & TBO_IMAGE_OBJECT) != 0) == object;
+    tbo_close(&image);
+    return current;
+}
+
+int32_t tbo_unpack_program(const tbo_image_t *image, instruction_t *program) {
+    int32_t count = (int32_t)image->header->instruction_count;
+
+    for (int32_t i = 0; i < count; i++) {
+        const tbo_instruction_t *packed = &image->instructions[i];
+        instruction_t *instr = &program[i];
+
+        memset(instr, 0, sizeof(*instr));
+        instr->opcode = (opcode_t)packed->opcode;
+        instr->has_operand1 = (packed->flags & TBO_HAS_OPERAND1) != 0;
+        instr->has_operand2 = (packed->flags & TBO_HAS_OPERAND2) != 0;
+        if (instr->has_operand1) unpack_operand(packed->mode1, packed->value1, &instr->operand1);
+        if (instr->has_operand2) unpack_operand(packed->mode2, packed->value2, &instr->operand2);
+    }
+
+    return count;
+}
+
+bool tbo_find_symbol(const tbo_image_t *image, const char *name, bool is_data, int32_t *address) {
+    size_t length = strlen(name);
+
+    for (uint32_t i = 0; i < image->header->symbol_count; i++) {
+        const tbo_symbol_t *symbol = &image->symbols[i];
+        if (symbol->name_length == length && ((symbol->flags & TBO_SYMBOL_DATA) != 0) == is_data &&
+            memcmp(image->strings + symbol->name_offset, name, length) == 0) {
+            *address = symbol->address;
+            return true;
+        }
+    }
+
+    return false;
+}
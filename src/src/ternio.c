@@ -1,7 +1,17 @@
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+
 #include "ternio.h"
+#include "tritconv.h"
+#include "runtime.h"
 #include <string.h>
 #include <stdlib.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/types.h>
+#endif
+
 // Convert trit (-1, 0, 1) to character ('T', '0', '1')
 char trit_to_char(int8_t trit) {
     switch (trit) {
@@ -29,31 +39,12 @@ void int_to_balanced_ternary(int32_t value, char *buffer, int buffer_size) {
         return;
     }
     
-    if (value == 0) {
-        strcpy(buffer, "0");
-        return;
-    }
-    
-    char temp[64];
-    int pos = 0;
-    int32_t n = value;
+    char digits[BT_MAX_TRITS];
+    int len = bt_format(value, digits);
     
-    while (n != 0 && pos < 63) {
-        int32_t remainder = ((n % 3) + 3) % 3;
-        if (remainder == 2) {
-            remainder = -1;
-            n = (n + 1) / 3;
-        } else {
-            n = n / 3;
-        }
-        temp[pos++] = trit_to_char(remainder);
-    }
-    
-    // Reverse the string
-    int len = (pos < buffer_size - 1) ? pos : buffer_size - 1;
-    for (int i = 0; i < len; i++) {
-        buffer[i] = temp[pos - 1 - i];
-    }
+    // Keep the most significant trits if the buffer is too small
+    if (len > buffer_size - 1) len = buffer_size - 1;
+    memcpy(buffer, digits, len);
     buffer[len] = '\0';
 }
 
@@ -61,17 +52,13 @@ void int_to_balanced_ternary(int32_t value, char *buffer, int buffer_size) {
 int32_t balanced_ternary_to_int(const char *bt_string) {
     if (!bt_string || !*bt_string) return 0;
     
-    int32_t result = 0;
-    int32_t power = 1;
-    int len = strlen(bt_string);
-    
-    for (int i = len - 1; i >= 0; i--) {
-        int8_t trit = char_to_trit(bt_string[i]);
-        result += trit * power;
-        power *= 3;
-    }
-    
-    return result;
+    return bt_parse(bt_string, strlen(bt_string));
+}
+
+// Convert the first len characters of a balanced ternary string to integer.
+// The input need not be NUL-terminated, so values can be decoded in place.
+int32_t balanced_ternary_to_int_n(const char *bt_string, size_t len) {
+    return bt_parse(bt_string, len);
 }
 
 // Check if string is valid balanced ternary
@@ -87,18 +74,33 @@ bool is_valid_balanced_ternary(const char *bt_string) {
     return true;
 }
 
-// Write ternary file header
-bool t3_write_header(FILE *file, uint32_t data_size) {
-    if (!file) return false;
+// Verify magic and version of a header
+static bool t3_header_valid(const t3_header_t *header) {
+    if (memcmp(header->header, TERNARY_FILE_HEADER, sizeof(TERNARY_FILE_HEADER)) != 0) {
+        return false;
+    }
     
+    return header->version == TERNARY_FORMAT_VERSION ||
+           header->version == TERNARY_FORMAT_VERSION_INDEXED;
+}
+
+static bool t3_write_header_version(FILE *file, uint8_t version, uint32_t data_size) {
     t3_header_t header;
+    memset(&header, 0, sizeof(header));
     strcpy(header.header, TERNARY_FILE_HEADER);
-    header.version = TERNARY_FORMAT_VERSION;
+    header.version = version;
     header.data_size = data_size;
     
     return fwrite(&header, sizeof(t3_header_t), 1, file) == 1;
 }
 
+// Write ternary file header
+bool t3_write_header(FILE *file, uint32_t data_size) {
+    if (!file) return false;
+    
+    return t3_write_header_version(file, TERNARY_FORMAT_VERSION, data_size);
+}
+
 // Read ternary file header
 bool t3_read_header(FILE *file, t3_header_t *header) {
     if (!file || !header) return false;
@@ -107,32 +109,254 @@ bool t3_read_header(FILE *file, t3_header_t *header) {
         return false;
     }
     
-    // Verify header
-    if (strcmp(header->header, TERNARY_FILE_HEADER) != 0) {
+    return t3_header_valid(header);
+}
+
+// Write a ternary value to file in balanced ternary format
+bool t3_write_value(FILE *file, int32_t value) {
+    if (!file) return false;
+    
+    // Length byte followed by the balanced ternary string, in one write
+    uint8_t record[1 + BT_MAX_TRITS];
+    size_t len = t3_encode_values(&value, 1, record);
+    
+    return fwrite(record, 1, len, file) == len;
+}
+
+// Write a block of values with one fwrite per T3_BATCH_SIZE values
+bool t3_write_values(FILE *file, const int32_t *values, size_t count) {
+    if (!file || (!values && count > 0)) return false;
+    
+    uint8_t records[T3_BATCH_SIZE * T3_MAX_RECORD_SIZE];
+    
+    for (size_t i = 0; i < count; i += T3_BATCH_SIZE) {
+        size_t n = (count - i < T3_BATCH_SIZE) ? count - i : T3_BATCH_SIZE;
+        size_t bytes = t3_encode_values(values + i, n, records);
+        if (fwrite(records, 1, bytes, file) != bytes) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+// Encode values as T3 records; out needs count * T3_MAX_RECORD_SIZE bytes.
+// Returns the number of bytes written.
+size_t t3_encode_values(const int32_t *values, size_t count, uint8_t *out) {
+    char strings[T3_BATCH_SIZE][BT_STRING_SIZE];
+    uint8_t *p = out;
+    
+    for (size_t i = 0; i < count; i += T3_BATCH_SIZE) {
+        size_t n = (count - i < T3_BATCH_SIZE) ? count - i : T3_BATCH_SIZE;
+        bt_format_batch(values + i, strings, n);
+        
+        for (size_t j = 0; j < n; j++) {
+            uint8_t len = (uint8_t)strlen(strings[j]);
+            *p++ = len;
+            memcpy(p, strings[j], len);
+            p += len;
+        }
+    }
+    
+    return (size_t)(p - out);
+}
+
+// Skip over count records, positioned at a length byte
+static bool t3_skip_values(FILE *file, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t len;
+        if (fread(&len, sizeof(uint8_t), 1, file) != 1 || len == 0 || len > 63) {
+            return false;
+        }
+        if (fseek(file, len, SEEK_CUR) != 0) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+// Seek to an absolute file offset. fseek takes a long, which is 32 bits on
+// Windows and 32-bit targets, so offsets past 2 GB need the 64-bit calls.
+static bool t3_fseek_to(FILE *file, uint64_t offset) {
+    if (offset > (uint64_t)INT64_MAX) return false;
+#ifdef _WIN32
+    return _fseeki64(file, (int64_t)offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+// Position a stdio stream at value number index. Indexed files jump to the
+// nearest index entry; others are scanned from the first value.
+bool t3_seek(FILE *file, uint32_t index) {
+    t3_header_t header;
+    if (!file || fseek(file, 0, SEEK_SET) != 0 || !t3_read_header(file, &header)) {
         return false;
     }
     
-    if (header->version != TERNARY_FORMAT_VERSION) {
+    if (header.data_size > 0 && index > header.data_size) {
         return false;
     }
     
-    return true;
+    if (header.version == TERNARY_FORMAT_VERSION_INDEXED) {
+        t3_index_footer_t footer;
+        if (fseek(file, -(long)sizeof(footer), SEEK_END) != 0 ||
+            fread(&footer, sizeof(footer), 1, file) != 1 ||
+            memcmp(footer.magic, TERNARY_INDEX_MAGIC, sizeof(TERNARY_INDEX_MAGIC)) != 0) {
+            return false;
+        }
+        
+        if (footer.entries > 0 && footer.stride > 0) {
+            uint32_t entry = index / footer.stride;
+            if (entry >= footer.entries) entry = footer.entries - 1;
+            
+            uint64_t offset;
+            if (!t3_fseek_to(file, footer.index_offset + (uint64_t)entry * sizeof(uint64_t)) ||
+                fread(&offset, sizeof(offset), 1, file) != 1 ||
+                !t3_fseek_to(file, offset)) {
+                return false;
+            }
+            
+            return t3_skip_values(file, index - entry * footer.stride);
+        }
+        
+        if (fseek(file, (long)sizeof(t3_header_t), SEEK_SET) != 0) {
+            return false;
+        }
+    }
+    
+    return t3_skip_values(file, index);
 }
 
-// Write a ternary value to file in balanced ternary format
-bool t3_write_value(FILE *file, int32_t value) {
-    if (!file) return false;
+// Open a new file for streaming writes. A non-zero index_stride records
+// the offset of every index_stride-th value for t3_seek.
+bool t3_writer_open(t3_writer_t *writer, const char *filename, uint32_t index_stride) {
+    return t3_writer_open_buffered(writer, filename, index_stride, 0);
+}
+
+// As t3_writer_open, with a stdio buffer of buffer_size bytes (0 keeps the
+// default) and a hint that the file is written sequentially
+bool t3_writer_open_buffered(t3_writer_t *writer, const char *filename, uint32_t index_stride,
+                             size_t buffer_size) {
+    if (!writer || !filename) return false;
     
-    char bt_string[64];
-    int_to_balanced_ternary(value, bt_string, sizeof(bt_string));
+    memset(writer, 0, sizeof(*writer));
+    writer->file = fopen(filename, "wb");
+    if (!writer->file) return false;
     
-    // Write length followed by the balanced ternary string
-    uint8_t len = strlen(bt_string);
-    if (fwrite(&len, sizeof(uint8_t), 1, file) != 1) {
+    if (buffer_size > 0) {
+        writer->buffer = ternuino_alloc(buffer_size);
+        if (writer->buffer) {
+            setvbuf(writer->file, writer->buffer, _IOFBF, buffer_size);
+        }
+    }
+    
+#ifndef _WIN32
+    posix_fadvise(fileno(writer->file), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    
+    // Placeholder header; the value count is patched in by t3_writer_finish
+    if (!t3_write_header(writer->file, 0)) {
+        fclose(writer->file);
+        ternuino_free(writer->buffer);
+        writer->file = NULL;
+        writer->buffer = NULL;
         return false;
     }
     
-    return fwrite(bt_string, sizeof(char), len, file) == len;
+    writer->offset = sizeof(t3_header_t);
+    writer->index_stride = index_stride;
+    return true;
+}
+
+static bool t3_writer_add_index(t3_writer_t *writer, uint64_t offset) {
+    if (writer->index_len == writer->index_cap) {
+        uint32_t cap = writer->index_cap ? writer->index_cap * 2 : 64;
+        uint64_t *index = ternuino_realloc(writer->index, cap * sizeof(uint64_t));
+        if (!index) return false;
+        writer->index = index;
+        writer->index_cap = cap;
+    }
+    
+    writer->index[writer->index_len++] = offset;
+    return true;
+}
+
+bool t3_writer_put(t3_writer_t *writer, int32_t value) {
+    return t3_writer_put_values(writer, &value, 1);
+}
+
+bool t3_writer_put_values(t3_writer_t *writer, const int32_t *values, size_t count) {
+    if (!writer || !writer->file || (!values && count > 0)) return false;
+    
+    uint8_t records[T3_BATCH_SIZE * T3_MAX_RECORD_SIZE];
+    
+    for (size_t i = 0; i < count; i += T3_BATCH_SIZE) {
+        size_t n = (count - i < T3_BATCH_SIZE) ? count - i : T3_BATCH_SIZE;
+        size_t bytes = t3_encode_values(values + i, n, records);
+        
+        if (writer->index_stride > 0) {
+            // Walk the encoded records to find the offsets of indexed values
+            size_t pos = 0;
+            for (size_t j = 0; j < n; j++) {
+                if ((writer->count + j) % writer->index_stride == 0 &&
+                    !t3_writer_add_index(writer, writer->offset + pos)) {
+                    return false;
+                }
+                pos += 1 + records[pos];
+            }
+        }
+        
+        if (fwrite(records, 1, bytes, writer->file) != bytes) {
+            return false;
+        }
+        
+        writer->count += (uint32_t)n;
+        writer->offset += bytes;
+    }
+    
+    return true;
+}
+
+// Append the index (if any), patch the header with the final value count
+// and close the file
+bool t3_writer_finish(t3_writer_t *writer) {
+    if (!writer || !writer->file) return false;
+    
+    bool success = true;
+    uint8_t version = TERNARY_FORMAT_VERSION;
+    
+    if (writer->index_stride > 0) {
+        t3_index_footer_t footer;
+        memset(&footer, 0, sizeof(footer));
+        footer.index_offset = writer->offset;
+        footer.stride = writer->index_stride;
+        footer.entries = writer->index_len;
+        memcpy(footer.magic, TERNARY_INDEX_MAGIC, sizeof(TERNARY_INDEX_MAGIC));
+        
+        success = fwrite(writer->index, sizeof(uint64_t), writer->index_len, writer->file) == writer->index_len &&
+                  fwrite(&footer, sizeof(footer), 1, writer->file) == 1;
+        version = TERNARY_FORMAT_VERSION_INDEXED;
+    }
+    
+    success = success &&
+              fseek(writer->file, 0, SEEK_SET) == 0 &&
+              t3_write_header_version(writer->file, version, writer->count);
+    
+    if (fclose(writer->file) != 0) {
+        success = false;
+    }
+    
+    ternuino_free(writer->index);
+    ternuino_free(writer->buffer);
+    writer->file = NULL;
+    writer->index = NULL;
+    writer->buffer = NULL;
+    writer->index_len = 0;
+    writer->index_cap = 0;
+    
+    return success;
 }
 
 // Read a ternary value from file
@@ -159,6 +383,147 @@ bool t3_read_value(FILE *file, int32_t *value) {
     return true;
 }
 
+// Map a ternary file and position the reader at the first value
+bool t3_reader_open(t3_reader_t *reader, const char *filename) {
+    if (!reader || !filename) return false;
+    
+    memset(reader, 0, sizeof(*reader));
+    if (!mapfile_open(&reader->map, filename)) {
+        return false;
+    }
+    
+    if (reader->map.size < sizeof(t3_header_t)) {
+        mapfile_close(&reader->map);
+        return false;
+    }
+    
+    memcpy(&reader->header, reader->map.data, sizeof(t3_header_t));
+    if (!t3_header_valid(&reader->header)) {
+        mapfile_close(&reader->map);
+        return false;
+    }
+    
+    reader->cursor = reader->map.data + sizeof(t3_header_t);
+    reader->end = reader->map.data + reader->map.size;
+    reader->values_read = 0;
+    
+    if (reader->header.version == TERNARY_FORMAT_VERSION_INDEXED) {
+        // Values end where the index starts
+        t3_index_footer_t footer;
+        size_t min_size = sizeof(t3_header_t) + sizeof(footer);
+        if (reader->map.size < min_size) {
+            t3_reader_close(reader);
+            return false;
+        }
+        
+        memcpy(&footer, reader->end - sizeof(footer), sizeof(footer));
+        // Compared by subtraction so a crafted offset cannot wrap around
+        uint64_t index_bytes = (uint64_t)footer.entries * sizeof(uint64_t);
+        uint64_t index_space = reader->map.size - sizeof(footer);
+        if (memcmp(footer.magic, TERNARY_INDEX_MAGIC, sizeof(TERNARY_INDEX_MAGIC)) != 0 ||
+            footer.index_offset < sizeof(t3_header_t) ||
+            footer.index_offset > index_space ||
+            index_bytes > index_space - footer.index_offset ||
+            (footer.entries > 0 && footer.stride == 0)) {
+            t3_reader_close(reader);
+            return false;
+        }
+        
+        reader->end = reader->map.data + footer.index_offset;
+        reader->index = reader->end;
+        reader->index_stride = footer.stride;
+        reader->index_entries = footer.entries;
+    }
+    
+    return true;
+}
+
+// Decode the next value directly from the mapping
+bool t3_reader_next(t3_reader_t *reader, int32_t *value) {
+    if (!reader || !value || reader->cursor >= reader->end) return false;
+    
+    // Finalized files know their value count
+    if (reader->header.data_size > 0 && reader->values_read >= reader->header.data_size) {
+        return false;
+    }
+    
+    uint8_t len = reader->cursor[0];
+    if (len == 0 || len > 63 || (size_t)(reader->end - reader->cursor) <= len) {
+        return false;
+    }
+    
+    *value = balanced_ternary_to_int_n((const char*)reader->cursor + 1, len);
+    reader->cursor += 1 + len;
+    reader->values_read++;
+    
+    return true;
+}
+
+// Decode up to count values into a caller buffer; returns how many were read
+size_t t3_reader_read(t3_reader_t *reader, int32_t *values, size_t count) {
+    size_t n = 0;
+    
+    while (n < count && t3_reader_next(reader, &values[n])) {
+        n++;
+    }
+    
+    return n;
+}
+
+// Position the reader at value number index. Uses the sparse index when
+// present; otherwise skips records from the current position or the start.
+// Skipping only follows length bytes, nothing is decoded.
+bool t3_reader_seek(t3_reader_t *reader, uint32_t index) {
+    if (!reader || !reader->cursor) return false;
+    
+    if (reader->header.data_size > 0 && index > reader->header.data_size) {
+        return false;
+    }
+    
+    const uint8_t *first_value = reader->map.data + sizeof(t3_header_t);
+    
+    if (reader->index_entries > 0) {
+        uint32_t entry = index / reader->index_stride;
+        if (entry >= reader->index_entries) entry = reader->index_entries - 1;
+        uint32_t entry_value = entry * reader->index_stride;
+        
+        // Jump unless the current position is already closer
+        if (reader->values_read < entry_value || reader->values_read > index) {
+            uint64_t offset;
+            memcpy(&offset, reader->index + entry * sizeof(uint64_t), sizeof(offset));
+            if (offset < sizeof(t3_header_t) || offset > (uint64_t)(reader->end - reader->map.data)) {
+                return false;
+            }
+            reader->cursor = reader->map.data + offset;
+            reader->values_read = entry_value;
+        }
+    } else if (reader->values_read > index) {
+        reader->cursor = first_value;
+        reader->values_read = 0;
+    }
+    
+    while (reader->values_read < index) {
+        if (reader->cursor >= reader->end) return false;
+        
+        uint8_t len = reader->cursor[0];
+        if (len == 0 || len > 63 || (size_t)(reader->end - reader->cursor) <= len) {
+            return false;
+        }
+        reader->cursor += 1 + len;
+        reader->values_read++;
+    }
+    
+    return true;
+}
+
+void t3_reader_close(t3_reader_t *reader) {
+    if (!reader) return;
+    
+    mapfile_close(&reader->map);
+    reader->cursor = NULL;
+    reader->end = NULL;
+}
+
 // Create a new ternary file
 bool t3_create_file(const char *filename) {
     if (!filename) return false;
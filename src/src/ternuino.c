@@ -3,6 +3,7 @@
 #include "tritarith.h"
 #include "ternio.h"
 #include "devices.h"
+#include "runtime.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -17,16 +18,24 @@ void ternuino_init(ternuino_t *cpu, int32_t dmem_size) {
     cpu->pc = 0;
     cpu->sp = MAX_DATA_MEMORY_SIZE - 1; // Stack grows downward
     cpu->running = true;
+    cpu->halted = false;
     cpu->interrupts_enabled = false;
     cpu->in_interrupt = false;
+    cpu->cycles = 0;
+    cpu->next_deadline = UINT64_MAX;
     cpu->pending_irq = -1;
     cpu->saved_pc = 0;
     cpu->dmem_size = (dmem_size > MAX_DATA_MEMORY_SIZE) ? MAX_DATA_MEMORY_SIZE : dmem_size;
+    cpu->data_mem = cpu->local_mem;
+    cpu->core_id = 0;
+    cpu->park_blocked = false;
+    cpu->blocked_on = NULL;
     
-    // Clear memory
-    memset(cpu->memory, 0, sizeof(cpu->memory));
-    memset(cpu->data_mem, 0, sizeof(cpu->data_mem));
-    memset(cpu->memory_valid, false, sizeof(cpu->memory_valid));
+    // No program until one is loaded
+    cpu->image = NULL;
+    cpu->code = NULL;
+    cpu->code_size = 0;
+    memset(cpu->local_mem, 0, sizeof(cpu->local_mem));
     
     // Initialize interrupt vector table
     for (int i = 0; i < MAX_IRQ_VECTORS; i++) {
@@ -40,13 +49,14 @@ void ternuino_init(ternuino_t *cpu, int32_t dmem_size) {
     }
     cpu->device_count = 0;
     
-    // Initialize file handles (legacy support)
-    for (int i = 0; i < MAX_OPEN_FILES; i++) {
-        cpu->files[i].file = NULL;
-        cpu->files[i].filename[0] = '\0';
-        cpu->files[i].is_open = false;
-        cpu->files[i].is_write_mode = false;
+    // MMIO stays off until the host enables it
+    cpu->mmio_limit = 0;
+    for (int i = 0; i < MMIO_PAGE_COUNT; i++) {
+        cpu->mmio_pages[i] = NULL;
+        cpu->mmio_control[i] = 0;
     }
+    cpu->shared_mem = NULL;
+    cpu->shared_size = 0;
 }
 
 void ternuino_reset(ternuino_t *cpu) {
@@ -56,30 +66,150 @@ void ternuino_reset(ternuino_t *cpu) {
     cpu->pc = 0;
     cpu->sp = MAX_DATA_MEMORY_SIZE - 1;
     cpu->running = true;
+    cpu->halted = false;
     cpu->interrupts_enabled = false;
     cpu->in_interrupt = false;
     cpu->pending_irq = -1;
     cpu->saved_pc = 0;
+    cpu->blocked_on = NULL;
 }
 
+ternuino_image_t* ternuino_image_create(const instruction_t *code, int32_t code_size,
+                                        const int32_t *data, int32_t data_size) {
+    if (!code || code_size < 0) code_size = 0;
+    if (code_size > MAX_MEMORY_SIZE) code_size = MAX_MEMORY_SIZE;
+    if (!data || data_size < 0) data_size = 0;
+    if (data_size > MAX_DATA_MEMORY_SIZE) data_size = MAX_DATA_MEMORY_SIZE;
+    
+    // One block: the header, the code, then the data
+    ternuino_image_t *image = ternuino_alloc(sizeof(ternuino_image_t) + sizeof(instruction_t) * (size_t)code_size +
+                                             sizeof(int32_t) * (size_t)data_size);
+    if (!image) return NULL;
+    
+    image->refs = 1;
+    image->code_size = code_size;
+    image->data_size = data_size;
+    image->data = (int32_t*)(image->code + code_size);
+    for (int i = 0; i < MAX_IRQ_VECTORS; i++) {
+        image->irq_handlers[i] = -1;
+    }
+    if (code_size > 0) {
+        memcpy(image->code, code, sizeof(instruction_t) * (size_t)code_size);
+    }
+    if (data_size > 0) {
+        memcpy(image->data, data, sizeof(int32_t) * (size_t)data_size);
+    }
+    return image;
+}
+
+void ternuino_image_retain(ternuino_image_t *image) {
+    __atomic_fetch_add(&image->refs, 1, __ATOMIC_RELAXED);
+}
+
+void ternuino_image_release(ternuino_image_t *image) {
+    if (image && __atomic_sub_fetch(&image->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        ternuino_free(image);
+    }
+}
+
+void ternuino_load_image(ternuino_t *cpu, ternuino_image_t *image, bool load_data) {
+    // Retain first: image may be the one the CPU already runs
+    if (image) ternuino_image_retain(image);
+    ternuino_image_release(cpu->image);
+    cpu->image = image;
+    cpu->code = image ? image->code : NULL;
+    cpu->code_size = image ? image->code_size : 0;
+    
+    if (image && load_data) {
+        int32_t copy_size = (image->data_size < cpu->dmem_size) ? image->data_size : cpu->dmem_size;
+        memcpy(cpu->data_mem, image->data, sizeof(int32_t) * (size_t)copy_size);
+        memset(cpu->data_mem + copy_size, 0, sizeof(int32_t) * (size_t)(cpu->dmem_size - copy_size));
+    }
+}
+
+void ternuino_unload(ternuino_t *cpu) {
+    ternuino_load_image(cpu, NULL, false);
+}
+
+// Load a program into an image of the CPU's own. Data, if given, replaces
+// data memory; otherwise data memory is left as it is.
 void ternuino_load_program(ternuino_t *cpu, instruction_t *program, int32_t program_size, 
                           int32_t *data, int32_t data_size) {
-    // Load program
-    for (int i = 0; i < program_size && i < MAX_MEMORY_SIZE; i++) {
-        cpu->memory[i] = program[i];
-        cpu->memory_valid[i] = true;
+    ternuino_image_t *image = ternuino_image_create(program, program_size, data, data_size);
+    if (!image) {
+        ternuino_log(TERNUINO_LOG_ERROR, "Error: Out of memory for the program");
+        cpu->running = false;
+        return;
     }
     
-    // Load data memory
-    if (data && data_size > 0) {
-        int32_t copy_size = (data_size < cpu->dmem_size) ? data_size : cpu->dmem_size;
-        memcpy(cpu->data_mem, data, copy_size * sizeof(int32_t));
-        
-        // Fill remaining with zeros if needed
-        if (copy_size < cpu->dmem_size) {
-            memset(cpu->data_mem + copy_size, 0, (cpu->dmem_size - copy_size) * sizeof(int32_t));
+    ternuino_load_image(cpu, image, data && data_size > 0);
+    ternuino_image_release(image); // The CPU holds the only reference
+}
+
+// Data memory cell an address outside [0, dmem_size) wraps to. C's %
+// keeps the sign of addr, so negative addresses are moved back into range.
+static int32_t wrap_data_address(const ternuino_t *cpu, int32_t addr) {
+    int32_t wrapped = addr % cpu->dmem_size;
+    return wrapped < 0 ? wrapped + cpu->dmem_size : wrapped;
+}
+
+// Move up to count values between data memory and a device in one
+// operation. Uses the device's bulk callbacks when it has them and falls
+// back to one callback per value otherwise. Returns the number of values
+// moved, or -1 if nothing could be transferred. addr wraps into data
+// memory like any other address.
+static int32_t transfer_block(ternuino_t *cpu, device_t *device, int32_t addr, int32_t count, bool to_device) {
+    if (!device || count < 0) return -1;
+    addr = wrap_data_address(cpu, addr);
+    
+    // Transfers stop at the end of data memory
+    if (count > cpu->dmem_size - addr) {
+        count = cpu->dmem_size - addr;
+    }
+    
+    int32_t *block = &cpu->data_mem[addr];
+    int32_t moved = 0;
+    
+    if (to_device) {
+        if (device->write_block) {
+            moved = device->write_block(device, block, count);
+        } else if (device->write) {
+            while (moved < count && device->write(device, block[moved]) == 0) {
+                moved++;
+            }
+        } else {
+            return -1;
         }
+    } else {
+        if (device->read_block) {
+            moved = device->read_block(device, block, count);
+        } else if (device->read) {
+            while (moved < count && device->read(device, &block[moved]) == 0) {
+                moved++;
+            }
+        } else {
+            return -1;
+        }
+    }
+    
+    if (moved <= 0 && count > 0) return -1;
+    
+    // Signal completion on the device's vector
+    ternuino_trigger_irq(cpu, device->irq_vector);
+    return moved;
+}
+
+// With park_blocked set, a read the device could not satisfy yet stops
+// the CPU in front of the instruction instead of failing, so a scheduler
+// can run something else and resume it once the device has input
+static bool park_read(ternuino_t *cpu, device_t *device) {
+    if (!cpu->park_blocked || !device->input_ready || !(device->status & DEVICE_BUSY)) {
+        return false;
     }
+    cpu->blocked_on = device;
+    cpu->running = false;
+    cpu->pc--;
+    return true;
 }
 
 static int32_t resolve_operand_value(ternuino_t *cpu, const operand_t *operand) {
@@ -99,7 +229,79 @@ static int32_t resolve_operand_value(ternuino_t *cpu, const operand_t *operand)
     }
 }
 
+// Raw address named by a LD/ST operand, before wrapping into data memory
+static int32_t resolve_operand_address(ternuino_t *cpu, const operand_t *operand) {
+    switch (operand->mode) {
+        case ADDR_IMMEDIATE:
+            return operand->value.immediate;
+        case ADDR_REGISTER:
+        case ADDR_INDIRECT:
+            return cpu->registers[operand->value.reg];
+        case ADDR_DIRECT:
+            return operand->value.address;
+        default:
+            return 0;
+    }
+}
+
+// Loads and stores outside data memory: MMIO registers, the shared window,
+// or an address that wraps into data memory
+static int32_t memory_load_slow(ternuino_t *cpu, int32_t addr) {
+    uint32_t mmio_offset = (uint32_t)addr - MMIO_BASE;
+    if (mmio_offset < cpu->mmio_limit) {
+        return ternuino_mmio_load(cpu, mmio_offset);
+    }
+    
+    uint32_t shared_offset = (uint32_t)addr - SHARED_BASE;
+    if (shared_offset < cpu->shared_size) {
+        return __atomic_load_n(&cpu->shared_mem[shared_offset], __ATOMIC_ACQUIRE);
+    }
+    
+    return __atomic_load_n(&cpu->data_mem[wrap_data_address(cpu, addr)], __ATOMIC_ACQUIRE);
+}
+
+static void memory_store_slow(ternuino_t *cpu, int32_t addr, int32_t value) {
+    uint32_t mmio_offset = (uint32_t)addr - MMIO_BASE;
+    if (mmio_offset < cpu->mmio_limit) {
+        ternuino_mmio_store(cpu, mmio_offset, value);
+        return;
+    }
+    
+    uint32_t shared_offset = (uint32_t)addr - SHARED_BASE;
+    if (shared_offset < cpu->shared_size) {
+        __atomic_store_n(&cpu->shared_mem[shared_offset], value, __ATOMIC_RELEASE);
+        return;
+    }
+    
+    __atomic_store_n(&cpu->data_mem[wrap_data_address(cpu, addr)], value, __ATOMIC_RELEASE);
+}
+
+// Cell an atomic instruction works on: data memory or the shared window.
+// MMIO registers have no atomic form, so their addresses give NULL.
+static int32_t* atomic_cell(ternuino_t *cpu, int32_t addr) {
+    if ((uint32_t)addr < (uint32_t)cpu->dmem_size) {
+        return &cpu->data_mem[addr];
+    }
+    
+    if ((uint32_t)addr - MMIO_BASE < cpu->mmio_limit) {
+        return NULL;
+    }
+    
+    uint32_t shared_offset = (uint32_t)addr - SHARED_BASE;
+    if (shared_offset < cpu->shared_size) {
+        return &cpu->shared_mem[shared_offset];
+    }
+    
+    return &cpu->data_mem[wrap_data_address(cpu, addr)];
+}
+
 void ternuino_step(ternuino_t *cpu) {
+    // Devices with a scheduled deadline cost one compare per cycle
+    cpu->cycles++;
+    if (cpu->cycles >= cpu->next_deadline) {
+        ternuino_run_deadlines(cpu);
+    }
+    
     // Check for pending interrupts first
     ternuino_check_interrupts(cpu);
     
@@ -110,7 +312,7 @@ void ternuino_step(ternuino_t *cpu) {
     }
     
     // Check if instruction is valid
-    if (!cpu->memory_valid[cpu->pc]) {
+    if (cpu->pc >= cpu->code_size) {
         // If we encounter empty memory, stop to avoid running off the end
         if (cpu->pc >= MAX_MEMORY_SIZE - 1) {
             cpu->running = false;
@@ -119,7 +321,7 @@ void ternuino_step(ternuino_t *cpu) {
         return;
     }
     
-    instruction_t *instr = &cpu->memory[cpu->pc];
+    const instruction_t *instr = &cpu->code[cpu->pc];
     cpu->pc++;
     
     switch (instr->opcode) {
@@ -179,6 +381,7 @@ void ternuino_step(ternuino_t *cpu) {
         
         case OP_HLT:
             cpu->running = false;
+            cpu->halted = true;
             break;
             
         case OP_LEA: {
@@ -194,25 +397,28 @@ void ternuino_step(ternuino_t *cpu) {
         
         case OP_LD: {
             ternuino_register_t reg = instr->operand1.value.reg;
-            int32_t addr;
-            if (instr->operand2.mode == ADDR_INDIRECT) {
-                addr = cpu->registers[instr->operand2.value.reg] % cpu->dmem_size;
+            int32_t addr = resolve_operand_address(cpu, &instr->operand2);
+            
+            // A single unsigned compare keeps ordinary addresses on the fast
+            // path. Loads acquire and stores release, so data memory shared
+            // between cores orders like the shared window.
+            if ((uint32_t)addr < (uint32_t)cpu->dmem_size) {
+                cpu->registers[reg] = __atomic_load_n(&cpu->data_mem[addr], __ATOMIC_ACQUIRE);
             } else {
-                addr = resolve_operand_value(cpu, &instr->operand2) % cpu->dmem_size;
+                cpu->registers[reg] = memory_load_slow(cpu, addr);
             }
-            cpu->registers[reg] = cpu->data_mem[addr];
             break;
         }
         
         case OP_ST: {
             ternuino_register_t reg = instr->operand1.value.reg;
-            int32_t addr;
-            if (instr->operand2.mode == ADDR_INDIRECT) {
-                addr = cpu->registers[instr->operand2.value.reg] % cpu->dmem_size;
+            int32_t addr = resolve_operand_address(cpu, &instr->operand2);
+            
+            if ((uint32_t)addr < (uint32_t)cpu->dmem_size) {
+                __atomic_store_n(&cpu->data_mem[addr], cpu->registers[reg], __ATOMIC_RELEASE);
             } else {
-                addr = resolve_operand_value(cpu, &instr->operand2) % cpu->dmem_size;
+                memory_store_slow(cpu, addr, cpu->registers[reg]);
             }
-            cpu->data_mem[addr] = cpu->registers[reg];
             break;
         }
         
@@ -305,7 +511,7 @@ void ternuino_step(ternuino_t *cpu) {
             int32_t device_id = resolve_operand_value(cpu, &instr->operand1);
             int32_t mode = resolve_operand_value(cpu, &instr->operand2);
             
-            device_t *device = ternuino_get_device(cpu, device_id);
+            device_t *device = ternuino_get_channel(cpu, device_id);
             if (device && device->open) {
                 cpu->registers[REG_A] = device->open(device, mode);
             } else {
@@ -318,7 +524,7 @@ void ternuino_step(ternuino_t *cpu) {
             // TREAD device_id, register
             int32_t device_id = resolve_operand_value(cpu, &instr->operand1);
             
-            device_t *device = ternuino_get_device(cpu, device_id);
+            device_t *device = ternuino_get_channel(cpu, device_id);
             if (device && device->read) {
                 int32_t value;
                 if (device->read(device, &value) == 0) {
@@ -328,7 +534,7 @@ void ternuino_step(ternuino_t *cpu) {
                     } else {
                         cpu->registers[REG_A] = -1; // Invalid target
                     }
-                } else {
+                } else if (!park_read(cpu, device)) {
                     cpu->registers[REG_A] = -1; // Read error or no data
                 }
             } else {
@@ -342,7 +548,7 @@ void ternuino_step(ternuino_t *cpu) {
             int32_t device_id = resolve_operand_value(cpu, &instr->operand1);
             int32_t value = resolve_operand_value(cpu, &instr->operand2);
             
-            device_t *device = ternuino_get_device(cpu, device_id);
+            device_t *device = ternuino_get_channel(cpu, device_id);
             if (device && device->write) {
                 cpu->registers[REG_A] = device->write(device, value);
             } else {
@@ -355,7 +561,7 @@ void ternuino_step(ternuino_t *cpu) {
             // TCLOSE device_id
             int32_t device_id = resolve_operand_value(cpu, &instr->operand1);
             
-            device_t *device = ternuino_get_device(cpu, device_id);
+            device_t *device = ternuino_get_channel(cpu, device_id);
             if (device && device->close) {
                 cpu->registers[REG_A] = device->close(device);
             } else {
@@ -364,6 +570,36 @@ void ternuino_step(ternuino_t *cpu) {
             break;
         }
         
+        case OP_TSEEK: {
+            // TSEEK device_id, index
+            int32_t device_id = resolve_operand_value(cpu, &instr->operand1);
+            int32_t index = resolve_operand_value(cpu, &instr->operand2);
+            
+            device_t *device = ternuino_get_channel(cpu, device_id);
+            if (device && device->seek) {
+                cpu->registers[REG_A] = device->seek(device, index);
+            } else {
+                cpu->registers[REG_A] = -1; // Invalid device or not seekable
+            }
+            break;
+        }
+        
+        case OP_TBREAD:
+        case OP_TBWRITE: {
+            // TBREAD/TBWRITE device_id, address  (count in C, values moved in A)
+            int32_t device_id = resolve_operand_value(cpu, &instr->operand1);
+            int32_t addr = resolve_operand_address(cpu, &instr->operand2);
+            
+            device_t *device = ternuino_get_channel(cpu, device_id);
+            int32_t moved = transfer_block(cpu, device, addr, cpu->registers[REG_C],
+                                           instr->opcode == OP_TBWRITE);
+            if (moved < 0 && instr->opcode == OP_TBREAD && device && park_read(cpu, device)) {
+                break;
+            }
+            cpu->registers[REG_A] = moved;
+            break;
+        }
+        
         case OP_IRQ: {
             // IRQ vector - software interrupt
             int32_t vector = resolve_operand_value(cpu, &instr->operand1);
@@ -372,8 +608,9 @@ void ternuino_step(ternuino_t *cpu) {
         }
         
         case OP_IRET: {
-            // Return from interrupt
-            if (cpu->in_interrupt && cpu->sp < MAX_DATA_MEMORY_SIZE - 1) {
+            // Return from interrupt (the return address is kept in saved_pc,
+            // nothing is pushed on the stack)
+            if (cpu->in_interrupt) {
                 cpu->pc = cpu->saved_pc;
                 cpu->in_interrupt = false;
                 cpu->interrupts_enabled = true;
@@ -392,14 +629,76 @@ void ternuino_step(ternuino_t *cpu) {
             cpu->interrupts_enabled = false;
             break;
         }
+        
+        case OP_CAS:
+        case OP_TCAS: {
+            // CAS/TCAS reg, address: store reg if the cell holds A. CAS sets A
+            // to the old value, TCAS to tcmpr(old, A), so 0 means swapped.
+            int32_t *cell = atomic_cell(cpu, resolve_operand_address(cpu, &instr->operand2));
+            if (!cell) break;
+            
+            int32_t expected = cpu->registers[REG_A];
+            int32_t old = expected;
+            __atomic_compare_exchange_n(cell, &old, cpu->registers[instr->operand1.value.reg], false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+            cpu->registers[REG_A] = instr->opcode == OP_CAS ? old : tcmpr(old, expected);
+            break;
+        }
+        
+        case OP_XADD: {
+            // XADD reg, address: add reg to the cell, reg gets the old value
+            ternuino_register_t reg = instr->operand1.value.reg;
+            int32_t *cell = atomic_cell(cpu, resolve_operand_address(cpu, &instr->operand2));
+            if (cell) {
+                cpu->registers[reg] = __atomic_fetch_add(cell, cpu->registers[reg], __ATOMIC_SEQ_CST);
+            }
+            break;
+        }
+        
+        case OP_CID: {
+            ternuino_register_t reg = instr->operand1.value.reg;
+            cpu->registers[reg] = cpu->core_id;
+            break;
+        }
     }
 }
 
 void ternuino_run(ternuino_t *cpu) {
-    while (cpu->running) {
-        ternuino_step(cpu);
-        ternuino_tick_devices(cpu);
+    ternuino_run_for(cpu, 0, ENGINE_STEP);
+}
+
+// Run until the CPU stops or max_cycles more cycles have passed (0 for no
+// limit)
+stop_reason_t ternuino_run_for(ternuino_t *cpu, uint64_t max_cycles, engine_t engine) {
+    uint64_t limit = UINT64_MAX;
+    if (max_cycles > 0 && max_cycles < UINT64_MAX - cpu->cycles) {
+        limit = cpu->cycles + max_cycles;
+    }
+    cpu->blocked_on = NULL;
+    
+    if (engine == ENGINE_BATCH) {
+        while (cpu->running && cpu->cycles < limit) {
+            uint64_t batch_end = limit - cpu->cycles > TERNUINO_BATCH_CYCLES ?
+                                 cpu->cycles + TERNUINO_BATCH_CYCLES : limit;
+            while (cpu->running && cpu->cycles < batch_end) {
+                ternuino_step(cpu);
+            }
+            ternuino_tick_devices(cpu);
+        }
+    } else {
+        while (cpu->running && cpu->cycles < limit) {
+            ternuino_step(cpu);
+            ternuino_tick_devices(cpu);
+        }
+    }
+    
+    // A parked CPU stopped without ending the program
+    if (cpu->blocked_on) {
+        cpu->running = true;
+        return STOP_BLOCKED;
     }
+    if (cpu->running) return STOP_CYCLE_LIMIT;
+    return cpu->halted ? STOP_HALTED : STOP_END_OF_PROGRAM;
 }
 
 const char* opcode_to_string(opcode_t opcode) {
@@ -435,6 +734,13 @@ const char* opcode_to_string(opcode_t opcode) {
         case OP_IRET:  return "IRET";
         case OP_EI:    return "EI";
         case OP_DI:    return "DI";
+        case OP_TSEEK: return "TSEEK";
+        case OP_TBREAD: return "TBREAD";
+        case OP_TBWRITE: return "TBWRITE";
+        case OP_CAS:   return "CAS";
+        case OP_TCAS:  return "TCAS";
+        case OP_XADD:  return "XADD";
+        case OP_CID:   return "CID";
         default:       return "UNKNOWN";
     }
 }
@@ -545,6 +851,79 @@ void ternuino_check_interrupts(ternuino_t *cpu) {
     }
 }
 
+// Memory-mapped I/O functions
+void ternuino_enable_mmio(ternuino_t *cpu, bool enabled) {
+    cpu->mmio_limit = enabled ? MMIO_WINDOW_SIZE : 0;
+}
+
+int32_t ternuino_mmio_load(ternuino_t *cpu, uint32_t offset) {
+    uint32_t page = offset / MMIO_PAGE_SIZE;
+    device_t *device = (page < MMIO_PAGE_COUNT) ? cpu->mmio_pages[page] : NULL;
+    if (!device) return 0; // Unmapped pages read as zero
+    
+    device->handle = 0; // MMIO pages always address the first handle
+    
+    switch (offset % MMIO_PAGE_SIZE) {
+        case MMIO_REG_DATA: {
+            int32_t value = 0;
+            if (!device->read || device->read(device, &value) != 0) {
+                device->status |= DEVICE_ERROR;
+                return 0;
+            }
+            return value;
+        }
+        case MMIO_REG_STATUS:
+            return device->status;
+        case MMIO_REG_CONTROL:
+            return cpu->mmio_control[page];
+        case MMIO_REG_IRQ_ENABLE:
+            return device->irq_enabled ? 1 : 0;
+        default:
+            return 0;
+    }
+}
+
+void ternuino_mmio_store(ternuino_t *cpu, uint32_t offset, int32_t value) {
+    uint32_t page = offset / MMIO_PAGE_SIZE;
+    device_t *device = (page < MMIO_PAGE_COUNT) ? cpu->mmio_pages[page] : NULL;
+    if (!device) return; // Stores to unmapped pages are ignored
+    
+    device->handle = 0;
+    
+    switch (offset % MMIO_PAGE_SIZE) {
+        case MMIO_REG_DATA:
+            if (!device->write || device->write(device, value) != 0) {
+                device->status |= DEVICE_ERROR;
+            }
+            break;
+        case MMIO_REG_STATUS:
+            // Write-one-to-clear, e.g. to acknowledge DEVICE_IRQ_PENDING
+            device->status &= (uint8_t)~value;
+            break;
+        case MMIO_REG_CONTROL:
+            if (value < 0) {
+                cpu->mmio_control[page] = device->close ? device->close(device) : -1;
+            } else {
+                cpu->mmio_control[page] = device->open ? device->open(device, value) : -1;
+            }
+            break;
+        case MMIO_REG_IRQ_ENABLE:
+            device->irq_enabled = (value != 0);
+            break;
+        default:
+            break;
+    }
+}
+
+void ternuino_map_shared(ternuino_t *cpu, int32_t *cells, uint32_t count) {
+    cpu->shared_mem = cells;
+    cpu->shared_size = cells ? count : 0;
+}
+
+void ternuino_share_data(ternuino_t *cpu, int32_t *cells) {
+    cpu->data_mem = cells ? cells : cpu->local_mem;
+}
+
 // Device management functions
 int32_t ternuino_register_device(ternuino_t *cpu, device_t *device) {
     if (cpu->device_count >= MAX_DEVICES) {
@@ -560,6 +939,13 @@ int32_t ternuino_register_device(ternuino_t *cpu, device_t *device) {
     
     cpu->devices[cpu->device_count] = device;
     cpu->device_count++;
+    device->cpu = cpu;
+    
+    // Devices with a small ID get a page in the MMIO window
+    if (device->device_id < MMIO_PAGE_COUNT) {
+        cpu->mmio_pages[device->device_id] = device;
+        cpu->mmio_control[device->device_id] = 0;
+    }
     
     return device->device_id;
 }
@@ -567,8 +953,10 @@ int32_t ternuino_register_device(ternuino_t *cpu, device_t *device) {
 void ternuino_unregister_device(ternuino_t *cpu, int32_t device_id) {
     for (int i = 0; i < cpu->device_count; i++) {
         if (cpu->devices[i] && cpu->devices[i]->device_id == device_id) {
-            device_cleanup(cpu->devices[i]);
-            free(cpu->devices[i]);
+            if (device_id >= 0 && device_id < MMIO_PAGE_COUNT) {
+                cpu->mmio_pages[device_id] = NULL;
+            }
+            device_destroy(cpu->devices[i]);
             
             // Shift remaining devices down
             for (int j = i; j < cpu->device_count - 1; j++) {
@@ -576,11 +964,24 @@ void ternuino_unregister_device(ternuino_t *cpu, int32_t device_id) {
             }
             cpu->devices[cpu->device_count - 1] = NULL;
             cpu->device_count--;
+            ternuino_schedule(cpu, NULL, UINT64_MAX);
             break;
         }
     }
 }
 
+// Look up the device of an I/O channel (device_id + 256 * handle) and
+// select the handle for the operation that follows
+device_t* ternuino_get_channel(ternuino_t *cpu, int32_t channel) {
+    if (channel < 0) return NULL;
+    
+    device_t *device = ternuino_get_device(cpu, channel & ((1 << DEVICE_CHANNEL_SHIFT) - 1));
+    if (device) {
+        device->handle = channel >> DEVICE_CHANNEL_SHIFT;
+    }
+    return device;
+}
+
 device_t* ternuino_get_device(ternuino_t *cpu, int32_t device_id) {
     for (int i = 0; i < cpu->device_count; i++) {
         if (cpu->devices[i] && cpu->devices[i]->device_id == device_id) {
@@ -598,3 +999,33 @@ void ternuino_tick_devices(ternuino_t *cpu) {
         }
     }
 }
+
+// Set a device's deadline (UINT64_MAX for none) and recompute the earliest
+// one. With device NULL only the recompute is done.
+void ternuino_schedule(ternuino_t *cpu, device_t *device, uint64_t deadline) {
+    if (device) {
+        device->deadline = deadline;
+    }
+    
+    uint64_t next = UINT64_MAX;
+    for (int i = 0; i < cpu->device_count; i++) {
+        if (cpu->devices[i] && cpu->devices[i]->deadline < next) {
+            next = cpu->devices[i]->deadline;
+        }
+    }
+    cpu->next_deadline = next;
+}
+
+void ternuino_run_deadlines(ternuino_t *cpu) {
+    for (int i = 0; i < cpu->device_count; i++) {
+        device_t *device = cpu->devices[i];
+        if (device && device->deadline <= cpu->cycles) {
+            // Timeouts reschedule themselves if they need another callback
+            device->deadline = UINT64_MAX;
+            if (device->timeout) {
+                device->timeout(device, cpu);
+            }
+        }
+    }
+    ternuino_schedule(cpu, NULL, UINT64_MAX);
+}
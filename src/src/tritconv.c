@@ -0,0 +1,450 @@
+#include "tritconv.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TRITCONV_X86 1
+#include <immintrin.h>
+#endif
+
+// Values are converted in chunks of 5 trits (3^5 = 243). A chunk of packed
+// trits is 10 bits wide, so every per-chunk table has 1024 entries indexed
+// directly by the packed code; only 243 of them are reachable from pack.
+#define CHUNK_TRITS 5
+#define CHUNK_BASE 243
+#define CHUNK_HALF 121
+#define CHUNK_CODES 1024
+#define PACKED_MASK ((UINT64_C(1) << (2 * BT_MAX_TRITS)) - 1)
+#define PACKED_LOW_BITS UINT64_C(0x5555555555555555)
+
+// Balanced remainder (r + CHUNK_HALF) -> packed 10-bit code
+static uint32_t chunk_code[CHUNK_BASE];
+// Packed 10-bit code -> chunk value in [-121, 121]
+static int32_t chunk_value[CHUNK_CODES];
+// Packed 10-bit code -> 5 characters, most significant trit first
+static char chunk_chars[CHUNK_CODES][CHUNK_TRITS];
+// Character -> trit, matching char_to_trit (unknown characters read as 0)
+static const int8_t char_trit[256] = {
+    ['T'] = -1, ['t'] = -1, ['-'] = -1,
+    ['1'] = 1, ['+'] = 1
+};
+
+// init_tables progress, published with release stores
+enum { TABLES_EMPTY, TABLES_BUILDING, TABLES_READY };
+static int tables_state = TABLES_EMPTY;
+
+static int32_t code_to_trit(uint32_t code) {
+    // 01 -> +1, 11 -> -1, 00 and the unused 10 -> 0
+    return (int32_t)(code & 1) - (int32_t)((code & 1) << 1 & code);
+}
+
+// The first caller builds the tables; any thread arriving meanwhile waits
+// for it, which takes a few microseconds once per process.
+static void init_tables(void) {
+    if (__atomic_load_n(&tables_state, __ATOMIC_ACQUIRE) == TABLES_READY) return;
+
+    int expected = TABLES_EMPTY;
+    if (!__atomic_compare_exchange_n(&tables_state, &expected, TABLES_BUILDING, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(&tables_state, __ATOMIC_ACQUIRE) != TABLES_READY) {
+        }
+        return;
+    }
+
+    for (uint32_t code = 0; code < CHUNK_CODES; code++) {
+        int32_t value = 0;
+        for (int t = CHUNK_TRITS - 1; t >= 0; t--) {
+            int32_t trit = code_to_trit(code >> (2 * t) & 3);
+            value = value * 3 + trit;
+            chunk_chars[code][CHUNK_TRITS - 1 - t] = trit < 0 ? 'T' : (char)('0' + trit);
+        }
+        chunk_value[code] = value;
+    }
+
+    for (int32_t r = -CHUNK_HALF; r <= CHUNK_HALF; r++) {
+        uint32_t code = 0;
+        int32_t n = r;
+        for (int t = 0; t < CHUNK_TRITS; t++) {
+            int32_t digit = ((n % 3) + 3) % 3;
+            if (digit == 2) digit = -1;
+            n = (n - digit) / 3;
+            code |= (uint32_t)(digit & 3) << (2 * t);
+        }
+        chunk_code[r + CHUNK_HALF] = code;
+    }
+
+    __atomic_store_n(&tables_state, TABLES_READY, __ATOMIC_RELEASE);
+}
+
+static packed_trits_t negate_packed(packed_trits_t packed) {
+    // Flip +1 (01) and -1 (11) by toggling the high bit of every non-zero trit
+    return packed ^ ((packed & PACKED_LOW_BITS) << 1);
+}
+
+static packed_trits_t pack_one(int32_t value) {
+    // Work on the magnitude; |INT32_MIN| is representable as uint32_t
+    uint32_t u = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+    packed_trits_t packed = 0;
+
+    for (int shift = 0; u != 0; shift += 2 * CHUNK_TRITS) {
+        uint32_t q = u / CHUNK_BASE;
+        int32_t r = (int32_t)(u - q * CHUNK_BASE);
+        if (r > CHUNK_HALF) {
+            r -= CHUNK_BASE;
+            q++;
+        }
+        packed |= (packed_trits_t)chunk_code[r + CHUNK_HALF] << shift;
+        u = q;
+    }
+
+    return value < 0 ? negate_packed(packed) : packed;
+}
+
+static int32_t unpack_one(packed_trits_t packed) {
+    packed &= PACKED_MASK;
+
+    // Unsigned accumulation wraps instead of overflowing on hand-made input
+    uint32_t value = 0;
+    for (int shift = 4 * 2 * CHUNK_TRITS; shift >= 0; shift -= 2 * CHUNK_TRITS) {
+        value = value * CHUNK_BASE + (uint32_t)chunk_value[(packed >> shift) & (CHUNK_CODES - 1)];
+    }
+
+    return (int32_t)value;
+}
+
+static int format_packed(packed_trits_t packed, char *out) {
+    packed &= PACKED_MASK;
+    if (packed == 0) {
+        out[0] = '0';
+        return 1;
+    }
+
+    // Number of significant trits from the highest set bit
+    int bits = 0;
+#ifdef __GNUC__
+    bits = 64 - __builtin_clzll(packed);
+#else
+    for (packed_trits_t p = packed; p; p >>= 1) bits++;
+#endif
+    int len = (bits + 1) / 2;
+
+    char digits[5 * CHUNK_TRITS];
+    for (int c = 0; c < 5; c++) {
+        memcpy(digits + (4 - c) * CHUNK_TRITS,
+               chunk_chars[(packed >> (2 * CHUNK_TRITS * c)) & (CHUNK_CODES - 1)], CHUNK_TRITS);
+    }
+    memcpy(out, digits + sizeof(digits) - len, len);
+
+    return len;
+}
+
+static void pack_scalar(const int32_t *values, packed_trits_t *packed, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        packed[i] = pack_one(values[i]);
+    }
+}
+
+static void unpack_scalar(const packed_trits_t *packed, int32_t *values, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        values[i] = unpack_one(packed[i]);
+    }
+}
+
+#ifdef TRITCONV_X86
+
+// Unsigned 32-bit division by 243 in every lane: q = (u * 0x86D90545) >> 39
+__attribute__((target("avx2")))
+static __m256i div243_avx2(__m256i u) {
+    const __m256i magic = _mm256_set1_epi32((int32_t)0x86D90545);
+    const __m256i high_dwords = _mm256_set1_epi64x((int64_t)UINT64_C(0xFFFFFFFF00000000));
+    __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(u, magic), 39);
+    __m256i odd = _mm256_srli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(u, 32), magic), 7);
+    return _mm256_or_si256(even, _mm256_and_si256(odd, high_dwords));
+}
+
+// Split u into its balanced low chunk (returned as a packed code) and the rest
+__attribute__((target("avx2")))
+static __m256i next_chunk_avx2(__m256i *u) {
+    const __m256i base = _mm256_set1_epi32(CHUNK_BASE);
+    const __m256i half = _mm256_set1_epi32(CHUNK_HALF);
+    __m256i q = div243_avx2(*u);
+    __m256i r = _mm256_sub_epi32(*u, _mm256_mullo_epi32(q, base));
+    __m256i carry = _mm256_cmpgt_epi32(r, half);
+    r = _mm256_sub_epi32(r, _mm256_and_si256(carry, base));
+    *u = _mm256_sub_epi32(q, carry);
+    return _mm256_i32gather_epi32((const int*)chunk_code, _mm256_add_epi32(r, half), 4);
+}
+
+__attribute__((target("avx2")))
+static void pack_avx2(const int32_t *values, packed_trits_t *packed, size_t count) {
+    const __m256i low_bits = _mm256_set1_epi32(0x55555555);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(values + i));
+        __m256i sign = _mm256_srai_epi32(v, 31);
+        __m256i u = _mm256_abs_epi32(v);
+
+        // Five chunks cover 50 bits; build the low and high dwords separately
+        __m256i c0 = next_chunk_avx2(&u);
+        __m256i c1 = next_chunk_avx2(&u);
+        __m256i c2 = next_chunk_avx2(&u);
+        __m256i c3 = next_chunk_avx2(&u);
+        __m256i c4 = next_chunk_avx2(&u);
+        __m256i lo = _mm256_or_si256(_mm256_or_si256(c0, _mm256_slli_epi32(c1, 10)),
+                                     _mm256_or_si256(_mm256_slli_epi32(c2, 20), _mm256_slli_epi32(c3, 30)));
+        __m256i hi = _mm256_or_si256(_mm256_srli_epi32(c3, 2), _mm256_slli_epi32(c4, 8));
+
+        // Negative inputs: flip every non-zero trit
+        lo = _mm256_xor_si256(lo, _mm256_and_si256(_mm256_slli_epi32(_mm256_and_si256(lo, low_bits), 1), sign));
+        hi = _mm256_xor_si256(hi, _mm256_and_si256(_mm256_slli_epi32(_mm256_and_si256(hi, low_bits), 1), sign));
+
+        __m256i a = _mm256_unpacklo_epi32(lo, hi); // values 0, 1 | 4, 5
+        __m256i b = _mm256_unpackhi_epi32(lo, hi); // values 2, 3 | 6, 7
+        _mm256_storeu_si256((__m256i*)(packed + i), _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256((__m256i*)(packed + i + 4), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+
+    pack_scalar(values + i, packed + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void unpack_avx2(const packed_trits_t *packed, int32_t *values, size_t count) {
+    const __m256i mask = _mm256_set1_epi64x((int64_t)PACKED_MASK);
+    const __m256i chunk_mask = _mm256_set1_epi32(CHUNK_CODES - 1);
+    const __m256i base = _mm256_set1_epi32(CHUNK_BASE);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i p0 = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(packed + i)), mask);
+        __m256i p1 = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(packed + i + 4)), mask);
+
+        // Gather low dwords into one vector and high dwords into another
+        p0 = _mm256_permute4x64_epi64(_mm256_shuffle_epi32(p0, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+        p1 = _mm256_permute4x64_epi64(_mm256_shuffle_epi32(p1, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+        __m256i lo = _mm256_permute2x128_si256(p0, p1, 0x20);
+        __m256i hi = _mm256_permute2x128_si256(p0, p1, 0x31);
+
+        __m256i c0 = _mm256_and_si256(lo, chunk_mask);
+        __m256i c1 = _mm256_and_si256(_mm256_srli_epi32(lo, 10), chunk_mask);
+        __m256i c2 = _mm256_and_si256(_mm256_srli_epi32(lo, 20), chunk_mask);
+        __m256i c3 = _mm256_and_si256(_mm256_or_si256(_mm256_srli_epi32(lo, 30), _mm256_slli_epi32(hi, 2)), chunk_mask);
+        __m256i c4 = _mm256_srli_epi32(hi, 8);
+
+        __m256i v = _mm256_i32gather_epi32(chunk_value, c4, 4);
+        v = _mm256_add_epi32(_mm256_mullo_epi32(v, base), _mm256_i32gather_epi32(chunk_value, c3, 4));
+        v = _mm256_add_epi32(_mm256_mullo_epi32(v, base), _mm256_i32gather_epi32(chunk_value, c2, 4));
+        v = _mm256_add_epi32(_mm256_mullo_epi32(v, base), _mm256_i32gather_epi32(chunk_value, c1, 4));
+        v = _mm256_add_epi32(_mm256_mullo_epi32(v, base), _mm256_i32gather_epi32(chunk_value, c0, 4));
+        _mm256_storeu_si256((__m256i*)(values + i), v);
+    }
+
+    unpack_scalar(packed + i, values + i, count - i);
+}
+
+// SSE4.1 has no gathers, so these kernels work one trit at a time on 4 lanes
+
+__attribute__((target("sse4.1")))
+static void pack_sse41(const int32_t *values, packed_trits_t *packed, size_t count) {
+    const __m128i magic = _mm_set1_epi32((int32_t)0xAAAAAAAB);
+    const __m128i high_dwords = _mm_set1_epi64x((int64_t)UINT64_C(0xFFFFFFFF00000000));
+    const __m128i low_bits = _mm_set1_epi32(0x55555555);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(values + i));
+        __m128i sign = _mm_srai_epi32(v, 31);
+        __m128i u = _mm_abs_epi32(v);
+        __m128i lo = _mm_setzero_si128();
+        __m128i hi = _mm_setzero_si128();
+
+        for (int t = 0; t < BT_MAX_TRITS; t++) {
+            // q = u / 3, r = u % 3; a remainder of 2 becomes trit -1 with a carry
+            __m128i even = _mm_srli_epi64(_mm_mul_epu32(u, magic), 33);
+            __m128i odd = _mm_and_si128(_mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(u, 32), magic), 1), high_dwords);
+            __m128i q = _mm_or_si128(even, odd);
+            __m128i r = _mm_sub_epi32(u, _mm_add_epi32(q, _mm_add_epi32(q, q)));
+            __m128i code = _mm_or_si128(r, _mm_srli_epi32(r, 1));
+            u = _mm_add_epi32(q, _mm_srli_epi32(r, 1));
+
+            if (t < 16) {
+                lo = _mm_or_si128(lo, _mm_sll_epi32(code, _mm_cvtsi32_si128(2 * t)));
+            } else {
+                hi = _mm_or_si128(hi, _mm_sll_epi32(code, _mm_cvtsi32_si128(2 * (t - 16))));
+            }
+        }
+
+        lo = _mm_xor_si128(lo, _mm_and_si128(_mm_slli_epi32(_mm_and_si128(lo, low_bits), 1), sign));
+        hi = _mm_xor_si128(hi, _mm_and_si128(_mm_slli_epi32(_mm_and_si128(hi, low_bits), 1), sign));
+        _mm_storeu_si128((__m128i*)(packed + i), _mm_unpacklo_epi32(lo, hi));
+        _mm_storeu_si128((__m128i*)(packed + i + 2), _mm_unpackhi_epi32(lo, hi));
+    }
+
+    pack_scalar(values + i, packed + i, count - i);
+}
+
+__attribute__((target("sse4.1")))
+static void unpack_sse41(const packed_trits_t *packed, int32_t *values, size_t count) {
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i three = _mm_set1_epi32(3);
+    const __m128i high_mask = _mm_set1_epi32((1 << (2 * (BT_MAX_TRITS - 16))) - 1);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i p0 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(packed + i)), _MM_SHUFFLE(3, 1, 2, 0));
+        __m128i p1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(packed + i + 2)), _MM_SHUFFLE(3, 1, 2, 0));
+        __m128i lo = _mm_unpacklo_epi64(p0, p1);
+        __m128i hi = _mm_and_si128(_mm_unpackhi_epi64(p0, p1), high_mask);
+        __m128i v = _mm_setzero_si128();
+
+        for (int t = BT_MAX_TRITS - 1; t >= 0; t--) {
+            __m128i code = (t < 16) ? _mm_srl_epi32(lo, _mm_cvtsi32_si128(2 * t))
+                                    : _mm_srl_epi32(hi, _mm_cvtsi32_si128(2 * (t - 16)));
+            code = _mm_and_si128(code, three);
+            __m128i low = _mm_and_si128(code, one);
+            __m128i trit = _mm_sub_epi32(low, _mm_and_si128(_mm_slli_epi32(low, 1), code));
+            v = _mm_add_epi32(_mm_add_epi32(v, _mm_add_epi32(v, v)), trit);
+        }
+
+        _mm_storeu_si128((__m128i*)(values + i), v);
+    }
+
+    unpack_scalar(packed + i, values + i, count - i);
+}
+
+#endif // TRITCONV_X86
+
+typedef void (*pack_fn_t)(const int32_t *values, packed_trits_t *packed, size_t count);
+typedef void (*unpack_fn_t)(const packed_trits_t *packed, int32_t *values, size_t count);
+
+typedef struct {
+    bt_kernel_t kernel;
+    pack_fn_t pack;
+    unpack_fn_t unpack;
+} kernel_ops_t;
+
+static const kernel_ops_t scalar_ops = { BT_KERNEL_SCALAR, pack_scalar, unpack_scalar };
+#ifdef TRITCONV_X86
+static const kernel_ops_t sse41_ops = { BT_KERNEL_SSE41, pack_sse41, unpack_sse41 };
+static const kernel_ops_t avx2_ops = { BT_KERNEL_AVX2, pack_avx2, unpack_avx2 };
+#endif
+
+// Selected kernel, NULL until the first batch call or bt_set_kernel. Swapped
+// as one pointer so callers never see a pack and unpack from different
+// kernels; the release store also publishes the tables the kernel reads.
+static const kernel_ops_t *active_ops = NULL;
+
+static bool kernel_supported(bt_kernel_t kernel) {
+    switch (kernel) {
+        case BT_KERNEL_SCALAR:
+            return true;
+#ifdef TRITCONV_X86
+        case BT_KERNEL_SSE41:
+            return __builtin_cpu_supports("sse4.1");
+        case BT_KERNEL_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+// Select a conversion kernel; returns false if the host cannot run it
+bool bt_set_kernel(bt_kernel_t kernel) {
+    init_tables();
+
+    if (kernel == BT_KERNEL_AUTO) {
+        kernel = kernel_supported(BT_KERNEL_AVX2) ? BT_KERNEL_AVX2 :
+                 kernel_supported(BT_KERNEL_SSE41) ? BT_KERNEL_SSE41 : BT_KERNEL_SCALAR;
+    }
+
+    if (!kernel_supported(kernel)) {
+        return false;
+    }
+
+    const kernel_ops_t *ops;
+    switch (kernel) {
+#ifdef TRITCONV_X86
+        case BT_KERNEL_AVX2:
+            ops = &avx2_ops;
+            break;
+        case BT_KERNEL_SSE41:
+            ops = &sse41_ops;
+            break;
+#endif
+        default:
+            ops = &scalar_ops;
+            break;
+    }
+
+    __atomic_store_n(&active_ops, ops, __ATOMIC_RELEASE);
+    return true;
+}
+
+static const kernel_ops_t* get_ops(void) {
+    const kernel_ops_t *ops = __atomic_load_n(&active_ops, __ATOMIC_ACQUIRE);
+    if (!ops) {
+        bt_set_kernel(BT_KERNEL_AUTO);
+        ops = __atomic_load_n(&active_ops, __ATOMIC_ACQUIRE);
+    }
+    return ops;
+}
+
+bt_kernel_t bt_get_kernel(void) {
+    return get_ops()->kernel;
+}
+
+const char* bt_kernel_name(bt_kernel_t kernel) {
+    switch (kernel) {
+        case BT_KERNEL_AUTO:   return "auto";
+        case BT_KERNEL_SCALAR: return "scalar";
+        case BT_KERNEL_SSE41:  return "sse4.1";
+        case BT_KERNEL_AVX2:   return "avx2";
+        default:               return "unknown";
+    }
+}
+
+int bt_format(int32_t value, char *out) {
+    init_tables();
+    return format_packed(pack_one(value), out);
+}
+
+int32_t bt_parse(const char *str, size_t len) {
+    // Unsigned accumulation wraps instead of overflowing on over-long strings
+    uint32_t value = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        value = value * 3 + (uint32_t)(int32_t)char_trit[(uint8_t)str[i]];
+    }
+
+    return (int32_t)value;
+}
+
+void bt_pack_batch(const int32_t *values, packed_trits_t *packed, size_t count) {
+    get_ops()->pack(values, packed, count);
+}
+
+void bt_unpack_batch(const packed_trits_t *packed, int32_t *values, size_t count) {
+    get_ops()->unpack(packed, values, count);
+}
+
+void bt_format_batch(const int32_t *values, char (*strings)[BT_STRING_SIZE], size_t count) {
+    packed_trits_t block[64];
+
+    for (size_t i = 0; i < count; i += 64) {
+        size_t n = (count - i < 64) ? count - i : 64;
+        bt_pack_batch(values + i, block, n);
+
+        for (size_t j = 0; j < n; j++) {
+            int len = format_packed(block[j], strings[i + j]);
+            strings[i + j][len] = '\0';
+        }
+    }
+}
+
+void bt_parse_batch(const char (*strings)[BT_STRING_SIZE], int32_t *values, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        size_t len = 0;
+        while (len < BT_STRING_SIZE && strings[i][len] != '\0') len++;
+        values[i] = bt_parse(strings[i], len);
+    }
+}
@@ -0,0 +1,179 @@
+// Checks every tritconv kernel the host can run against the scalar one,
+// plus pack/unpack and format/parse round trips. Exits non-zero if any
+// check fails. With --full it walks the whole int32 range instead, which
+// takes minutes.
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "tritconv.h"
+
+// Odd so every kernel's vector loop and scalar tail both run
+#define TEST_COUNT 4099
+
+// Values per block of the --full walk
+#define FULL_BLOCK 65536
+
+static const int32_t edge_values[] = {
+    0, 1, -1, 2, -2, 121, -121, 122, -122, 243, -243, 29524, -29524,
+    INT32_MAX, INT32_MIN, INT32_MAX - 1, INT32_MIN + 1
+};
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random(void) {
+    // splitmix64
+    uint64_t z = (rng_state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static int32_t values[TEST_COUNT];
+static int32_t unpacked[TEST_COUNT];
+static int32_t expected_values[TEST_COUNT];
+static packed_trits_t packed[TEST_COUNT];
+static packed_trits_t expected_packed[TEST_COUNT];
+static packed_trits_t noise[TEST_COUNT];
+
+static int failures = 0;
+
+static void fail(const char *kernel, const char *what, size_t i) {
+    if (failures++ < 10) {
+        fprintf(stderr, "FAIL %s: %s at %zu (value %ld)\n", kernel, what, i, (long)values[i]);
+    }
+}
+
+static void check_kernel(bt_kernel_t kernel) {
+    const char *name = bt_kernel_name(kernel);
+    if (!bt_set_kernel(kernel)) {
+        printf("skip %s (not supported here)\n", name);
+        return;
+    }
+    int before = failures;
+
+    // Pack matches the scalar kernel and unpacks back to the input
+    memset(packed, 0, sizeof(packed));
+    bt_pack_batch(values, packed, TEST_COUNT);
+    bt_unpack_batch(packed, unpacked, TEST_COUNT);
+    for (size_t i = 0; i < TEST_COUNT; i++) {
+        if (packed[i] != expected_packed[i]) fail(name, "pack differs from scalar", i);
+        if (unpacked[i] != values[i]) fail(name, "round trip", i);
+    }
+
+    // Unpack of arbitrary bits (unused code 10, bits above the trits) matches too
+    bt_unpack_batch(noise, unpacked, TEST_COUNT);
+    for (size_t i = 0; i < TEST_COUNT; i++) {
+        if (unpacked[i] != expected_values[i]) fail(name, "unpack differs from scalar", i);
+    }
+
+    printf("%s %s\n", failures == before ? "ok  " : "FAIL", name);
+}
+
+static int32_t full_values[FULL_BLOCK];
+static int32_t full_unpacked[FULL_BLOCK];
+static packed_trits_t full_expected[FULL_BLOCK];
+static packed_trits_t full_packed[FULL_BLOCK];
+
+static void full_fail(const char *kernel, const char *what, int32_t value) {
+    if (failures++ < 10) {
+        fprintf(stderr, "FAIL %s: %s for %ld\n", kernel, what, (long)value);
+    }
+}
+
+// Every int32 value, block by block: each kernel packs like the scalar
+// one, and unpacking the scalar result gives the value back
+static int run_full(void) {
+    const bt_kernel_t kernels[] = { BT_KERNEL_SCALAR, BT_KERNEL_SSE41, BT_KERNEL_AVX2 };
+    const size_t kernel_count = sizeof(kernels) / sizeof(kernels[0]);
+    bool supported[sizeof(kernels) / sizeof(kernels[0])];
+    for (size_t k = 0; k < kernel_count; k++) {
+        supported[k] = bt_set_kernel(kernels[k]);
+        printf("%s %s\n", supported[k] ? "full" : "skip", bt_kernel_name(kernels[k]));
+    }
+
+    for (uint64_t start = 0; start < (UINT64_C(1) << 32); start += FULL_BLOCK) {
+        for (size_t i = 0; i < FULL_BLOCK; i++) {
+            full_values[i] = (int32_t)(uint32_t)(start + i);
+        }
+
+        bt_set_kernel(BT_KERNEL_SCALAR);
+        bt_pack_batch(full_values, full_expected, FULL_BLOCK);
+
+        for (size_t k = 0; k < kernel_count; k++) {
+            if (!supported[k]) continue;
+            const char *name = bt_kernel_name(kernels[k]);
+            bt_set_kernel(kernels[k]);
+
+            bt_pack_batch(full_values, full_packed, FULL_BLOCK);
+            bt_unpack_batch(full_expected, full_unpacked, FULL_BLOCK);
+            for (size_t i = 0; i < FULL_BLOCK; i++) {
+                if (full_packed[i] != full_expected[i]) full_fail(name, "pack differs from scalar", full_values[i]);
+                if (full_unpacked[i] != full_values[i]) full_fail(name, "round trip", full_values[i]);
+            }
+        }
+
+        if ((start + FULL_BLOCK) % (UINT64_C(1) << 28) == 0) {
+            printf("%3d/16 of the int32 range checked\n", (int)((start + FULL_BLOCK) >> 28));
+            fflush(stdout);
+        }
+    }
+
+    if (failures > 0) {
+        fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    printf("ok   all 2^32 values\n");
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--full") == 0) {
+        return run_full();
+    }
+
+    size_t edges = sizeof(edge_values) / sizeof(edge_values[0]);
+    for (size_t i = 0; i < TEST_COUNT; i++) {
+        uint64_t r = next_random();
+        if (i < edges) {
+            values[i] = edge_values[i];
+        } else if (i % 3 == 0) {
+            values[i] = (int32_t)(r % 2001) - 1000; // Small values, the common case
+        } else {
+            values[i] = (int32_t)(uint32_t)r;
+        }
+        noise[i] = next_random();
+    }
+
+    if (!bt_set_kernel(BT_KERNEL_SCALAR)) {
+        fprintf(stderr, "FAIL scalar kernel unavailable\n");
+        return 1;
+    }
+    bt_pack_batch(values, expected_packed, TEST_COUNT);
+    bt_unpack_batch(noise, expected_values, TEST_COUNT);
+
+    check_kernel(BT_KERNEL_SCALAR);
+    check_kernel(BT_KERNEL_SSE41);
+    check_kernel(BT_KERNEL_AVX2);
+
+    // Strings: format then parse gives the value back, batch or single
+    static char strings[TEST_COUNT][BT_STRING_SIZE];
+    bt_set_kernel(BT_KERNEL_AUTO);
+    bt_format_batch(values, strings, TEST_COUNT);
+    bt_parse_batch((const char (*)[BT_STRING_SIZE])strings, unpacked, TEST_COUNT);
+    for (size_t i = 0; i < TEST_COUNT; i++) {
+        char single[BT_STRING_SIZE];
+        int len = bt_format(values[i], single);
+        if (unpacked[i] != values[i]) fail("strings", "batch round trip", i);
+        if ((size_t)len != strlen(strings[i]) || memcmp(single, strings[i], (size_t)len) != 0) {
+            fail("strings", "bt_format differs from bt_format_batch", i);
+        }
+        if (bt_parse(single, (size_t)len) != values[i]) fail("strings", "round trip", i);
+    }
+
+    if (failures > 0) {
+        fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    printf("ok   strings\n");
+    return 0;
+}